@@ -4,6 +4,7 @@
 #include "bloom.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "gettext.h"
 #include "hashmap.h"
 #include "commit-graph.h"
 #include "commit.h"
@@ -12,11 +13,21 @@
 #include "tree-walk.h"
 #include "config.h"
 #include "repository.h"
+#include "string-list.h"
+#include "thread-utils.h"
 
 define_commit_slab(bloom_filter_slab, struct bloom_filter);
 
 static struct bloom_filter_slab bloom_filters;
 
+/*
+ * Changed paths computed ahead of time by precompute_bloom_filter_paths(),
+ * waiting for get_or_compute_bloom_filter() to turn them into filters.
+ */
+define_commit_slab(bloom_paths_slab, struct diff_queue_struct *);
+
+static struct bloom_paths_slab bloom_paths;
+
 struct pathmap_hash_entry {
     struct hashmap_entry entry;
     const char path[FLEX_ARRAY];
@@ -264,6 +275,7 @@ void add_key_to_filter(const struct bloom_key *key,
 void init_bloom_filters(void)
 {
 	init_bloom_filter_slab(&bloom_filters);
+	init_bloom_paths_slab(&bloom_paths);
 }
 
 static void free_one_bloom_filter(struct bloom_filter *filter)
@@ -273,9 +285,18 @@ static void free_one_bloom_filter(struct bloom_filter *filter)
 	free(filter->to_free);
 }
 
+static void free_one_bloom_paths(struct diff_queue_struct **q)
+{
+	if (!*q)
+		return;
+	diff_queue_clear(*q);
+	FREE_AND_NULL(*q);
+}
+
 void deinit_bloom_filters(void)
 {
 	deep_clear_bloom_filter_slab(&bloom_filters, free_one_bloom_filter);
+	deep_clear_bloom_paths_slab(&bloom_paths, free_one_bloom_paths);
 }
 
 struct bloom_keyvec *bloom_keyvec_new(const char *path, size_t len,
@@ -433,16 +454,112 @@ struct bloom_filter *get_bloom_filter(struct repository *r, struct commit *c)
 	return filter;
 }
 
-struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
-						 struct commit *c,
-						 int compute_if_not_present,
-						 const struct bloom_filter_settings *settings,
-						 enum bloom_filter_computed *computed)
+/*
+ * Diff "c" against its first parent into a queue of changed paths, taking
+ * the one precompute_bloom_filter_paths() left for it if there is one.
+ * The queue is emptied (and freed) by release_changed_paths().
+ */
+static struct diff_queue_struct *diff_changed_paths(struct repository *r,
+						    struct commit *c,
+						    const struct bloom_filter_settings *settings)
 {
-	struct bloom_filter *filter;
-	int i;
+	struct diff_queue_struct *q, **precomputed;
 	struct diff_options diffopt;
 
+	precomputed = bloom_paths_slab_peek(&bloom_paths, c);
+	if (precomputed && *precomputed) {
+		q = *precomputed;
+		*precomputed = NULL;
+		return q;
+	}
+
+	repo_diff_setup(r, &diffopt);
+	diffopt.flags.recursive = 1;
+	diffopt.detect_rename = 0;
+	diffopt.max_changes = settings->max_changed_paths;
+	diff_setup_done(&diffopt);
+
+	/* ensure commit is parsed so we have parent information */
+	repo_parse_commit(r, c);
+
+	if (c->parents)
+		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
+	else
+		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
+	diffcore_std(&diffopt);
+
+	return &diff_queued_diff;
+}
+
+static void release_changed_paths(struct diff_queue_struct *q)
+{
+	diff_queue_clear(q);
+	if (q != &diff_queued_diff)
+		free(q);
+}
+
+/*
+ * Collect the paths of "q" that go into a filter in "pathmap". Returns -1
+ * if there are more than the settings allow, in which case the filter is
+ * truncated.
+ */
+static int fill_pathmap(struct hashmap *pathmap, struct diff_queue_struct *q,
+			const struct bloom_filter_settings *settings)
+{
+	struct pathmap_hash_entry *e;
+	int i;
+
+	if (q->nr > settings->max_changed_paths)
+		return -1;
+
+	for (i = 0; i < q->nr; i++) {
+		const char *path = q->queue[i]->two->path;
+
+		/*
+		 * Add each leading directory of the changed file, i.e. for
+		 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
+		 * the Bloom filter could be used to speed up commands like
+		 * 'git log dir/subdir', too.
+		 *
+		 * Note that directories are added without the trailing '/'.
+		 */
+		do {
+			char *last_slash = strrchr(path, '/');
+
+			FLEX_ALLOC_STR(e, path, path);
+			hashmap_entry_init(&e->entry, strhash(path));
+
+			if (!hashmap_get(pathmap, &e->entry, NULL))
+				hashmap_add(pathmap, &e->entry);
+			else
+				free(e);
+
+			if (!last_slash)
+				last_slash = (char*)path;
+			*last_slash = '\0';
+
+		} while (*path);
+	}
+
+	if (hashmap_get_size(pathmap) > settings->max_changed_paths)
+		return -1;
+	return 0;
+}
+
+static struct bloom_filter *get_or_compute_bloom_filter_1(struct repository *r,
+							  struct commit *c,
+							  int compute_if_not_present,
+							  const struct bloom_filter_settings *settings,
+							  enum bloom_filter_computed *computed,
+							  struct string_list *paths)
+{
+	struct bloom_filter *filter;
+	struct bloom_filter *found = NULL;
+	struct diff_queue_struct *q;
+	struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
+	struct pathmap_hash_entry *e;
+	struct hashmap_iter iter;
+
 	if (computed)
 		*computed = BLOOM_NOT_COMPUTED;
 
@@ -461,79 +578,41 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 	if (filter->data && filter->len) {
 		struct bloom_filter *upgrade;
 		if (!settings || settings->hash_version == filter->version)
-			return filter;
+			found = filter;
 
 		/* version mismatch, see if we can upgrade */
-		if (compute_if_not_present &&
-		    git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
+		else if (compute_if_not_present &&
+			 git_env_bool("GIT_TEST_UPGRADE_BLOOM_FILTERS", 1)) {
 			upgrade = upgrade_filter(r, c, filter,
 						 settings->hash_version);
 			if (upgrade) {
 				if (computed)
 					*computed |= BLOOM_UPGRADED;
-				return upgrade;
+				found = upgrade;
 			}
 		}
 	}
+	if (found && !paths)
+		return found;
 	if (!compute_if_not_present)
-		return NULL;
-
-	repo_diff_setup(r, &diffopt);
-	diffopt.flags.recursive = 1;
-	diffopt.detect_rename = 0;
-	diffopt.max_changes = settings->max_changed_paths;
-	diff_setup_done(&diffopt);
-
-	/* ensure commit is parsed so we have parent information */
-	repo_parse_commit(r, c);
-
-	if (c->parents)
-		diff_tree_oid(&c->parents->item->object.oid, &c->object.oid, "", &diffopt);
-	else
-		diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
-	diffcore_std(&diffopt);
+		return found;
 
-	if (diff_queued_diff.nr <= settings->max_changed_paths) {
-		struct hashmap pathmap = HASHMAP_INIT(pathmap_cmp, NULL);
-		struct pathmap_hash_entry *e;
-		struct hashmap_iter iter;
-
-		for (i = 0; i < diff_queued_diff.nr; i++) {
-			const char *path = diff_queued_diff.queue[i]->two->path;
-
-			/*
-			 * Add each leading directory of the changed file, i.e. for
-			 * 'dir/subdir/file' add 'dir' and 'dir/subdir' as well, so
-			 * the Bloom filter could be used to speed up commands like
-			 * 'git log dir/subdir', too.
-			 *
-			 * Note that directories are added without the trailing '/'.
-			 */
-			do {
-				char *last_slash = strrchr(path, '/');
-
-				FLEX_ALLOC_STR(e, path, path);
-				hashmap_entry_init(&e->entry, strhash(path));
-
-				if (!hashmap_get(&pathmap, &e->entry, NULL))
-					hashmap_add(&pathmap, &e->entry);
-				else
-					free(e);
-
-				if (!last_slash)
-					last_slash = (char*)path;
-				*last_slash = '\0';
-
-			} while (*path);
-		}
+	q = diff_changed_paths(r, c, settings);
 
-		if (hashmap_get_size(&pathmap) > settings->max_changed_paths) {
-			init_truncated_large_filter(filter,
-						    settings->hash_version);
-			if (computed)
-				*computed |= BLOOM_TRUNC_LARGE;
+	if (fill_pathmap(&pathmap, q, settings) < 0) {
+		if (found)
 			goto cleanup;
+		init_truncated_large_filter(filter, settings->hash_version);
+		if (computed)
+			*computed |= BLOOM_TRUNC_LARGE;
+	} else {
+		if (paths) {
+			hashmap_for_each_entry(&pathmap, &iter, e, entry)
+				string_list_append(paths, e->path);
+			*computed |= BLOOM_PATHS;
 		}
+		if (found)
+			goto cleanup;
 
 		filter->len = (hashmap_get_size(&pathmap) * settings->bits_per_entry + BITS_PER_WORD - 1) / BITS_PER_WORD;
 		filter->version = settings->hash_version;
@@ -551,21 +630,221 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 			add_key_to_filter(&key, filter, settings);
 			bloom_key_clear(&key);
 		}
-
-	cleanup:
-		hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
-	} else {
-		init_truncated_large_filter(filter, settings->hash_version);
-
-		if (computed)
-			*computed |= BLOOM_TRUNC_LARGE;
 	}
+	found = filter;
 
 	if (computed)
 		*computed |= BLOOM_COMPUTED;
 
-	diff_queue_clear(&diff_queued_diff);
-	return filter;
+cleanup:
+	hashmap_clear_and_free(&pathmap, struct pathmap_hash_entry, entry);
+	release_changed_paths(q);
+	return found;
+}
+
+struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
+						 struct commit *c,
+						 int compute_if_not_present,
+						 const struct bloom_filter_settings *settings,
+						 enum bloom_filter_computed *computed)
+{
+	return get_or_compute_bloom_filter_1(r, c, compute_if_not_present,
+					     settings, computed, NULL);
+}
+
+struct bloom_filter *get_or_compute_bloom_filter_paths(struct repository *r,
+						       struct commit *c,
+						       int compute_if_not_present,
+						       const struct bloom_filter_settings *settings,
+						       enum bloom_filter_computed *computed,
+						       struct string_list *paths)
+{
+	return get_or_compute_bloom_filter_1(r, c, compute_if_not_present,
+					     settings, computed, paths);
+}
+
+struct bloom_paths_thread {
+	struct diff_queue_struct *queue;
+	pthread_mutex_t *mutex;
+	int max_changes;
+};
+
+/*
+ * Like diff_addremove() and diff_change(), but queue the pairs in the
+ * queue of the calling thread rather than in diff_queued_diff. Whether
+ * a submodule change is ignored is read from the shared submodule
+ * config, so that is done under the mutex.
+ */
+static void bloom_paths_addremove(struct diff_options *opt, int addremove,
+				  unsigned mode, const struct object_id *oid,
+				  int oid_valid, const char *fullpath,
+				  unsigned dirty_submodule)
+{
+	struct bloom_paths_thread *data = opt->change_fn_data;
+
+	if (S_ISGITLINK(mode))
+		pthread_mutex_lock(data->mutex);
+	diff_queue_addremove(data->queue, opt, addremove, mode, oid,
+			     oid_valid, fullpath, dirty_submodule);
+	if (S_ISGITLINK(mode))
+		pthread_mutex_unlock(data->mutex);
+
+	/* the filter will be truncated, stop collecting paths */
+	if (data->queue->nr > data->max_changes)
+		opt->flags.quick = 1;
+}
+
+static void bloom_paths_change(struct diff_options *opt,
+			       unsigned old_mode, unsigned new_mode,
+			       const struct object_id *old_oid,
+			       const struct object_id *new_oid,
+			       int old_oid_valid, int new_oid_valid,
+			       const char *fullpath,
+			       unsigned old_dirty_submodule,
+			       unsigned new_dirty_submodule)
+{
+	struct bloom_paths_thread *data = opt->change_fn_data;
+	int gitlink = S_ISGITLINK(old_mode) && S_ISGITLINK(new_mode);
+
+	if (gitlink)
+		pthread_mutex_lock(data->mutex);
+	diff_queue_change(data->queue, opt, old_mode, new_mode, old_oid,
+			  new_oid, old_oid_valid, new_oid_valid, fullpath,
+			  old_dirty_submodule, new_dirty_submodule);
+	if (gitlink)
+		pthread_mutex_unlock(data->mutex);
+
+	if (data->queue->nr > data->max_changes)
+		opt->flags.quick = 1;
+}
+
+struct bloom_paths_threads {
+	struct repository *r;
+	const struct bloom_filter_settings *settings;
+	struct commit **commits;
+	struct diff_queue_struct **queues;
+	size_t nr, next;
+	pthread_mutex_t mutex;
+};
+
+static void *bloom_paths_thread(void *data)
+{
+	struct bloom_paths_threads *bt = data;
+
+	while (1) {
+		struct bloom_paths_thread td = {
+			.mutex = &bt->mutex,
+			.max_changes = bt->settings->max_changed_paths,
+		};
+		struct diff_options diffopt;
+		struct commit *c;
+		size_t i;
+
+		pthread_mutex_lock(&bt->mutex);
+		i = bt->next++;
+		if (i < bt->nr) {
+			repo_diff_setup(bt->r, &diffopt);
+			diffopt.flags.recursive = 1;
+			diffopt.detect_rename = 0;
+			diff_setup_done(&diffopt);
+		}
+		pthread_mutex_unlock(&bt->mutex);
+		if (i >= bt->nr)
+			break;
+
+		c = bt->commits[i];
+		td.queue = bt->queues[i];
+		diffopt.add_remove = bloom_paths_addremove;
+		diffopt.change = bloom_paths_change;
+		diffopt.change_fn_data = &td;
+
+		if (c->parents)
+			diff_tree_oid(&c->parents->item->object.oid,
+				      &c->object.oid, "", &diffopt);
+		else
+			diff_tree_oid(NULL, &c->object.oid, "", &diffopt);
+		diff_free(&diffopt);
+	}
+
+	return NULL;
+}
+
+size_t precompute_bloom_filter_paths(struct repository *r,
+				     struct commit **commits, size_t nr,
+				     size_t max_new,
+				     const struct bloom_filter_settings *settings,
+				     int nr_threads)
+{
+	struct bloom_paths_threads bt = {
+		.r = r,
+		.settings = settings,
+	};
+	pthread_t *threads;
+	size_t scanned, i;
+
+	if (!bloom_filters.slab_size)
+		return nr;
+
+	ALLOC_ARRAY(bt.commits, nr);
+	ALLOC_ARRAY(bt.queues, nr);
+	for (scanned = 0; scanned < nr && bt.nr < max_new; scanned++) {
+		struct commit *c = commits[scanned];
+		struct bloom_filter *filter;
+		struct diff_queue_struct **q;
+		uint32_t graph_pos;
+
+		/*
+		 * Leave the commits which may have a filter already to
+		 * get_or_compute_bloom_filter(); only the ones it would have
+		 * to diff are worth doing ahead of time.
+		 */
+		filter = bloom_filter_slab_at(&bloom_filters, c);
+		if (!filter->data &&
+		    repo_find_commit_pos_in_graph(r, c, &graph_pos))
+			load_bloom_filter_from_graph(r->objects->commit_graph,
+						     filter, graph_pos);
+		if (filter->data)
+			continue;
+
+		q = bloom_paths_slab_at(&bloom_paths, c);
+		if (*q)
+			continue;
+
+		/* ensure commit is parsed so we have parent information */
+		repo_parse_commit(r, c);
+
+		CALLOC_ARRAY(*q, 1);
+		diff_queue_init(*q);
+		bt.commits[bt.nr] = c;
+		bt.queues[bt.nr] = *q;
+		bt.nr++;
+	}
+
+	if (nr_threads > bt.nr)
+		nr_threads = bt.nr;
+	if (nr_threads) {
+		pthread_mutex_init(&bt.mutex, NULL);
+		enable_obj_read_lock();
+
+		CALLOC_ARRAY(threads, nr_threads);
+		for (i = 0; i < nr_threads; i++) {
+			int err = pthread_create(&threads[i], NULL,
+						 bloom_paths_thread, &bt);
+			if (err)
+				die(_("unable to create Bloom filter thread: %s"),
+				    strerror(err));
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i], NULL);
+		free(threads);
+
+		disable_obj_read_lock();
+		pthread_mutex_destroy(&bt.mutex);
+	}
+
+	free(bt.commits);
+	free(bt.queues);
+	return scanned;
 }
 
 int bloom_filter_contains(const struct bloom_filter *filter,
@@ -600,6 +879,155 @@ int bloom_filter_contains_vec(const struct bloom_filter *filter,
 	return ret;
 }
 
+struct bloom_probe_key {
+	struct hashmap_entry entry;
+	const uint32_t *hashes;
+	size_t nr;
+};
+
+static int bloom_probe_key_cmp(const void *num_hashes,
+			       const struct hashmap_entry *eptr,
+			       const struct hashmap_entry *entry_or_key,
+			       const void *keydata UNUSED)
+{
+	const struct bloom_probe_key *e1, *e2;
+
+	e1 = container_of(eptr, const struct bloom_probe_key, entry);
+	e2 = container_of(entry_or_key, const struct bloom_probe_key, entry);
+
+	return memcmp(e1->hashes, e2->hashes,
+		      *(const uint32_t *)num_hashes * sizeof(uint32_t));
+}
+
+struct bloom_probe *bloom_probe_new(struct bloom_keyvec **vecs, size_t nr,
+				    const struct bloom_filter_settings *settings)
+{
+	struct bloom_probe *probe;
+	struct hashmap keys;
+	struct bloom_probe_key *e;
+	size_t nr_refs = 0, alloc = 0;
+
+	CALLOC_ARRAY(probe, 1);
+	probe->num_hashes = settings->num_hashes;
+	probe->nr_vecs = nr;
+	ALLOC_ARRAY(probe->vec_end, nr);
+	for (size_t i = 0; i < nr; i++)
+		nr_refs += vecs[i]->count;
+	ALLOC_ARRAY(probe->key_refs, nr_refs);
+
+	/*
+	 * Pathspecs below the same directory share the keys of their
+	 * leading directories; keep one copy of each distinct key so
+	 * that it is tested at most once per filter.
+	 */
+	hashmap_init(&keys, bloom_probe_key_cmp, &probe->num_hashes, 0);
+	nr_refs = 0;
+	for (size_t i = 0; i < nr; i++) {
+		for (size_t j = 0; j < vecs[i]->count; j++) {
+			struct bloom_probe_key k;
+
+			k.hashes = vecs[i]->key[j].hashes;
+			hashmap_entry_init(&k.entry, k.hashes[0]);
+			e = hashmap_get_entry(&keys, &k, entry, NULL);
+			if (!e) {
+				CALLOC_ARRAY(e, 1);
+				e->hashes = k.hashes;
+				e->nr = probe->nr_keys++;
+				hashmap_entry_init(&e->entry, k.hashes[0]);
+				hashmap_add(&keys, &e->entry);
+
+				ALLOC_GROW(probe->hashes,
+					   probe->nr_keys * probe->num_hashes,
+					   alloc);
+				COPY_ARRAY(probe->hashes + e->nr * probe->num_hashes,
+					   k.hashes, probe->num_hashes);
+			}
+			probe->key_refs[nr_refs++] = e->nr;
+		}
+		probe->vec_end[i] = nr_refs;
+	}
+	hashmap_clear_and_free(&keys, struct bloom_probe_key, entry);
+
+	CALLOC_ARRAY(probe->state, probe->nr_keys);
+	return probe;
+}
+
+void bloom_probe_free(struct bloom_probe *probe)
+{
+	if (!probe)
+		return;
+	free(probe->vec_end);
+	free(probe->key_refs);
+	free(probe->hashes);
+	free(probe->state);
+	free(probe);
+}
+
+/*
+ * Whether all the bits of one key are set. All positions are computed
+ * before any is tested so that the divisions, which dominate, do not
+ * wait on one another; filters are nearly always short enough for the
+ * cheaper 32-bit division.
+ */
+static int bloom_probe_key_contains(const struct bloom_filter *filter,
+				    const uint32_t *hashes, uint32_t num_hashes,
+				    uint64_t mod)
+{
+	unsigned char bits = 1;
+
+	if (mod <= UINT32_MAX) {
+		uint32_t mod32 = mod;
+
+		for (uint32_t i = 0; i < num_hashes; i++) {
+			uint32_t pos = hashes[i] % mod32;
+			bits &= filter->data[pos / BITS_PER_WORD] >>
+				(pos & (BITS_PER_WORD - 1));
+		}
+	} else {
+		for (uint32_t i = 0; i < num_hashes; i++) {
+			uint64_t pos = hashes[i] % mod;
+			bits &= filter->data[pos / BITS_PER_WORD] >>
+				(pos & (BITS_PER_WORD - 1));
+		}
+	}
+
+	return bits & 1;
+}
+
+int bloom_filter_contains_probe(const struct bloom_filter *filter,
+				struct bloom_probe *probe)
+{
+	uint64_t mod = filter->len * BITS_PER_WORD;
+	size_t ref = 0;
+
+	if (!mod)
+		return -1;
+
+	memset(probe->state, 0, probe->nr_keys);
+	for (size_t i = 0; i < probe->nr_vecs; i++) {
+		int all = 1;
+
+		for (; ref < probe->vec_end[i]; ref++) {
+			size_t k = probe->key_refs[ref];
+
+			if (!probe->state[k])
+				probe->state[k] = bloom_probe_key_contains(
+					filter,
+					probe->hashes + k * probe->num_hashes,
+					probe->num_hashes, mod) ? 1 : 2;
+			if (probe->state[k] == 2) {
+				all = 0;
+				break;
+			}
+		}
+		if (all)
+			return 1;
+		ref = probe->vec_end[i];
+	}
+
+	return 0;
+}
+
 uint32_t test_bloom_murmur3_seeded(uint32_t seed, const char *data, size_t len,
 				   int version)
 {
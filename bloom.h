@@ -4,6 +4,7 @@
 struct commit;
 struct repository;
 struct commit_graph;
+struct string_list;
 
 struct bloom_filter_settings {
 	/*
@@ -122,6 +123,7 @@ enum bloom_filter_computed {
 	BLOOM_TRUNC_LARGE  = (1 << 2),
 	BLOOM_TRUNC_EMPTY  = (1 << 3),
 	BLOOM_UPGRADED     = (1 << 4),
+	BLOOM_PATHS        = (1 << 5),
 };
 
 struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
@@ -130,6 +132,38 @@ struct bloom_filter *get_or_compute_bloom_filter(struct repository *r,
 						 const struct bloom_filter_settings *settings,
 						 enum bloom_filter_computed *computed);
 
+/*
+ * Like get_or_compute_bloom_filter(), but also append to "paths" the
+ * paths that go into the filter of "c", leading directories included,
+ * and set BLOOM_PATHS in "computed" (which must not be NULL) if it did.
+ * That takes a tree diff even when the filter itself was computed
+ * before; it is not done when "compute_if_not_present" is false, or
+ * when more paths changed than the filter can hold.
+ */
+struct bloom_filter *get_or_compute_bloom_filter_paths(struct repository *r,
+						       struct commit *c,
+						       int compute_if_not_present,
+						       const struct bloom_filter_settings *settings,
+						       enum bloom_filter_computed *computed,
+						       struct string_list *paths);
+
+/*
+ * Run the tree diffs that get_or_compute_bloom_filter() would need for
+ * (at most "max_new" of) the first "nr" commits in "commits", on
+ * "nr_threads" threads. The changed paths are kept until the filter of
+ * each commit is computed, in whatever order the caller asks for them,
+ * so that the filters come out the same as when computed one by one.
+ * Commits that have a filter already are skipped.
+ *
+ * Returns the number of commits that were looked at, which is less than
+ * "nr" if "max_new" commits to diff were found before the end.
+ */
+size_t precompute_bloom_filter_paths(struct repository *r,
+				     struct commit **commits, size_t nr,
+				     size_t max_new,
+				     const struct bloom_filter_settings *settings,
+				     int nr_threads);
+
 /*
  * Find the Bloom filter associated with the given commit "c".
  *
@@ -164,6 +198,37 @@ int bloom_filter_contains_vec(const struct bloom_filter *filter,
 			      const struct bloom_keyvec *v,
 			      const struct bloom_filter_settings *settings);
 
+/*
+ * A bloom_probe tests a filter against the key vectors of several
+ * pathspec items at once: the keys they have in common are tested
+ * once, and the hashes of all keys are kept in a single array.
+ */
+struct bloom_probe {
+	uint32_t num_hashes;
+	size_t nr_vecs, nr_keys;
+	/* the keys of vector i are key_refs[vec_end[i - 1]..vec_end[i]] */
+	size_t *vec_end;
+	size_t *key_refs;
+	/* num_hashes hashes for each distinct key */
+	uint32_t *hashes;
+	/* scratch space: 0 if unknown, 1 if in the filter, 2 if not */
+	unsigned char *state;
+};
+
+struct bloom_probe *bloom_probe_new(struct bloom_keyvec **vecs, size_t nr,
+				    const struct bloom_filter_settings *settings);
+void bloom_probe_free(struct bloom_probe *probe);
+
+/*
+ * bloom_filter_contains_probe - Check if the filter contains all keys of
+ * any of the key vectors of the probe.
+ *
+ * Returns 1 if it does, 0 if it does not, and -1 if the filter is empty,
+ * like calling bloom_filter_contains_vec() for each vector in turn.
+ */
+int bloom_filter_contains_probe(const struct bloom_filter *filter,
+				struct bloom_probe *probe);
+
 uint32_t test_bloom_murmur3_seeded(uint32_t seed, const char *data, size_t len,
 				   int version);
 
@@ -23,27 +23,80 @@
 #include "trace2.h"
 #include "progress.h"
 #include "packfile.h"
+#include "pack.h"
+#include "path.h"
 #include "path-walk.h"
+#include "run-command.h"
+#include "tempfile.h"
+#include "thread-utils.h"
+#include "write-or-die.h"
 
 static const char * const builtin_backfill_usage[] = {
-	N_("git backfill [--min-batch-size=<n>] [--[no-]sparse]"),
+	N_("git backfill [--min-batch-size=<n>] [--[no-]sparse] [--jobs=<n>]"),
 	NULL
 };
 
+struct backfill_batch {
+	struct oid_array oids;
+	struct backfill_batch *next;
+};
+
 struct backfill_context {
 	struct repository *repo;
 	struct oid_array current_batch;
 	size_t min_batch_size;
 	int sparse;
+	int jobs;
+
+	/*
+	 * With more than one job, the path walk runs in its own thread and
+	 * queues full batches in "queue", from where they are fetched in
+	 * parallel. Everything below the mutex is protected by it.
+	 */
+	const char *remote_name;
+	struct oidset queued;
+	int running;
+	struct oid_array failed;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct backfill_batch *queue, **queue_tail;
+	int queue_nr;
+	int walk_done;
 };
 
 static void backfill_context_clear(struct backfill_context *ctx)
 {
 	oid_array_clear(&ctx->current_batch);
+	oid_array_clear(&ctx->failed);
+	oidset_clear(&ctx->queued);
+}
+
+static void queue_batch(struct backfill_context *ctx)
+{
+	struct backfill_batch *batch;
+
+	CALLOC_ARRAY(batch, 1);
+	SWAP(batch->oids, ctx->current_batch);
+
+	pthread_mutex_lock(&ctx->mutex);
+	/* run ahead of the fetches, but not too far */
+	while (ctx->queue_nr >= 2 * ctx->jobs)
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	*ctx->queue_tail = batch;
+	ctx->queue_tail = &batch->next;
+	ctx->queue_nr++;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->mutex);
 }
 
 static void download_batch(struct backfill_context *ctx)
 {
+	if (ctx->jobs > 1) {
+		if (ctx->current_batch.nr)
+			queue_batch(ctx);
+		return;
+	}
+
 	promisor_remote_get_direct(ctx->repo,
 				   ctx->current_batch.oid,
 				   ctx->current_batch.nr);
@@ -67,9 +120,16 @@ static int fill_missing_blobs(const char *path UNUSED,
 		return 0;
 
 	for (size_t i = 0; i < list->nr; i++) {
-		if (!odb_has_object(ctx->repo->objects, &list->oid[i],
-				    OBJECT_INFO_FOR_PREFETCH))
-			oid_array_append(&ctx->current_batch, &list->oid[i]);
+		if (odb_has_object(ctx->repo->objects, &list->oid[i],
+				   OBJECT_INFO_FOR_PREFETCH))
+			continue;
+		/*
+		 * Packs fetched in parallel are only looked at in the end,
+		 * so do not ask twice for a blob seen at another path.
+		 */
+		if (ctx->jobs > 1 && oidset_insert(&ctx->queued, &list->oid[i]))
+			continue;
+		oid_array_append(&ctx->current_batch, &list->oid[i]);
 	}
 
 	if (ctx->current_batch.nr >= ctx->min_batch_size)
@@ -78,7 +138,7 @@ static int fill_missing_blobs(const char *path UNUSED,
 	return 0;
 }
 
-static int do_backfill(struct backfill_context *ctx)
+static int walk_and_download(struct backfill_context *ctx)
 {
 	struct rev_info revs;
 	struct path_walk_info info = PATH_WALK_INFO_INIT;
@@ -113,6 +173,266 @@ static int do_backfill(struct backfill_context *ctx)
 	return ret;
 }
 
+static void *walk_thread(void *data)
+{
+	struct backfill_context *ctx = data;
+	intptr_t ret = walk_and_download(ctx);
+
+	pthread_mutex_lock(&ctx->mutex);
+	ctx->walk_done = 1;
+	pthread_cond_broadcast(&ctx->cond);
+	pthread_mutex_unlock(&ctx->mutex);
+	return (void *)ret;
+}
+
+static int fetch_next_batch(struct child_process *cp,
+			    struct strbuf *out UNUSED,
+			    void *pp_cb, void **pp_task_cb)
+{
+	struct backfill_context *ctx = pp_cb;
+	struct backfill_batch *batch;
+	struct tempfile *input;
+	struct strbuf buf = STRBUF_INIT;
+	char hex[GIT_MAX_HEXSZ + 1];
+
+	/*
+	 * Wait for the walk only when no fetch is running; otherwise come
+	 * back once one of them finished or a little time has passed.
+	 */
+	pthread_mutex_lock(&ctx->mutex);
+	while (!ctx->queue && !ctx->walk_done && !ctx->running)
+		pthread_cond_wait(&ctx->cond, &ctx->mutex);
+	batch = ctx->queue;
+	if (batch) {
+		ctx->queue = batch->next;
+		if (!ctx->queue)
+			ctx->queue_tail = &ctx->queue;
+		ctx->queue_nr--;
+		pthread_cond_broadcast(&ctx->cond);
+	}
+	pthread_mutex_unlock(&ctx->mutex);
+	if (!batch)
+		return 0;
+
+	/* too many objects for a pipe to take before the fetch starts */
+	input = mks_tempfile_t("backfill-XXXXXX");
+	if (!input)
+		die_errno(_("unable to create temporary file"));
+	/* the walk thread may be using oid_to_hex()'s static buffers */
+	for (size_t i = 0; i < batch->oids.nr; i++) {
+		strbuf_addstr(&buf, oid_to_hex_r(hex, &batch->oids.oid[i]));
+		strbuf_addch(&buf, '\n');
+	}
+	if (write_in_full(input->fd, buf.buf, buf.len) < 0 ||
+	    lseek(input->fd, 0, SEEK_SET) < 0)
+		die_errno(_("unable to write temporary file"));
+	strbuf_release(&buf);
+
+	promisor_remote_fetch_command(ctx->repo, ctx->remote_name, 1, cp);
+	strvec_push(&cp->args, "--no-auto-maintenance");
+	cp->no_stdin = 0;
+	cp->in = xdup(input->fd);
+	delete_tempfile(&input);
+
+	trace2_data_intmax("backfill", ctx->repo, "fetch_count", batch->oids.nr);
+	ctx->running++;
+	*pp_task_cb = batch;
+	return 1;
+}
+
+static int fetch_batch_failed(struct backfill_context *ctx,
+			      struct backfill_batch *batch)
+{
+	for (size_t i = 0; i < batch->oids.nr; i++)
+		oid_array_append(&ctx->failed, &batch->oids.oid[i]);
+	oid_array_clear(&batch->oids);
+	free(batch);
+	return 0;
+}
+
+static int fetch_start_failure(struct strbuf *out UNUSED,
+			       void *pp_cb, void *pp_task_cb)
+{
+	struct backfill_context *ctx = pp_cb;
+
+	ctx->running--;
+	return fetch_batch_failed(ctx, pp_task_cb);
+}
+
+static int fetch_batch_finished(int result, struct strbuf *out UNUSED,
+				void *pp_cb, void *pp_task_cb)
+{
+	struct backfill_context *ctx = pp_cb;
+	struct backfill_batch *batch = pp_task_cb;
+
+	ctx->running--;
+	if (result)
+		return fetch_batch_failed(ctx, batch);
+
+	oid_array_clear(&batch->oids);
+	free(batch);
+	return 0;
+}
+
+static void add_promisor_pack_names(struct repository *r, struct strset *set)
+{
+	for (struct packed_git *p = get_all_packs(r); p; p = p->next)
+		if (p->pack_local && p->pack_promisor && !p->pack_keep)
+			strset_add(set, pack_basename(p));
+}
+
+/*
+ * Pack the objects of the promisor packs that the parallel fetches left
+ * behind into a single promisor pack, and drop those packs.
+ */
+static void consolidate_packs(struct backfill_context *ctx,
+			      struct strset *old_packs)
+{
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	struct string_list new_packs = STRING_LIST_INIT_DUP;
+	struct string_list_item *item;
+	struct strbuf line = STRBUF_INIT;
+	FILE *out;
+
+	for (struct packed_git *p = get_all_packs(ctx->repo); p; p = p->next)
+		if (p->pack_local && p->pack_promisor && !p->pack_keep &&
+		    !strset_contains(old_packs, pack_basename(p)))
+			string_list_append(&new_packs, pack_basename(p));
+	if (new_packs.nr < 2)
+		goto cleanup;
+
+	trace2_region_enter("backfill", "consolidate", ctx->repo);
+	cmd.git_cmd = 1;
+	cmd.in = -1;
+	cmd.out = -1;
+	strvec_pushl(&cmd.args, "pack-objects", "--stdin-packs", "-q",
+		     "--delta-base-offset", NULL);
+	strvec_pushf(&cmd.args, "%s/pack/pack",
+		     repo_get_object_directory(ctx->repo));
+	if (start_command(&cmd)) {
+		error(_("could not start pack-objects to consolidate packs"));
+		goto leave;
+	}
+
+	for_each_string_list_item(item, &new_packs) {
+		strbuf_addf(&line, "%s\n", item->string);
+		write_or_die(cmd.in, line.buf, line.len);
+		strbuf_reset(&line);
+	}
+	close(cmd.in);
+
+	out = xfdopen(cmd.out, "r");
+	if (strbuf_getline_lf(&line, out) == EOF ||
+	    line.len != ctx->repo->hash_algo->hexsz) {
+		fclose(out);
+		finish_command(&cmd);
+		error(_("pack-objects did not consolidate the fetched packs"));
+		goto leave;
+	}
+	fclose(out);
+	if (finish_command(&cmd)) {
+		error(_("could not consolidate the fetched packs"));
+		goto leave;
+	}
+
+	/* the objects came from a promisor remote, like those of the packs */
+	write_promisor_file(mkpath("%s/pack/pack-%s.promisor",
+				   repo_get_object_directory(ctx->repo),
+				   line.buf), NULL, 0);
+
+	for_each_string_list_item(item, &new_packs) {
+		const char *pack_hash;
+
+		/* pack-objects may have written the very same pack */
+		if (skip_prefix(item->string, "pack-", &pack_hash) &&
+		    starts_with(pack_hash, line.buf))
+			continue;
+		unlink_pack_path(mkpath("%s/pack/%s",
+					repo_get_object_directory(ctx->repo),
+					item->string), 0);
+	}
+	reprepare_packed_git(ctx->repo);
+	trace2_data_intmax("backfill", ctx->repo, "consolidated_packs",
+			   new_packs.nr);
+
+leave:
+	trace2_region_leave("backfill", "consolidate", ctx->repo);
+cleanup:
+	strbuf_release(&line);
+	string_list_clear(&new_packs, 0);
+}
+
+static int do_parallel_backfill(struct backfill_context *ctx)
+{
+	struct promisor_remote *remote = repo_promisor_remote_find(ctx->repo, NULL);
+	struct run_process_parallel_opts opts = {
+		.tr2_category = "backfill",
+		.tr2_label = "fetch",
+
+		.processes = ctx->jobs,
+
+		.get_next_task = fetch_next_batch,
+		.start_failure = fetch_start_failure,
+		.task_finished = fetch_batch_finished,
+		.data = ctx,
+	};
+	struct strset old_packs = STRSET_INIT;
+	pthread_t walker;
+	void *walk_ret;
+	int err;
+
+	if (!remote)
+		return walk_and_download(ctx);
+	ctx->remote_name = remote->name;
+
+	add_promisor_pack_names(ctx->repo, &old_packs);
+
+	pthread_mutex_init(&ctx->mutex, NULL);
+	pthread_cond_init(&ctx->cond, NULL);
+	ctx->queue_tail = &ctx->queue;
+	err = pthread_create(&walker, NULL, walk_thread, ctx);
+	if (err)
+		die(_("unable to create backfill thread: %s"), strerror(err));
+
+	run_processes_parallel(&opts);
+
+	pthread_join(walker, &walk_ret);
+	pthread_cond_destroy(&ctx->cond);
+	pthread_mutex_destroy(&ctx->mutex);
+
+	reprepare_packed_git(ctx->repo);
+
+	/*
+	 * Leave what the parallel fetches did not get to the usual way,
+	 * which tries the other promisor remotes, too.
+	 */
+	oid_array_clear(&ctx->current_batch);
+	for (size_t i = 0; i < ctx->failed.nr; i++)
+		if (!odb_has_object(ctx->repo->objects, &ctx->failed.oid[i],
+				    OBJECT_INFO_FOR_PREFETCH))
+			oid_array_append(&ctx->current_batch,
+					 &ctx->failed.oid[i]);
+	if (ctx->current_batch.nr) {
+		promisor_remote_get_direct(ctx->repo,
+					   ctx->current_batch.oid,
+					   ctx->current_batch.nr);
+		oid_array_clear(&ctx->current_batch);
+		reprepare_packed_git(ctx->repo);
+	}
+
+	consolidate_packs(ctx, &old_packs);
+
+	strset_clear(&old_packs);
+	return (intptr_t)walk_ret;
+}
+
+static int do_backfill(struct backfill_context *ctx)
+{
+	if (ctx->jobs > 1)
+		return do_parallel_backfill(ctx);
+	return walk_and_download(ctx);
+}
+
 int cmd_backfill(int argc, const char **argv, const char *prefix, struct repository *repo)
 {
 	int result;
@@ -121,12 +441,17 @@ int cmd_backfill(int argc, const char **argv, const char *prefix, struct reposit
 		.current_batch = OID_ARRAY_INIT,
 		.min_batch_size = 50000,
 		.sparse = 0,
+		.jobs = 1,
+		.failed = OID_ARRAY_INIT,
+		.queued = OIDSET_INIT,
 	};
 	struct option options[] = {
 		OPT_UNSIGNED(0, "min-batch-size", &ctx.min_batch_size,
 			     N_("Minimum number of objects to request at a time")),
 		OPT_BOOL(0, "sparse", &ctx.sparse,
 			 N_("Restrict the missing objects to the current sparse-checkout")),
+		OPT_INTEGER('j', "jobs", &ctx.jobs,
+			    N_("Number of batches to fetch in parallel")),
 		OPT_END(),
 	};
 
@@ -141,6 +466,13 @@ int cmd_backfill(int argc, const char **argv, const char *prefix, struct reposit
 	if (ctx.sparse < 0)
 		ctx.sparse = core_apply_sparse_checkout;
 
+	if (ctx.jobs < 1)
+		ctx.jobs = online_cpus();
+	if (!HAVE_THREADS && ctx.jobs > 1) {
+		warning(_("no threads support, ignoring --jobs"));
+		ctx.jobs = 1;
+	}
+
 	result = do_backfill(&ctx);
 	backfill_context_clear(&ctx);
 	return result;
@@ -17,6 +17,7 @@ static void packet_to_pc_item(const char *buffer, int len,
 	const struct pc_item_fixed_portion *fixed_portion;
 	const char *variant;
 	char *encoding;
+	char *filter_driver = NULL;
 
 	if (len < sizeof(struct pc_item_fixed_portion))
 		BUG("checkout worker received too short item (got %dB, exp %dB)",
@@ -25,7 +26,8 @@ static void packet_to_pc_item(const char *buffer, int len,
 	fixed_portion = (struct pc_item_fixed_portion *)buffer;
 
 	if (len - sizeof(struct pc_item_fixed_portion) !=
-		fixed_portion->name_len + fixed_portion->working_tree_encoding_len)
+		fixed_portion->name_len + fixed_portion->working_tree_encoding_len +
+		fixed_portion->filter_driver_len)
 		BUG("checkout worker received corrupted item");
 
 	variant = buffer + sizeof(struct pc_item_fixed_portion);
@@ -44,6 +46,12 @@ static void packet_to_pc_item(const char *buffer, int len,
 		encoding = NULL;
 	}
 
+	if (fixed_portion->filter_driver_len) {
+		filter_driver = xmemdupz(variant,
+					 fixed_portion->filter_driver_len);
+		variant += fixed_portion->filter_driver_len;
+	}
+
 	memset(pc_item, 0, sizeof(*pc_item));
 	pc_item->ce = make_empty_transient_cache_entry(fixed_portion->name_len, NULL);
 	pc_item->ce->ce_namelen = fixed_portion->name_len;
@@ -55,6 +63,13 @@ static void packet_to_pc_item(const char *buffer, int len,
 	pc_item->ca.crlf_action = fixed_portion->crlf_action;
 	pc_item->ca.ident = fixed_portion->ident;
 	pc_item->ca.working_tree_encoding = encoding;
+
+	if (filter_driver) {
+		if (set_conv_attrs_driver(&pc_item->ca, filter_driver))
+			die(_("checkout worker: filter driver '%s' is not configured"),
+			    filter_driver);
+		free(filter_driver);
+	}
 }
 
 static void report_result(struct parallel_checkout_item *pc_item)
@@ -36,6 +36,7 @@
 #include "iterator.h"
 #include "sigchain.h"
 #include "branch.h"
+#include "checkout-stream.h"
 #include "remote.h"
 #include "run-command.h"
 #include "setup.h"
@@ -70,6 +71,7 @@ static int option_local = -1, option_no_hardlinks, option_shared;
 static int option_tags = 1; /* default enabled */
 static int option_shallow_submodules;
 static int config_reject_shallow = -1;    /* unspecified */
+static int config_stream_checkout = -1;   /* unspecified */
 static char *remote_name = NULL;
 static char *option_branch = NULL;
 static int option_verbosity;
@@ -685,6 +687,8 @@ static int checkout(int submodule_progress, int filter_submodules,
 		die(_("unable to parse commit %s"), oid_to_hex(&oid));
 	if (parse_tree(tree) < 0)
 		exit(128);
+	/* files written while the pack came in are up to date already */
+	checkout_stream_load(the_repository->index, &tree->object.oid);
 	init_tree_desc(&t, &tree->object.oid, tree->buffer, tree->size);
 	if (unpack_trees(1, &t, &opts) < 0)
 		die(_("unable to checkout working tree"));
@@ -750,6 +754,8 @@ static int git_clone_config(const char *k, const char *v,
 	}
 	if (!strcmp(k, "clone.rejectshallow"))
 		config_reject_shallow = git_config_bool(k, v);
+	if (!strcmp(k, "clone.streamcheckout"))
+		config_stream_checkout = git_config_bool(k, v);
 	if (!strcmp(k, "clone.filtersubmodules"))
 		config_filter_submodules = git_config_bool(k, v);
 
@@ -868,6 +874,8 @@ int cmd_clone(int argc,
 {
 	int is_bundle = 0, is_local;
 	int reject_shallow = 0;
+	int stream_checkout = 0;
+	char *stream_checkout_dir = NULL;
 	const char *repo_name, *repo, *work_tree, *git_dir;
 	char *repo_to_free = NULL;
 	char *path = NULL, *dir, *display_repo = NULL;
@@ -891,6 +899,7 @@ int cmd_clone(int argc,
 	enum ref_storage_format ref_storage_format = REF_STORAGE_FORMAT_UNKNOWN;
 	const int do_not_override_repo_unix_permissions = -1;
 	int option_reject_shallow = -1; /* unspecified */
+	int option_stream_checkout = -1; /* unspecified */
 	int deepen = 0;
 	char *option_template = NULL, *option_depth = NULL, *option_since = NULL;
 	char *option_origin = NULL;
@@ -921,6 +930,8 @@ int cmd_clone(int argc,
 			 N_("don't clone shallow repository")),
 		OPT_BOOL('n', "no-checkout", &option_no_checkout,
 			 N_("don't create a checkout")),
+		OPT_BOOL(0, "stream-checkout", &option_stream_checkout,
+			 N_("write out files while the pack is received")),
 		OPT_BOOL(0, "bare", &option_bare, N_("create a bare repository")),
 		OPT_HIDDEN_BOOL(0, "naked", &option_bare,
 				N_("create a bare repository")),
@@ -1252,6 +1263,10 @@ int cmd_clone(int argc,
 		reject_shallow = config_reject_shallow;
 	if (option_reject_shallow != -1)
 		reject_shallow = option_reject_shallow;
+	if (config_stream_checkout != -1)
+		stream_checkout = config_stream_checkout;
+	if (option_stream_checkout != -1)
+		stream_checkout = option_stream_checkout;
 
 	/*
 	 * If option_filter_submodules is specified from CLI option,
@@ -1595,6 +1610,16 @@ int cmd_clone(int argc,
 	if (is_local)
 		clone_local(path, git_dir);
 	else if (mapped_refs && complete_refs_before_fetch) {
+		const struct ref *head = our_head_points_at ?
+			our_head_points_at : remote_head;
+
+		if (stream_checkout && !option_no_checkout &&
+		    !option_sparse_checkout && head && transport->smart_options) {
+			stream_checkout_dir = absolute_pathdup(work_tree);
+			transport->smart_options->stream_checkout = &head->old_oid;
+			transport->smart_options->stream_checkout_dir =
+				stream_checkout_dir;
+		}
 		if (transport_fetch_refs(transport, mapped_refs))
 			die(_("remote transport reported error"));
 	}
@@ -1643,6 +1668,7 @@ int cmd_clone(int argc,
 	free(dir);
 	free(path);
 	free(repo_to_free);
+	free(stream_checkout_dir);
 	junk_mode = JUNK_LEAVE_ALL;
 
 	transport_ls_refs_options_release(&transport_ls_refs_options);
@@ -13,6 +13,7 @@
 #include "fsck.h"
 #include "parse-options.h"
 #include "progress.h"
+#include "thread-utils.h"
 #include "streaming.h"
 #include "packfile.h"
 #include "object-file.h"
@@ -51,6 +52,7 @@ static int show_progress = -1;
 static int show_dangling = 1;
 static int name_objects;
 static int check_references = 1;
+static int nr_threads = 1;
 #define ERROR_OBJECT 01
 #define ERROR_REACHABLE 02
 #define ERROR_PACK 04
@@ -928,7 +930,8 @@ static char const * const fsck_usage[] = {
 	N_("git fsck [--tags] [--root] [--unreachable] [--cache] [--no-reflogs]\n"
 	   "         [--[no-]full] [--strict] [--verbose] [--lost-found]\n"
 	   "         [--[no-]dangling] [--[no-]progress] [--connectivity-only]\n"
-	   "         [--[no-]name-objects] [--[no-]references] [<object>...]"),
+	   "         [--[no-]name-objects] [--[no-]references] [--threads=<n>]\n"
+	   "         [<object>...]"),
 	NULL
 };
 
@@ -948,6 +951,7 @@ static struct option fsck_opts[] = {
 	OPT_BOOL(0, "progress", &show_progress, N_("show progress")),
 	OPT_BOOL(0, "name-objects", &name_objects, N_("show verbose names for reachable objects")),
 	OPT_BOOL(0, "references", &check_references, N_("check reference database consistency")),
+	OPT_INTEGER(0, "threads", &nr_threads, N_("use <n> threads to check packed objects")),
 	OPT_END(),
 };
 
@@ -979,6 +983,15 @@ int cmd_fsck(int argc,
 	if (verbose)
 		show_progress = 0;
 
+	if (nr_threads < 0)
+		die(_("invalid number of threads specified (%d)"), nr_threads);
+	if (!nr_threads)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS && nr_threads > 1) {
+		warning(_("no threads support, ignoring --threads"));
+		nr_threads = 1;
+	}
+
 	if (write_lost_and_found) {
 		check_full = 1;
 		include_reflogs = 0;
@@ -1024,7 +1037,7 @@ int cmd_fsck(int argc,
 				/* verify gives error messages itself */
 				if (verify_pack(the_repository,
 						p, fsck_obj_buffer,
-						progress, count))
+						progress, count, nr_threads))
 					errors_found |= ERROR_PACK;
 				count += p->num_objects;
 			}
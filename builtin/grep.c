@@ -30,6 +30,7 @@
 #include "odb.h"
 #include "packfile.h"
 #include "pager.h"
+#include "promisor-remote.h"
 #include "path.h"
 #include "read-cache-ll.h"
 #include "write-or-die.h"
@@ -232,6 +233,7 @@ static void start_threads(struct grep_opt *opt)
 	pthread_cond_init(&cond_result, NULL);
 	grep_use_locks = 1;
 	enable_obj_read_lock();
+	promisor_remote_start_batching(the_repository);
 
 	for (i = 0; i < ARRAY_SIZE(todo); i++) {
 		strbuf_init(&todo[i].out, 0);
@@ -286,6 +288,7 @@ static int wait_all(void)
 	pthread_cond_destroy(&cond_write);
 	pthread_cond_destroy(&cond_result);
 	grep_use_locks = 0;
+	promisor_remote_stop_batching();
 	disable_obj_read_lock();
 
 	return hit;
@@ -367,6 +370,11 @@ static int grep_oid(struct grep_opt *opt, const struct object_id *oid,
 	strbuf_release(&pathbuf);
 
 	if (num_threads > 1) {
+		/*
+		 * Have a missing blob fetched along with the others before a
+		 * worker gets to it.
+		 */
+		promisor_remote_queue(opt->repo, oid);
 		/*
 		 * add_work() copies gs and thus assumes ownership of
 		 * its fields, so do not call grep_source_clear()
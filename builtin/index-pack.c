@@ -10,6 +10,7 @@
 #include "pack.h"
 #include "csum-file.h"
 #include "blob.h"
+#include "checkout-stream.h"
 #include "commit.h"
 #include "tag.h"
 #include "tree.h"
@@ -33,7 +34,7 @@
 #include "strvec.h"
 
 static const char index_pack_usage[] =
-"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--[no-]rev-index] [--verify] [--strict[=<msg-id>=<severity>...]] [--fsck-objects[=<msg-id>=<severity>...]] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
+"git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--[no-]rev-index] [--verify] [--strict[=<msg-id>=<severity>...]] [--fsck-objects[=<msg-id>=<severity>...]] [--check-links] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
 
 struct object_entry {
 	struct pack_idx_entry idx;
@@ -142,6 +143,7 @@ static const char *progress_title;
 static int show_resolving_progress;
 static int show_stat;
 static int check_self_contained_and_connected;
+static struct checkout_stream *checkout_stream;
 
 static struct progress *progress;
 
@@ -651,6 +653,14 @@ static void *get_data_from_pack(struct object_entry *obj)
 	return unpack_data(obj, NULL, NULL);
 }
 
+static void *reread_for_checkout(void *handle, unsigned long *size)
+{
+	struct object_entry *obj = handle;
+
+	*size = obj->size;
+	return get_data_from_pack(obj);
+}
+
 static int compare_ofs_delta_bases(off_t offset1, off_t offset2,
 				   enum object_type type1,
 				   enum object_type type2)
@@ -977,6 +987,10 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 		read_unlock();
 	}
 
+	if (checkout_stream)
+		checkout_stream_object(checkout_stream, oid, type, data, size,
+				       obj_entry);
+
 	free(new_data);
 }
 
@@ -1284,7 +1298,8 @@ static void parse_pack_objects(unsigned char *hash)
 			obj->real_type = OBJ_BAD;
 			nr_delays++;
 		} else
-			sha1_object(data, NULL, obj->size, obj->type,
+			/* with "obj" to find it by should it be needed again */
+			sha1_object(data, obj, obj->size, obj->type,
 				    &obj->idx.oid);
 		free(data);
 		display_progress(progress, i+1);
@@ -1893,6 +1908,7 @@ int cmd_index_pack(int argc,
 	const char *index_name = NULL, *pack_name = NULL, *rev_index_name = NULL;
 	const char *keep_msg = NULL;
 	const char *promisor_msg = NULL;
+	const char *stream_checkout = NULL, *stream_checkout_dir = NULL;
 	struct strbuf index_name_buf = STRBUF_INIT;
 	struct strbuf rev_index_name_buf = STRBUF_INIT;
 	struct pack_idx_entry **idx_objects;
@@ -1941,6 +1957,8 @@ int cmd_index_pack(int argc,
 			} else if (!strcmp(arg, "--check-self-contained-and-connected")) {
 				strict = 1;
 				check_self_contained_and_connected = 1;
+			} else if (!strcmp(arg, "--check-links")) {
+				strict = 1;
 			} else if (skip_to_optional_arg(arg, "--fsck-objects", &arg)) {
 				do_fsck_object = 1;
 				fsck_set_msg_types(&fsck_options, arg);
@@ -1957,6 +1975,10 @@ int cmd_index_pack(int argc,
 				; /* nothing to do */
 			} else if (skip_to_optional_arg(arg, "--promisor", &promisor_msg)) {
 				record_outgoing_links = 1;
+			} else if (skip_prefix(arg, "--stream-checkout=", &arg)) {
+				stream_checkout = arg;
+			} else if (skip_prefix(arg, "--stream-checkout-dir=", &arg)) {
+				stream_checkout_dir = arg;
 			} else if (starts_with(arg, "--threads=")) {
 				char *end;
 				nr_threads = strtoul(arg+10, &end, 0);
@@ -2025,6 +2047,10 @@ int cmd_index_pack(int argc,
 		die(_("--stdin requires a git repository"));
 	if (from_stdin && hash_algo)
 		die(_("options '%s' and '%s' cannot be used together"), "--object-format", "--stdin");
+	if (stream_checkout && !from_stdin)
+		die(_("the option '%s' requires '%s'"), "--stream-checkout", "--stdin");
+	if (stream_checkout && !stream_checkout_dir)
+		die(_("the option '%s' requires '%s'"), "--stream-checkout", "--stream-checkout-dir");
 	if (!index_name && pack_name)
 		index_name = derive_filename(pack_name, "pack", "idx", &index_name_buf);
 
@@ -2075,6 +2101,16 @@ int cmd_index_pack(int argc,
 			nr_threads = 20; /* hard cap */
 	}
 
+	if (stream_checkout && checkout_stream_possible(the_repository)) {
+		struct object_id oid;
+
+		if (get_oid_hex(stream_checkout, &oid))
+			die(_("bad %s"), "--stream-checkout");
+		checkout_stream = checkout_stream_start(the_repository, &oid,
+							stream_checkout_dir,
+							reread_for_checkout);
+	}
+
 	curr_pack = open_pack_file(pack_name);
 	parse_pack_header();
 	CALLOC_ARRAY(objects, st_add(nr_objects, 1));
@@ -2082,9 +2118,16 @@ int cmd_index_pack(int argc,
 		CALLOC_ARRAY(obj_stat, st_add(nr_objects, 1));
 	CALLOC_ARRAY(ofs_deltas, nr_objects);
 	parse_pack_objects(pack_hash);
+	if (checkout_stream)
+		checkout_stream_received(checkout_stream);
 	if (report_end_of_input)
 		write_in_full(2, "\0", 1);
 	resolve_deltas(&opts);
+	/* before fixing a thin pack moves "objects" the handles point into */
+	if (checkout_stream) {
+		checkout_stream_finish(checkout_stream);
+		checkout_stream = NULL;
+	}
 	conclude_pack(fix_thin_pack, curr_pack, pack_hash);
 	free(ofs_deltas);
 	free(ref_deltas);
@@ -21,6 +21,7 @@
 #include "commit.h"
 #include "diff.h"
 #include "diff-merges.h"
+#include "diff-prefetch.h"
 #include "revision.h"
 #include "log-tree.h"
 #include "builtin.h"
@@ -46,6 +47,7 @@
 #include "tmp-objdir.h"
 #include "tree.h"
 #include "write-or-die.h"
+#include "thread-utils.h"
 
 #define MAIL_DEFAULT_WRAP 72
 #define COVER_FROM_AUTO_MAX_SUBJECT_LEN 100
@@ -391,8 +393,143 @@ static void cmd_log_init(int argc, const char **argv, const char *prefix,
 	cmd_log_init_finish(argc, argv, prefix, rev, opt, cfg);
 }
 
+/*
+ * With log.diffThreads, the walk runs up to LOG_LOOKAHEAD_COMMITS commits
+ * ahead of the one being shown, and worker threads read the blobs their
+ * diffs need, up to LOG_LOOKAHEAD_MAX_BYTES of them, while it is shown.
+ */
+#define LOG_LOOKAHEAD_COMMITS 32
+#define LOG_LOOKAHEAD_MAX_BYTES (64 * 1024 * 1024)
+
+struct log_lookahead_entry {
+	struct commit *commit;
+	unsigned prefetched : 1;
+};
+
+struct log_lookahead {
+	struct diff_prefetch *prefetch;
+	struct log_lookahead_entry queue[LOG_LOOKAHEAD_COMMITS];
+	size_t first, nr;
+	/* whether the commit being shown has its diff queued for prefetch */
+	unsigned showing_prefetched : 1;
+	/* get_revision() ran out of commits, or of --max-count */
+	unsigned exhausted : 1,
+		 at_max_count : 1;
+};
+
+static void log_lookahead_init(struct rev_info *rev, struct log_lookahead *la)
+{
+	int nr_threads = 1;
+
+	memset(la, 0, sizeof(*la));
+
+	repo_config_get_int(rev->repo, "log.diffthreads", &nr_threads);
+	if (nr_threads < 1)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS || nr_threads == 1)
+		return;
+
+	/* only diffs that look at the contents of the blobs benefit */
+	if (!rev->diff ||
+	    (!(rev->diffopt.output_format & (DIFF_FORMAT_PATCH |
+					     DIFF_FORMAT_DIFFSTAT |
+					     DIFF_FORMAT_NUMSTAT |
+					     DIFF_FORMAT_SHORTSTAT |
+					     DIFF_FORMAT_DIRSTAT)) &&
+	     !rev->diffopt.detect_rename && !rev->diffopt.pickaxe_opts))
+		return;
+
+	/*
+	 * Walking ahead must not change what is shown: leave alone the
+	 * modes where showing a commit depends on the state of the walk
+	 * (graph, linear breaks, boundaries, reflogs, parents saved for
+	 * --full-diff), or where the diff depends on earlier commits.
+	 */
+	if (rev->graph || rev->track_linear || rev->boundary ||
+	    rev->reflog_info || rev->remerge_diff ||
+	    rev->line_level_traverse || rev->diffopt.flags.follow_renames ||
+	    (rev->full_diff && (rev->rewrite_parents || rev->children.name)))
+		return;
+
+	/* the thread showing the commits is one of them */
+	la->prefetch = diff_prefetch_start(rev->repo, &rev->diffopt.pathspec,
+					   nr_threads - 1,
+					   LOG_LOOKAHEAD_MAX_BYTES);
+}
+
+/*
+ * Queue the diff log_tree_diff() is going to show for "commit", if it is
+ * a single-parent or root one.
+ */
+static int log_lookahead_prefetch(struct rev_info *rev,
+				  struct diff_prefetch *prefetch,
+				  struct commit *commit)
+{
+	struct commit_list *parents;
+
+	if (repo_parse_commit(rev->repo, commit))
+		return 0;
+	parents = get_saved_parents(rev, commit);
+	if (!parents) {
+		if (!rev->show_root_diff)
+			return 0;
+		diff_prefetch_add(prefetch, NULL, get_commit_tree_oid(commit));
+		return 1;
+	}
+	if (parents->next || repo_parse_commit(rev->repo, parents->item))
+		return 0;
+	diff_prefetch_add(prefetch, get_commit_tree_oid(parents->item),
+			  get_commit_tree_oid(commit));
+	return 1;
+}
+
+static struct commit *log_lookahead_next(struct rev_info *rev,
+					 struct log_lookahead *la)
+{
+	struct log_lookahead_entry *e;
+
+	if (!la->prefetch)
+		return get_revision(rev);
+
+	if (la->showing_prefetched)
+		diff_prefetch_done(la->prefetch);
+	la->showing_prefetched = 0;
+
+	while (la->nr < LOG_LOOKAHEAD_COMMITS) {
+		struct commit *commit;
+
+		/*
+		 * A commit that was not shown gives its --max-count slot
+		 * back, so the walk may go on after all.
+		 */
+		if (la->exhausted && !(la->at_max_count && rev->max_count > 0))
+			break;
+
+		commit = get_revision(rev);
+		if (!commit) {
+			la->exhausted = 1;
+			la->at_max_count = !rev->max_count;
+			break;
+		}
+		la->exhausted = 0;
+
+		e = &la->queue[(la->first + la->nr++) % LOG_LOOKAHEAD_COMMITS];
+		e->commit = commit;
+		e->prefetched = log_lookahead_prefetch(rev, la->prefetch, commit);
+	}
+
+	if (!la->nr)
+		return NULL;
+	e = &la->queue[la->first];
+	la->first = (la->first + 1) % LOG_LOOKAHEAD_COMMITS;
+	la->nr--;
+	la->showing_prefetched = e->prefetched;
+	return e->commit;
+}
+
 static int cmd_log_walk_no_free(struct rev_info *rev)
 {
+	struct log_lookahead lookahead;
 	struct commit *commit;
 	int saved_nrl = 0;
 	int saved_dcctc = 0;
@@ -400,13 +537,14 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 
 	if (prepare_revision_walk(rev))
 		die(_("revision walk setup failed"));
+	log_lookahead_init(rev, &lookahead);
 
 	/*
 	 * For --check and --exit-code, the exit code is based on CHECK_FAILED
 	 * and HAS_CHANGES being accumulated in rev->diffopt, so be careful to
 	 * retain that state information if replacing rev->diffopt in this loop
 	 */
-	while ((commit = get_revision(rev)) != NULL) {
+	while ((commit = log_lookahead_next(rev, &lookahead)) != NULL) {
 		if (!log_tree_commit(rev, commit) && rev->max_count >= 0)
 			/*
 			 * We decremented max_count in get_revision,
@@ -432,6 +570,7 @@ static int cmd_log_walk_no_free(struct rev_info *rev)
 		if (rev->diffopt.degraded_cc_to_c)
 			saved_dcctc = 1;
 	}
+	diff_prefetch_stop(lookahead.prefetch);
 	rev->diffopt.degraded_cc_to_c = saved_dcctc;
 	rev->diffopt.needed_rename_limit = saved_nrl;
 
@@ -1442,6 +1442,8 @@ static void write_pack_file(void)
 
 				bitmap_writer_show_progress(&bitmap_writer,
 							    progress);
+				bitmap_writer_set_threads(&bitmap_writer,
+							  delta_search_threads);
 				bitmap_writer_select_commits(&bitmap_writer,
 							     indexed_commits,
 							     indexed_commits_nr);
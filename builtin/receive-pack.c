@@ -43,6 +43,7 @@
 #include "worktree.h"
 #include "shallow.h"
 #include "parse-options.h"
+#include "promisor-remote.h"
 
 static const char * const receive_pack_usage[] = {
 	N_("git receive-pack <git-dir>"),
@@ -82,6 +83,12 @@ static int auto_update_server_info;
 static int auto_gc = 1;
 static int reject_thin;
 static int skip_connectivity_check;
+static enum {
+	CONNECTIVITY_CHECK_FULL,
+	CONNECTIVITY_CHECK_EDGES
+} connectivity_check;
+/* the unpacker made sure the received objects only link to existing ones */
+static int received_links_checked;
 static int stateless_rpc;
 static const char *service_dir;
 static const char *head_name;
@@ -162,6 +169,18 @@ static int receive_pack_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (strcmp(var, "receive.connectivitycheck") == 0) {
+		if (!value)
+			return config_error_nonbool(var);
+		if (!strcmp(value, "full"))
+			connectivity_check = CONNECTIVITY_CHECK_FULL;
+		else if (!strcmp(value, "edges"))
+			connectivity_check = CONNECTIVITY_CHECK_EDGES;
+		else
+			return error(_("invalid value for '%s': '%s'"), var, value);
+		return 0;
+	}
+
 	if (strcmp(var, "receive.unpacklimit") == 0) {
 		receive_unpack_limit = git_config_int(var, value, ctx->kvi);
 		return 0;
@@ -1779,6 +1798,26 @@ static void set_connectivity_errors(struct command *commands,
 	}
 }
 
+/*
+ * With receive.connectivityCheck=edges, the unpacker has made sure that
+ * every object the received ones refer to was received or is in the
+ * repository, whose objects are complete: gc never drops an object that
+ * one it keeps refers to. All that is left is to check that the new tips
+ * exist, instead of walking from them to the existing refs.
+ */
+static void check_received_tips(struct command *commands)
+{
+	struct command *cmd;
+
+	for (cmd = commands; cmd; cmd = cmd->next) {
+		if (is_null_oid(&cmd->new_oid) || cmd->skip_update)
+			continue;
+		if (!odb_has_object(the_repository->objects, &cmd->new_oid,
+				    HAS_OBJECT_RECHECK_PACKED))
+			cmd->error_string = "missing necessary objects";
+	}
+}
+
 struct iterate_data {
 	struct command *cmds;
 	struct shallow_info *si;
@@ -2006,7 +2045,9 @@ static void execute_commands(struct command *commands,
 		return;
 	}
 
-	if (!skip_connectivity_check) {
+	if (!skip_connectivity_check && received_links_checked) {
+		check_received_tips(commands);
+	} else if (!skip_connectivity_check) {
 		if (use_sideband) {
 			memset(&muxer, 0, sizeof(muxer));
 			muxer.proc = copy_to_sideband;
@@ -2300,6 +2341,14 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 			    : transfer_fsck_objects >= 0
 			    ? transfer_fsck_objects
 			    : 0);
+	/*
+	 * Leave shallow pushes, whose links stop at the shallow boundary,
+	 * and partial clones, where a missing object may be a promised one,
+	 * to the full connectivity check.
+	 */
+	int check_links = connectivity_check == CONNECTIVITY_CHECK_EDGES &&
+			  !si->nr_ours && !si->nr_theirs &&
+			  !repo_has_promisor_remote(the_repository);
 
 	hdr_err = parse_pack_header(&hdr);
 	if (hdr_err) {
@@ -2337,6 +2386,8 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 		if (fsck_objects)
 			strvec_pushf(&child.args, "--strict%s",
 				     fsck_msg_types.buf);
+		else if (check_links)
+			strvec_push(&child.args, "--check-links");
 		if (max_input_size)
 			strvec_pushf(&child.args, "--max-input-size=%"PRIuMAX,
 				     (uintmax_t)max_input_size);
@@ -2367,6 +2418,8 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 		if (fsck_objects)
 			strvec_pushf(&child.args, "--strict%s",
 				     fsck_msg_types.buf);
+		else if (check_links)
+			strvec_push(&child.args, "--check-links");
 		if (!reject_thin)
 			strvec_push(&child.args, "--fix-thin");
 		if (max_input_size)
@@ -2391,6 +2444,7 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 			return "index-pack abnormal exit";
 		reprepare_packed_git(the_repository);
 	}
+	received_links_checked = check_links;
 	return NULL;
 }
 
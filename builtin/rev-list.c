@@ -4,6 +4,7 @@
 #include "builtin.h"
 #include "config.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "diff.h"
 #include "environment.h"
 #include "gettext.h"
@@ -24,9 +25,11 @@
 #include "reflog-walk.h"
 #include "oidset.h"
 #include "oidmap.h"
+#include "oid-array.h"
 #include "packfile.h"
 #include "quote.h"
 #include "strbuf.h"
+#include "tag.h"
 
 struct rev_list_info {
 	struct rev_info *revs;
@@ -575,6 +578,65 @@ static int try_bitmap_count(struct rev_info *revs,
 	return 0;
 }
 
+/*
+ * Count the commits of a plain "--count" walk over commit-graph positions
+ * without materializing a "struct commit" for any of them.
+ */
+static int try_commit_graph_count(struct rev_info *revs, int bisect_list)
+{
+	struct oid_array include = OID_ARRAY_INIT, exclude = OID_ARRAY_INIT;
+	uint32_t commit_count;
+	int ret = -1;
+
+	if (!revs->count)
+		return -1;
+
+	/*
+	 * Only a walk that shows every commit that is reachable from the
+	 * positive tips and not from the negative ones can be counted
+	 * without looking at the commits.
+	 */
+	if (revs->left_right || revs->cherry_mark || revs->cherry_pick ||
+	    revs->left_only || revs->right_only || revs->prune ||
+	    revs->no_walk || revs->boundary || revs->reflog_info ||
+	    revs->first_parent_only || revs->exclude_first_parent_only ||
+	    revs->ancestry_path || revs->bisect || bisect_list ||
+	    revs->show_merge || revs->line_level_traverse ||
+	    revs->simplify_by_decoration || revs->max_count >= 0 ||
+	    revs->skip_count >= 0 || revs->max_age != -1 ||
+	    revs->max_age_as_filter != -1 || revs->min_age != -1 ||
+	    revs->min_parents || revs->max_parents != -1 ||
+	    revs->grep_filter.pattern_list || revs->grep_filter.header_list ||
+	    revs->tag_objects || revs->tree_objects || revs->blob_objects ||
+	    revs->filter.choice || revs->unpacked || revs->no_kept_objects ||
+	    revs->exclude_promisor_objects ||
+	    revs->do_not_die_on_missing_objects || revs->include_check ||
+	    revs->commits)
+		return -1;
+
+	for (size_t i = 0; i < revs->pending.nr; i++) {
+		struct object *object = revs->pending.objects[i].item;
+		unsigned flags = object->flags;
+
+		object = deref_tag(revs->repo, object, NULL, 0);
+		if (!object || object->type != OBJ_COMMIT)
+			goto out;
+		oid_array_append(flags & UNINTERESTING ? &exclude : &include,
+				 &object->oid);
+	}
+
+	if (commit_graph_count_reachable(revs->repo, &include, &exclude,
+					 &commit_count))
+		goto out;
+
+	printf("%"PRIu32"\n", commit_count);
+	ret = 0;
+out:
+	oid_array_clear(&include);
+	oid_array_clear(&exclude);
+	return ret;
+}
+
 static int try_bitmap_traversal(struct rev_info *revs,
 				int filter_provided_objects)
 {
@@ -863,6 +925,9 @@ int cmd_rev_list(int argc,
 			goto cleanup;
 	}
 
+	if (!try_commit_graph_count(&revs, bisect_list))
+		goto cleanup;
+
 	if (prepare_revision_walk(&revs))
 		die("revision walk setup failed");
 	if (revs.tree_objects)
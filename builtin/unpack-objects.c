@@ -21,8 +21,8 @@
 #include "fsck.h"
 #include "packfile.h"
 
-static int dry_run, quiet, recover, has_errors, strict;
-static const char unpack_usage[] = "git unpack-objects [-n] [-q] [-r] [--strict]";
+static int dry_run, quiet, recover, has_errors, strict, check_links_only;
+static const char unpack_usage[] = "git unpack-objects [-n] [-q] [-r] [--strict | --check-links]";
 
 /* We always read in 4kB chunks. */
 static unsigned char buffer[4096];
@@ -242,7 +242,8 @@ static int check_object(struct object *obj, enum object_type type,
 	obj_buf = lookup_object_buffer(obj);
 	if (!obj_buf)
 		die("Whoops! Cannot find object '%s'", oid_to_hex(&obj->oid));
-	if (fsck_object(obj, obj_buf->buffer, obj_buf->size, &fsck_options))
+	if (!check_links_only &&
+	    fsck_object(obj, obj_buf->buffer, obj_buf->size, &fsck_options))
 		die("fsck error in packed object");
 	fsck_options.walk = check_object;
 	if (fsck_walk(obj, NULL, &fsck_options))
@@ -653,6 +654,11 @@ int cmd_unpack_objects(int argc,
 				fsck_set_msg_types(&fsck_options, arg);
 				continue;
 			}
+			if (!strcmp(arg, "--check-links")) {
+				strict = 1;
+				check_links_only = 1;
+				continue;
+			}
 			if (skip_prefix(arg, "--pack_header=", &arg)) {
 				if (parse_pack_header_option(arg,
 							     buffer, &len) < 0)
@@ -677,7 +683,7 @@ int cmd_unpack_objects(int argc,
 	git_hash_final_oid(&oid, &tmp_ctx);
 	if (strict) {
 		write_rest();
-		if (fsck_finish(&fsck_options))
+		if (!check_links_only && fsck_finish(&fsck_options))
 			die(_("fsck error in pack objects"));
 	}
 	if (!hasheq(fill(the_hash_algo->rawsz), oid.hash,
@@ -290,6 +290,32 @@ static char *find_temp_filename(void)
 	return strbuf_detach(&name, NULL);
 }
 
+/*
+ * The protocol we speak with git-remote-https(1) uses a space to
+ * separate between URI and file, so the URI itself must not contain a
+ * space. If it did, an adversary could change the location where the
+ * downloaded file is being written to.
+ *
+ * Similarly, we use newlines to separate commands from one another.
+ * Consequently, neither the URI nor the file must contain a newline or
+ * otherwise an adversary could inject arbitrary commands.
+ *
+ * TODO: Restricting newlines in the target paths may break valid
+ *       usecases, even if those are a bit more on the esoteric side.
+ *       If this ever becomes a problem we should probably think about
+ *       alternatives. One alternative could be to use NUL-delimited
+ *       requests in git-remote-http(1). Another alternative could be
+ *       to use URL quoting.
+ */
+static int check_https_download(const char *file, const char *uri)
+{
+	if (strpbrk(uri, " \n"))
+		return error("bundle-uri: URI is malformed: '%s'", file);
+	if (strchr(file, '\n'))
+		return error("bundle-uri: filename is malformed: '%s'", file);
+	return 0;
+}
+
 static int download_https_uri_to_file(const char *file, const char *uri)
 {
 	int result = 0;
@@ -298,27 +324,8 @@ static int download_https_uri_to_file(const char *file, const char *uri)
 	struct strbuf line = STRBUF_INIT;
 	int found_get = 0;
 
-	/*
-	 * The protocol we speak with git-remote-https(1) uses a space to
-	 * separate between URI and file, so the URI itself must not contain a
-	 * space. If it did, an adversary could change the location where the
-	 * downloaded file is being written to.
-	 *
-	 * Similarly, we use newlines to separate commands from one another.
-	 * Consequently, neither the URI nor the file must contain a newline or
-	 * otherwise an adversary could inject arbitrary commands.
-	 *
-	 * TODO: Restricting newlines in the target paths may break valid
-	 *       usecases, even if those are a bit more on the esoteric side.
-	 *       If this ever becomes a problem we should probably think about
-	 *       alternatives. One alternative could be to use NUL-delimited
-	 *       requests in git-remote-http(1). Another alternative could be
-	 *       to use URL quoting.
-	 */
-	if (strpbrk(uri, " \n"))
-		return error("bundle-uri: URI is malformed: '%s'", file);
-	if (strchr(file, '\n'))
-		return error("bundle-uri: filename is malformed: '%s'", file);
+	if (check_https_download(file, uri))
+		return -1;
 
 	strvec_pushl(&cp.args, "git-remote-https", uri, NULL);
 	cp.err = -1;
@@ -368,12 +375,16 @@ static int download_https_uri_to_file(const char *file, const char *uri)
 	return result;
 }
 
+static int is_https_uri(const char *uri)
+{
+	return starts_with(uri, "https:") || starts_with(uri, "http:");
+}
+
 static int copy_uri_to_file(const char *filename, const char *uri)
 {
 	const char *out;
 
-	if (starts_with(uri, "https:") ||
-	    starts_with(uri, "http:"))
+	if (is_https_uri(uri))
 		return download_https_uri_to_file(filename, uri);
 
 	if (skip_prefix(uri, "file://", &out))
@@ -383,44 +394,134 @@ static int copy_uri_to_file(const char *filename, const char *uri)
 	return copy_file(filename, uri, 0);
 }
 
-static int unbundle_from_file(struct repository *r, const char *file)
+static int bundle_jobs(struct repository *r)
 {
-	int result = 0;
-	int bundle_fd;
-	struct bundle_header header = BUNDLE_HEADER_INIT;
-	struct string_list_item *refname;
-	struct strbuf bundle_ref = STRBUF_INIT;
-	size_t bundle_prefix_len;
-	struct unbundle_opts opts = {
-		.flags = VERIFY_BUNDLE_QUIET |
-			 (fetch_pack_fsck_objects() ? VERIFY_BUNDLE_FSCK : 0),
-	};
+	int jobs;
 
-	bundle_fd = read_bundle_header(file, &header);
-	if (bundle_fd < 0) {
-		result = 1;
-		goto cleanup;
+	if (repo_config_get_int(r, "fetch.bundlejobs", &jobs))
+		return 4;
+	return jobs > 0 ? jobs : online_cpus();
+}
+
+struct bundle_prefetch {
+	struct remote_bundle_info **bundles;
+	size_t nr, alloc, next;
+};
+
+static int prefetch_next_task(struct child_process *cp,
+			      struct strbuf *out UNUSED,
+			      void *pp_cb, void **pp_task_cb)
+{
+	struct bundle_prefetch *batch = pp_cb;
+
+	while (batch->next < batch->nr) {
+		struct remote_bundle_info *bundle = batch->bundles[batch->next++];
+		struct strbuf cmds = STRBUF_INIT;
+		int fds[2];
+
+		bundle->prefetched = 1;
+		if (!(bundle->file = find_temp_filename()) ||
+		    check_https_download(bundle->file, bundle->uri)) {
+			bundle->prefetch_failed = 1;
+			continue;
+		}
+
+		/*
+		 * Unlike download_https_uri_to_file(), hand the helper all
+		 * of its commands up front; they fit into the pipe, and it
+		 * is our own helper, which knows how to "get".
+		 */
+		if (pipe(fds) < 0)
+			die_errno(_("unable to create pipe"));
+		strbuf_addf(&cmds, "capabilities\nget %s %s\n\n",
+			    bundle->uri, bundle->file);
+		if (write_in_full(fds[1], cmds.buf, cmds.len) < 0)
+			die_errno(_("unable to write to pipe"));
+		close(fds[1]);
+		strbuf_release(&cmds);
+
+		strvec_pushl(&cp->args, "git-remote-https", bundle->uri, NULL);
+		cp->no_stdin = 0;
+		cp->in = fds[0];
+		*pp_task_cb = bundle;
+		return 1;
 	}
 
-	/*
-	 * Skip the reachability walk here, since we will be adding
-	 * a reachable ref pointing to the new tips, which will reach
-	 * the prerequisite commits.
-	 */
-	result = unbundle(r, &header, bundle_fd, NULL, &opts);
-	if (result) {
-		result = 1;
-		goto cleanup;
+	return 0;
+}
+
+static int prefetch_start_failure(struct strbuf *out UNUSED,
+				  void *pp_cb UNUSED, void *pp_task_cb)
+{
+	struct remote_bundle_info *bundle = pp_task_cb;
+
+	bundle->prefetch_failed = 1;
+	return 0;
+}
+
+static int prefetch_task_finished(int result, struct strbuf *out,
+				  void *pp_cb UNUSED, void *pp_task_cb)
+{
+	struct remote_bundle_info *bundle = pp_task_cb;
+
+	/* Like download_https_uri_to_file(), ignore what the helper says. */
+	strbuf_reset(out);
+	bundle->prefetch_failed = !!result;
+	return 0;
+}
+
+/*
+ * Download those of the given bundles that are served over HTTP(S) and
+ * not downloaded yet all at once, fetch.bundleJobs at a time, so that
+ * fetch_bundle_uri_internal() finds them already there.
+ */
+static void prefetch_bundles(struct repository *r,
+			     struct remote_bundle_info **bundles, size_t nr)
+{
+	struct bundle_prefetch batch = { 0 };
+	struct run_process_parallel_opts opts = {
+		.tr2_category = "fetch",
+		.tr2_label = "prefetch-bundles",
+
+		.processes = bundle_jobs(r),
+		.hold_output = 1,
+
+		.get_next_task = prefetch_next_task,
+		.start_failure = prefetch_start_failure,
+		.task_finished = prefetch_task_finished,
+		.data = &batch,
+	};
+
+	if (opts.processes < 2)
+		return;
+
+	for (size_t i = 0; i < nr; i++) {
+		if (bundles[i]->file || !bundles[i]->uri ||
+		    !is_https_uri(bundles[i]->uri))
+			continue;
+		ALLOC_GROW(batch.bundles, batch.nr + 1, batch.alloc);
+		batch.bundles[batch.nr++] = bundles[i];
 	}
 
-	/*
-	 * Convert all refs/heads/ from the bundle into refs/bundles/
-	 * in the local repository.
-	 */
+	if (batch.nr > 1)
+		run_processes_parallel(&opts);
+	free(batch.bundles);
+}
+
+/*
+ * Convert all refs/heads/ from the bundle into refs/bundles/
+ * in the local repository.
+ */
+static void write_bundle_refs(struct bundle_header *header)
+{
+	struct string_list_item *refname;
+	struct strbuf bundle_ref = STRBUF_INIT;
+	size_t bundle_prefix_len;
+
 	strbuf_addstr(&bundle_ref, "refs/bundles/");
 	bundle_prefix_len = bundle_ref.len;
 
-	for_each_string_list_item(refname, &header.references) {
+	for_each_string_list_item(refname, &header->references) {
 		struct object_id *oid = refname->util;
 		struct object_id old_oid;
 		const char *branch_name;
@@ -440,8 +541,44 @@ static int unbundle_from_file(struct repository *r, const char *file)
 				0, UPDATE_REFS_MSG_ON_ERR);
 	}
 
-cleanup:
 	strbuf_release(&bundle_ref);
+}
+
+static void init_unbundle_opts(struct unbundle_opts *opts)
+{
+	opts->flags = VERIFY_BUNDLE_QUIET |
+		      (fetch_pack_fsck_objects() ? VERIFY_BUNDLE_FSCK : 0);
+}
+
+static int unbundle_from_file(struct repository *r, const char *file)
+{
+	int result = 0;
+	int bundle_fd;
+	struct bundle_header header = BUNDLE_HEADER_INIT;
+	struct unbundle_opts opts = { 0 };
+
+	init_unbundle_opts(&opts);
+
+	bundle_fd = read_bundle_header(file, &header);
+	if (bundle_fd < 0) {
+		result = 1;
+		goto cleanup;
+	}
+
+	/*
+	 * Skip the reachability walk here, since we will be adding
+	 * a reachable ref pointing to the new tips, which will reach
+	 * the prerequisite commits.
+	 */
+	result = unbundle(r, &header, bundle_fd, NULL, &opts);
+	if (result) {
+		result = 1;
+		goto cleanup;
+	}
+
+	write_bundle_refs(&header);
+
+cleanup:
 	bundle_header_release(&header);
 	return result;
 }
@@ -594,9 +731,19 @@ static int fetch_bundles_by_token(struct repository *r,
 		if (bundle->creationToken <= maxCreationToken)
 			break;
 
-		if (!bundle->file) {
+		/*
+		 * Without a previous creation token, this is likely a fresh
+		 * clone where all of the bundles are needed. Once the first
+		 * one turned out not to be enough, download the rest of
+		 * them at once.
+		 */
+		if (!bundle->file && move_direction > 0 && !maxCreationToken)
+			prefetch_bundles(r, bundles.items + cur, bundles.nr - cur);
+
+		if (!bundle->file || bundle->prefetched) {
 			/*
-			 * Not downloaded yet. Try downloading.
+			 * Not downloaded yet, or only ahead of time. Try
+			 * downloading.
 			 *
 			 * Note that bundle->file is non-NULL if a download
 			 * was attempted, even if it failed to download.
@@ -671,6 +818,12 @@ static int fetch_bundles_by_token(struct repository *r,
 	return cur >= 0;
 }
 
+/**
+ * This limits the recursion on fetch_bundle_uri_internal() when following
+ * bundle lists.
+ */
+static int max_bundle_uri_depth = 4;
+
 static int download_bundle_list(struct repository *r,
 				struct bundle_list *local_list,
 				struct bundle_list *global_list,
@@ -683,6 +836,23 @@ static int download_bundle_list(struct repository *r,
 		.mode = local_list->mode,
 	};
 
+	/*
+	 * All of the bundles are wanted, so download them at once. This
+	 * happens before fetch_bundle_uri_internal() gets to check the
+	 * depth of the bundles, so leave those too deep to it.
+	 */
+	if (local_list->mode == BUNDLE_MODE_ALL &&
+	    ctx.depth + 1 < max_bundle_uri_depth) {
+		struct bundles_for_sorting bundles = {
+			.alloc = hashmap_get_size(&local_list->bundles),
+		};
+
+		ALLOC_ARRAY(bundles.items, bundles.alloc);
+		for_all_bundles_in_list(local_list, append_bundle, &bundles);
+		prefetch_bundles(r, bundles.items, bundles.nr);
+		free(bundles.items);
+	}
+
 	return for_all_bundles_in_list(local_list, download_bundle_to_file, &ctx);
 }
 
@@ -725,12 +895,6 @@ static int fetch_bundle_list_in_config_format(struct repository *r,
 	return result;
 }
 
-/**
- * This limits the recursion on fetch_bundle_uri_internal() when following
- * bundle lists.
- */
-static int max_bundle_uri_depth = 4;
-
 /**
  * Recursively download all bundles advertised at the given URI
  * to files. If the file is a bundle, then add it to the given
@@ -757,7 +921,13 @@ static int fetch_bundle_uri_internal(struct repository *r,
 		goto cleanup;
 	}
 
-	if ((result = copy_uri_to_file(bundle->file, bundle->uri))) {
+	if (bundle->prefetched) {
+		bundle->prefetched = 0;
+		result = bundle->prefetch_failed;
+	} else {
+		result = copy_uri_to_file(bundle->file, bundle->uri);
+	}
+	if (result) {
 		warning(_("failed to download bundle from URI '%s'"), bundle->uri);
 		goto cleanup;
 	}
@@ -784,39 +954,142 @@ static int fetch_bundle_uri_internal(struct repository *r,
 	return result;
 }
 
-/**
- * This loop iterator breaks the loop with nonzero return code on the
- * first successful unbundling of a bundle.
+struct unbundle_task {
+	struct remote_bundle_info *info;
+	struct bundle_header header;
+	int bundle_fd;
+	int result;
+};
+
+struct unbundle_batch {
+	struct repository *r;
+	struct unbundle_opts opts;
+	struct unbundle_task *tasks;
+	size_t nr, alloc, next;
+};
+
+/*
+ * Collect the bundles not unbundled yet whose prerequisites are all
+ * there, so that their objects can be indexed at the same time.
  */
-static int attempt_unbundle(struct remote_bundle_info *info, void *data)
+static int collect_unbundle(struct remote_bundle_info *info, void *data)
 {
-	struct repository *r = data;
+	struct unbundle_batch *batch = data;
+	struct unbundle_task *task;
 
 	if (!info->file || info->unbundled)
 		return 0;
 
-	if (!unbundle_from_file(r, info->file)) {
-		info->unbundled = 1;
-		return 1;
+	ALLOC_GROW(batch->tasks, batch->nr + 1, batch->alloc);
+	task = &batch->tasks[batch->nr];
+	task->info = info;
+	bundle_header_init(&task->header);
+
+	task->bundle_fd = read_bundle_header(info->file, &task->header);
+	if (task->bundle_fd < 0) {
+		bundle_header_release(&task->header);
+		return 0;
+	}
+	if (verify_bundle(batch->r, &task->header, batch->opts.flags)) {
+		close(task->bundle_fd);
+		bundle_header_release(&task->header);
+		return 0;
 	}
 
+	batch->nr++;
+	return 0;
+}
+
+static int unbundle_next_task(struct child_process *cp,
+			      struct strbuf *out UNUSED,
+			      void *pp_cb, void **pp_task_cb)
+{
+	struct unbundle_batch *batch = pp_cb;
+	struct unbundle_task *task;
+
+	if (batch->next >= batch->nr)
+		return 0;
+
+	task = &batch->tasks[batch->next++];
+	unbundle_prepare_index_pack(&task->header, task->bundle_fd, NULL,
+				    &batch->opts, cp);
+	cp->no_stdin = 0;
+	*pp_task_cb = task;
+	return 1;
+}
+
+static int unbundle_start_failure(struct strbuf *out UNUSED,
+				  void *pp_cb UNUSED, void *pp_task_cb)
+{
+	struct unbundle_task *task = pp_task_cb;
+
+	task->result = -1;
+	return 0;
+}
+
+static int unbundle_task_finished(int result, struct strbuf *out,
+				  void *pp_cb UNUSED, void *pp_task_cb)
+{
+	struct unbundle_task *task = pp_task_cb;
+
+	task->result = result;
+	if (result)
+		strbuf_addf(out, "error: %s\n", _("index-pack died"));
 	return 0;
 }
 
 static int unbundle_all_bundles(struct repository *r,
 				struct bundle_list *list)
 {
+	struct unbundle_batch batch = { .r = r };
+	struct run_process_parallel_opts opts = {
+		.tr2_category = "fetch",
+		.tr2_label = "unbundle",
+
+		.processes = bundle_jobs(r),
+
+		.get_next_task = unbundle_next_task,
+		.start_failure = unbundle_start_failure,
+		.task_finished = unbundle_task_finished,
+		.data = &batch,
+	};
+	int rounds = 0;
+
+	init_unbundle_opts(&batch.opts);
+
 	/*
-	 * Iterate through all bundles looking for ones that can
-	 * successfully unbundle. If any succeed, then perhaps another
-	 * will succeed in the next attempt.
-	 *
-	 * Keep in mind that a non-zero result for the loop here means
-	 * the loop terminated early on a successful unbundling, which
-	 * signals that we can try again.
+	 * Index all of the bundles that can be unbundled at once. If any
+	 * succeed, then perhaps others will succeed in the next round.
+	 * Only the refs are written one bundle after the other, in list
+	 * order.
 	 */
-	while (for_all_bundles_in_list(list, attempt_unbundle, r)) ;
+	while (1) {
+		int progress = 0;
+
+		batch.nr = batch.next = 0;
+		for_all_bundles_in_list(list, collect_unbundle, &batch);
+		if (!batch.nr)
+			break;
+
+		rounds++;
+		run_processes_parallel(&opts);
+
+		for (size_t i = 0; i < batch.nr; i++) {
+			struct unbundle_task *task = &batch.tasks[i];
+
+			if (!task->result) {
+				write_bundle_refs(&task->header);
+				task->info->unbundled = 1;
+				progress = 1;
+			}
+			bundle_header_release(&task->header);
+		}
+		if (!progress)
+			break;
+	}
 
+	trace2_data_intmax("fetch", r, "bundle-uri/unbundle-rounds", rounds);
+	free(batch.tasks);
 	return 0;
 }
 
@@ -43,6 +43,14 @@ struct remote_bundle_info {
 	 */
 	unsigned unbundled:1;
 
+	/*
+	 * If the bundle has been downloaded to 'file' ahead of time,
+	 * along with others in parallel, then this boolean is true and
+	 * 'prefetch_failed' tells whether that download failed.
+	 */
+	unsigned prefetched:1,
+		 prefetch_failed:1;
+
 	/**
 	 * If the bundle is part of a list with the creationToken
 	 * heuristic, then we use this member for sorting the bundles.
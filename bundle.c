@@ -603,37 +603,47 @@ int create_bundle(struct repository *r, const char *path,
 	return ret;
 }
 
-int unbundle(struct repository *r, struct bundle_header *header,
-	     int bundle_fd, struct strvec *extra_index_pack_args,
-	     struct unbundle_opts *opts)
+void unbundle_prepare_index_pack(struct bundle_header *header, int bundle_fd,
+				 struct strvec *extra_index_pack_args,
+				 struct unbundle_opts *opts,
+				 struct child_process *ip)
 {
-	struct child_process ip = CHILD_PROCESS_INIT;
 	struct unbundle_opts opts_fallback = { 0 };
 
 	if (!opts)
 		opts = &opts_fallback;
 
-	if (verify_bundle(r, header, opts->flags)) {
-		close(bundle_fd);
-		return -1;
-	}
-
-	strvec_pushl(&ip.args, "index-pack", "--fix-thin", "--stdin", NULL);
+	strvec_pushl(&ip->args, "index-pack", "--fix-thin", "--stdin", NULL);
 
 	/* If there is a filter, then we need to create the promisor pack. */
 	if (header->filter.choice)
-		strvec_push(&ip.args, "--promisor=from-bundle");
+		strvec_push(&ip->args, "--promisor=from-bundle");
 
 	if (opts->flags & VERIFY_BUNDLE_FSCK)
-		strvec_pushf(&ip.args, "--fsck-objects%s",
+		strvec_pushf(&ip->args, "--fsck-objects%s",
 			     opts->fsck_msg_types ? opts->fsck_msg_types : "");
 
 	if (extra_index_pack_args)
-		strvec_pushv(&ip.args, extra_index_pack_args->v);
+		strvec_pushv(&ip->args, extra_index_pack_args->v);
+
+	ip->in = bundle_fd;
+	ip->no_stdout = 1;
+	ip->git_cmd = 1;
+}
+
+int unbundle(struct repository *r, struct bundle_header *header,
+	     int bundle_fd, struct strvec *extra_index_pack_args,
+	     struct unbundle_opts *opts)
+{
+	struct child_process ip = CHILD_PROCESS_INIT;
+
+	if (verify_bundle(r, header, opts ? opts->flags : 0)) {
+		close(bundle_fd);
+		return -1;
+	}
 
-	ip.in = bundle_fd;
-	ip.no_stdout = 1;
-	ip.git_cmd = 1;
+	unbundle_prepare_index_pack(header, bundle_fd, extra_index_pack_args,
+				    opts, &ip);
 	if (run_command(&ip))
 		return error(_("index-pack died"));
 	return 0;
@@ -5,6 +5,8 @@
 #include "string-list.h"
 #include "list-objects-filter-options.h"
 
+struct child_process;
+
 struct bundle_header {
 	unsigned version;
 	struct string_list prerequisites;
@@ -68,6 +70,18 @@ struct unbundle_opts {
 int unbundle(struct repository *r, struct bundle_header *header,
 	     int bundle_fd, struct strvec *extra_index_pack_args,
 	     struct unbundle_opts *opts);
+
+/**
+ * Set up "ip" to run the "git index-pack" that unbundle() runs on the
+ * `bundle_fd` from read_bundle_header(), without verifying the bundle.
+ * For callers that verify it themselves and run the command on their
+ * own, e.g. along with others in parallel.
+ */
+void unbundle_prepare_index_pack(struct bundle_header *header, int bundle_fd,
+				 struct strvec *extra_index_pack_args,
+				 struct unbundle_opts *opts,
+				 struct child_process *ip);
+
 int list_bundle_refs(struct bundle_header *header,
 		int argc, const char **argv);
 
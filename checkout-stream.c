@@ -0,0 +1,698 @@
+#define USE_THE_REPOSITORY_VARIABLE
+
+#include "git-compat-util.h"
+#include "checkout-stream.h"
+#include "attr.h"
+#include "convert.h"
+#include "dir.h"
+#include "environment.h"
+#include "hex.h"
+#include "oidmap.h"
+#include "parallel-checkout.h"
+#include "path.h"
+#include "read-cache-ll.h"
+#include "repository.h"
+#include "strbuf.h"
+#include "string-list.h"
+#include "thread-utils.h"
+#include "trace2.h"
+#include "tree-walk.h"
+#include "wrapper.h"
+
+/* The most tree data kept for trees that come before anything names them. */
+#define PARKED_TREES_MAX (32 * 1024 * 1024)
+
+/* The most blobs remembered to be read back should they be wanted later. */
+#define SEEN_BLOBS_MAX (1024 * 1024)
+
+/* The most blob data waiting for a writer thread. */
+#define QUEUED_BYTES_MAX (64 * 1024 * 1024)
+
+struct wanted_object {
+	struct oidmap_entry entry;
+	enum object_type type;
+	/* paths below the working tree; for blobs, util holds the mode */
+	struct string_list paths;
+};
+
+struct parked_tree {
+	struct oidmap_entry entry;
+	void *data;
+	unsigned long size;
+};
+
+struct seen_blob {
+	struct oidmap_entry entry;
+	void *handle;
+};
+
+struct write_job {
+	struct object_id oid;
+	/* to read the blob back with when "data" is NULL */
+	void *handle;
+	void *data;
+	unsigned long size;
+	struct string_list paths;
+	struct write_job *next;
+};
+
+struct checkout_stream {
+	struct repository *repo;
+	/* the working tree, with a trailing slash */
+	struct strbuf worktree;
+	checkout_stream_reread_fn reread;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* the commit or tag to check out, until its tree is known */
+	struct object_id target;
+	struct object_id tree;
+	unsigned have_tree : 1,
+		 received : 1,
+		 poisoned : 1,
+		 stopping : 1;
+
+	struct oidmap wanted;
+	struct oidmap parked;
+	size_t parked_bytes;
+	struct oidmap seen;
+	size_t nr_seen;
+
+	/* blobs seen before they were wanted, to be read back */
+	struct wanted_object **ready;
+	size_t ready_nr, ready_alloc;
+	struct write_job *deferred;
+
+	pthread_t *threads;
+	int nr_threads;
+	struct write_job *queue, **queue_tail;
+	size_t queued_bytes;
+
+	/* "<mode> <oid> <path>\0" for every file written */
+	struct strbuf written;
+	intmax_t nr_written;
+};
+
+int checkout_stream_possible(struct repository *r)
+{
+	const char *global = git_attr_global_file();
+	char *info;
+	int ret;
+
+	if (auto_crlf == AUTO_CRLF_TRUE || core_eol == EOL_CRLF)
+		return 0;
+	if (ignore_case || precomposed_unicode == 1)
+		return 0;
+	if (git_attr_tree || getenv(GIT_ATTR_SOURCE_ENVIRONMENT))
+		return 0;
+	if (git_attr_system_is_enabled() && file_exists(git_attr_system_file()))
+		return 0;
+	if (global && file_exists(global))
+		return 0;
+
+	info = repo_git_path(r, INFOATTRIBUTES_FILE);
+	ret = !file_exists(info);
+	free(info);
+	return ret;
+}
+
+/* Must be called with the mutex held, like the rest down to found_target(). */
+static void poison(struct checkout_stream *cs)
+{
+	cs->poisoned = 1;
+}
+
+static void want_object(struct checkout_stream *cs, const struct object_id *oid,
+			enum object_type type, const char *path, unsigned mode)
+{
+	struct wanted_object *w = oidmap_get(&cs->wanted, oid);
+
+	if (!w) {
+		CALLOC_ARRAY(w, 1);
+		oidcpy(&w->entry.oid, oid);
+		w->type = type;
+		string_list_init_dup(&w->paths);
+		oidmap_put(&cs->wanted, w);
+	} else if (w->type != type) {
+		poison(cs);
+		return;
+	}
+	string_list_append(&w->paths, path)->util = (void *)(uintptr_t)mode;
+
+	if (type == OBJ_BLOB && w->paths.nr == 1 &&
+	    oidmap_get(&cs->seen, oid)) {
+		ALLOC_GROW(cs->ready, cs->ready_nr + 1, cs->ready_alloc);
+		cs->ready[cs->ready_nr++] = w;
+	}
+}
+
+/*
+ * Turn the blobs that became wanted after they came by into jobs that
+ * read them back, which are returned or, until the whole pack is there
+ * to read them from, kept for checkout_stream_received().
+ */
+static struct write_job *take_ready(struct checkout_stream *cs)
+{
+	struct write_job *jobs = NULL;
+
+	for (size_t i = 0; i < cs->ready_nr; i++) {
+		struct wanted_object *w = cs->ready[i];
+		struct seen_blob *b = oidmap_remove(&cs->seen, &w->entry.oid);
+		struct write_job *job;
+
+		oidmap_remove(&cs->wanted, &w->entry.oid);
+		CALLOC_ARRAY(job, 1);
+		oidcpy(&job->oid, &w->entry.oid);
+		job->handle = b->handle;
+		job->paths = w->paths;
+		free(w);
+		free(b);
+
+		if (cs->received) {
+			job->next = jobs;
+			jobs = job;
+		} else {
+			job->next = cs->deferred;
+			cs->deferred = job;
+		}
+	}
+	cs->ready_nr = 0;
+	return jobs;
+}
+
+static void free_wanted(struct wanted_object *w)
+{
+	string_list_clear(&w->paths, 0);
+	free(w);
+}
+
+/*
+ * Take apart the wanted tree "w", wanting its subtrees and regular files
+ * in turn, and then the parked subtrees that have become wanted by that.
+ */
+static void take_apart(struct checkout_stream *cs, struct wanted_object *w,
+		       const void *data, unsigned long size)
+{
+	struct wanted_object **todo = NULL;
+	size_t todo_nr = 0, todo_alloc = 0;
+	struct strbuf path = STRBUF_INIT;
+
+	ALLOC_GROW(todo, todo_nr + 1, todo_alloc);
+	todo[todo_nr++] = w;
+
+	while (todo_nr && !cs->poisoned) {
+		struct parked_tree *p = NULL;
+
+		w = todo[--todo_nr];
+		if (!data) {
+			p = oidmap_get(&cs->parked, &w->entry.oid);
+			data = p->data;
+			size = p->size;
+		}
+
+		for (size_t i = 0; i < w->paths.nr && !cs->poisoned; i++) {
+			struct tree_desc desc;
+			struct name_entry entry;
+
+			if (init_tree_desc_gently(&desc, &w->entry.oid,
+						  data, size, 0)) {
+				poison(cs);
+				break;
+			}
+			while (tree_entry_gently(&desc, &entry)) {
+				strbuf_reset(&path);
+				strbuf_addstr(&path, w->paths.items[i].string);
+				strbuf_add(&path, entry.path, entry.pathlen);
+
+				if (!strcmp(entry.path, GITATTRIBUTES_FILE)) {
+					/* files below depend on it */
+					poison(cs);
+					break;
+				}
+				if (S_ISDIR(entry.mode)) {
+					struct wanted_object *sub;
+
+					strbuf_addch(&path, '/');
+					want_object(cs, &entry.oid, OBJ_TREE,
+						    path.buf, 0);
+					sub = oidmap_get(&cs->wanted, &entry.oid);
+					if (sub && sub->paths.nr == 1 &&
+					    oidmap_get(&cs->parked, &entry.oid)) {
+						ALLOC_GROW(todo, todo_nr + 1,
+							   todo_alloc);
+						todo[todo_nr++] = sub;
+					}
+				} else if (S_ISREG(entry.mode)) {
+					if (!verify_path(path.buf, entry.mode)) {
+						poison(cs);
+						break;
+					}
+					want_object(cs, &entry.oid, OBJ_BLOB,
+						    path.buf, entry.mode);
+				}
+				/* symlinks and submodules are left to checkout */
+			}
+		}
+
+		oidmap_remove(&cs->wanted, &w->entry.oid);
+		free_wanted(w);
+		if (p) {
+			oidmap_remove(&cs->parked, &p->entry.oid);
+			cs->parked_bytes -= p->size;
+			free(p->data);
+			free(p);
+		}
+		data = NULL;
+	}
+
+	free(todo);
+	strbuf_release(&path);
+}
+
+static void found_target(struct checkout_stream *cs, enum object_type type,
+			 const char *data, unsigned long size)
+{
+	const struct git_hash_algo *algop = cs->repo->hash_algo;
+	const char *end = data + size, *p;
+	struct object_id oid;
+	struct wanted_object *w;
+
+	if (type == OBJ_TAG) {
+		/* follow it to the commit it points at, should that come later */
+		if (size < 7 + algop->hexsz + 1 ||
+		    !skip_prefix(data, "object ", &p) ||
+		    get_oid_hex_algop(p, &oid, algop) ||
+		    p[algop->hexsz] != '\n') {
+			poison(cs);
+			return;
+		}
+		p += algop->hexsz + 1;
+		if (end - p >= 12 && !memcmp(p, "type commit\n", 12))
+			oidcpy(&cs->target, &oid);
+		else if (end - p >= 9 && !memcmp(p, "type tag\n", 9))
+			oidcpy(&cs->target, &oid);
+		else
+			poison(cs);
+		return;
+	}
+
+	if (type != OBJ_COMMIT ||
+	    size < 5 + algop->hexsz + 1 ||
+	    !skip_prefix(data, "tree ", &p) ||
+	    get_oid_hex_algop(p, &oid, algop) ||
+	    p[algop->hexsz] != '\n') {
+		poison(cs);
+		return;
+	}
+
+	oidcpy(&cs->tree, &oid);
+	cs->have_tree = 1;
+	want_object(cs, &oid, OBJ_TREE, "", 0);
+	w = oidmap_get(&cs->wanted, &oid);
+	if (oidmap_get(&cs->parked, &oid))
+		take_apart(cs, w, NULL, 0);
+}
+
+static int write_one(struct checkout_stream *cs, const char *path,
+		     unsigned mode, const void *data, unsigned long size)
+{
+	struct strbuf sb = STRBUF_INIT;
+	int fd, ret = -1;
+
+	strbuf_addf(&sb, "%s%s", cs->worktree.buf, path);
+	if (safe_create_leading_directories_no_share(sb.buf))
+		goto out;
+	fd = open(sb.buf, O_WRONLY | O_CREAT | O_EXCL,
+		  (mode & 0100) ? 0777 : 0666);
+	if (fd < 0)
+		goto out;
+	if (write_in_full(fd, data, size) < 0) {
+		close(fd);
+		unlink(sb.buf);
+		goto out;
+	}
+	if (close(fd)) {
+		unlink(sb.buf);
+		goto out;
+	}
+	ret = 0;
+
+out:
+	strbuf_release(&sb);
+	return ret;
+}
+
+static void free_job(struct write_job *job)
+{
+	string_list_clear(&job->paths, 0);
+	free(job->data);
+	free(job);
+}
+
+/* This and submit() are called without the mutex held. */
+static void write_job(struct checkout_stream *cs, struct write_job *job)
+{
+	char hex[GIT_MAX_HEXSZ + 1];
+
+	oid_to_hex_r(hex, &job->oid);
+	for (size_t i = 0; i < job->paths.nr; i++) {
+		const char *path = job->paths.items[i].string;
+		unsigned mode = (uintptr_t)job->paths.items[i].util;
+
+		if (write_one(cs, path, mode, job->data, job->size))
+			continue;
+
+		pthread_mutex_lock(&cs->mutex);
+		strbuf_addf(&cs->written, "%o %s %s", mode, hex, path);
+		strbuf_addch(&cs->written, '\0');
+		cs->nr_written++;
+		pthread_mutex_unlock(&cs->mutex);
+	}
+
+	free_job(job);
+}
+
+/*
+ * Hand the jobs to the writer threads, or write them out right away if
+ * there are none or they are behind. Blobs to be read back are read by
+ * the caller, which may be one of index-pack's threads that know how.
+ */
+static void submit(struct checkout_stream *cs, struct write_job *jobs)
+{
+	while (jobs) {
+		struct write_job *job = jobs;
+
+		jobs = job->next;
+		job->next = NULL;
+		if (!job->data)
+			job->data = cs->reread(job->handle, &job->size);
+
+		pthread_mutex_lock(&cs->mutex);
+		if (cs->nr_threads &&
+		    cs->queued_bytes + job->size <= QUEUED_BYTES_MAX) {
+			*cs->queue_tail = job;
+			cs->queue_tail = &job->next;
+			cs->queued_bytes += job->size;
+			pthread_cond_signal(&cs->cond);
+			job = NULL;
+		}
+		pthread_mutex_unlock(&cs->mutex);
+
+		if (job)
+			write_job(cs, job);
+	}
+}
+
+static void *writer_thread(void *data)
+{
+	struct checkout_stream *cs = data;
+
+	while (1) {
+		struct write_job *job;
+
+		pthread_mutex_lock(&cs->mutex);
+		while (!cs->queue && !cs->stopping)
+			pthread_cond_wait(&cs->cond, &cs->mutex);
+		job = cs->queue;
+		if (job) {
+			cs->queue = job->next;
+			if (!cs->queue)
+				cs->queue_tail = &cs->queue;
+			cs->queued_bytes -= job->size;
+		}
+		pthread_mutex_unlock(&cs->mutex);
+
+		if (!job)
+			break;
+		write_job(cs, job);
+	}
+
+	return NULL;
+}
+
+struct checkout_stream *checkout_stream_start(struct repository *r,
+					      const struct object_id *commit,
+					      const char *worktree,
+					      checkout_stream_reread_fn reread)
+{
+	struct checkout_stream *cs;
+	int workers, threshold;
+
+	CALLOC_ARRAY(cs, 1);
+	cs->repo = r;
+	strbuf_init(&cs->worktree, 0);
+	strbuf_addstr(&cs->worktree, worktree);
+	strbuf_complete(&cs->worktree, '/');
+	cs->reread = reread;
+	oidcpy(&cs->target, commit);
+	oidmap_init(&cs->wanted, 0);
+	oidmap_init(&cs->parked, 0);
+	oidmap_init(&cs->seen, 0);
+	cs->queue_tail = &cs->queue;
+	strbuf_init(&cs->written, 0);
+	pthread_mutex_init(&cs->mutex, NULL);
+	pthread_cond_init(&cs->cond, NULL);
+
+	get_parallel_checkout_configs(&workers, &threshold);
+	if (HAVE_THREADS && workers > 1) {
+		CALLOC_ARRAY(cs->threads, workers);
+		for (int i = 0; i < workers; i++) {
+			if (pthread_create(&cs->threads[i], NULL,
+					   writer_thread, cs))
+				break;
+			cs->nr_threads++;
+		}
+	}
+
+	return cs;
+}
+
+void checkout_stream_object(struct checkout_stream *cs,
+			    const struct object_id *oid,
+			    enum object_type type,
+			    const void *data, unsigned long size,
+			    void *handle)
+{
+	struct wanted_object *w;
+	struct write_job *jobs = NULL;
+
+	pthread_mutex_lock(&cs->mutex);
+	if (cs->poisoned || !data)
+		goto out;
+
+	if (!cs->have_tree && oideq(oid, &cs->target)) {
+		found_target(cs, type, data, size);
+		goto out;
+	}
+
+	w = oidmap_get(&cs->wanted, oid);
+	if (!w) {
+		/* it may turn out to be wanted once its parent comes */
+		if (type == OBJ_TREE &&
+		    cs->parked_bytes + size <= PARKED_TREES_MAX &&
+		    !oidmap_get(&cs->parked, oid)) {
+			struct parked_tree *p;
+
+			CALLOC_ARRAY(p, 1);
+			oidcpy(&p->entry.oid, oid);
+			p->data = xmemdupz(data, size);
+			p->size = size;
+			oidmap_put(&cs->parked, p);
+			cs->parked_bytes += size;
+		} else if (type == OBJ_BLOB && handle &&
+			   cs->nr_seen < SEEN_BLOBS_MAX &&
+			   !oidmap_get(&cs->seen, oid)) {
+			struct seen_blob *b;
+
+			CALLOC_ARRAY(b, 1);
+			oidcpy(&b->entry.oid, oid);
+			b->handle = handle;
+			oidmap_put(&cs->seen, b);
+			cs->nr_seen++;
+		}
+		goto out;
+	}
+
+	if (w->type != type) {
+		poison(cs);
+		goto out;
+	}
+	if (type == OBJ_TREE) {
+		take_apart(cs, w, data, size);
+		goto out;
+	}
+
+	oidmap_remove(&cs->wanted, oid);
+	CALLOC_ARRAY(jobs, 1);
+	oidcpy(&jobs->oid, oid);
+	jobs->data = xmemdupz(data, size);
+	jobs->size = size;
+	jobs->paths = w->paths;
+	free(w);
+
+out:
+	if (cs->ready_nr) {
+		struct write_job *ready = take_ready(cs);
+
+		while (ready) {
+			struct write_job *job = ready;
+
+			ready = job->next;
+			job->next = jobs;
+			jobs = job;
+		}
+	}
+	pthread_mutex_unlock(&cs->mutex);
+	submit(cs, jobs);
+}
+
+void checkout_stream_received(struct checkout_stream *cs)
+{
+	struct write_job *jobs;
+
+	pthread_mutex_lock(&cs->mutex);
+	cs->received = 1;
+	jobs = cs->deferred;
+	cs->deferred = NULL;
+	pthread_mutex_unlock(&cs->mutex);
+	submit(cs, jobs);
+}
+
+static void remove_written(struct checkout_stream *cs)
+{
+	const char *p = cs->written.buf, *end = p + cs->written.len;
+
+	while (p < end) {
+		const char *path = strchr(strchr(p, ' ') + 1, ' ') + 1;
+		struct strbuf sb = STRBUF_INIT;
+
+		strbuf_addf(&sb, "%s%s", cs->worktree.buf, path);
+		unlink(sb.buf);
+		strbuf_release(&sb);
+		p = path + strlen(path) + 1;
+	}
+	strbuf_reset(&cs->written);
+	cs->nr_written = 0;
+}
+
+void checkout_stream_finish(struct checkout_stream *cs)
+{
+	struct oidmap_iter iter;
+	struct wanted_object *w;
+	struct parked_tree *p;
+
+	pthread_mutex_lock(&cs->mutex);
+	cs->stopping = 1;
+	pthread_cond_broadcast(&cs->cond);
+	pthread_mutex_unlock(&cs->mutex);
+	for (int i = 0; i < cs->nr_threads; i++)
+		pthread_join(cs->threads[i], NULL);
+	free(cs->threads);
+
+	if (cs->poisoned)
+		remove_written(cs);
+	trace2_data_intmax("checkout-stream", cs->repo, "written",
+			   cs->nr_written);
+	if (cs->nr_written) {
+		char *list = repo_git_path(cs->repo, CHECKOUT_STREAM_LIST);
+
+		strbuf_insertf(&cs->written, 0, "tree %s\n",
+			       oid_to_hex(&cs->tree));
+		write_file_buf(list, cs->written.buf, cs->written.len);
+		free(list);
+	}
+
+	for (w = oidmap_iter_first(&cs->wanted, &iter); w;
+	     w = oidmap_iter_next(&iter))
+		string_list_clear(&w->paths, 0);
+	oidmap_clear(&cs->wanted, 1);
+	for (p = oidmap_iter_first(&cs->parked, &iter); p;
+	     p = oidmap_iter_next(&iter))
+		free(p->data);
+	oidmap_clear(&cs->parked, 1);
+	oidmap_clear(&cs->seen, 1);
+	while (cs->deferred) {
+		struct write_job *job = cs->deferred;
+
+		cs->deferred = job->next;
+		free_job(job);
+	}
+	free(cs->ready);
+	strbuf_release(&cs->written);
+	strbuf_release(&cs->worktree);
+	pthread_cond_destroy(&cs->cond);
+	pthread_mutex_destroy(&cs->mutex);
+	free(cs);
+}
+
+static int add_streamed(struct index_state *istate, const char *path,
+			unsigned mode, const struct object_id *oid)
+{
+	size_t len = strlen(path);
+	struct cache_entry *ce;
+	struct stat st;
+
+	if (lstat(path, &st) || !S_ISREG(st.st_mode))
+		return -1;
+
+	ce = make_empty_cache_entry(istate, len);
+	memcpy(ce->name, path, len);
+	ce->ce_flags = create_ce_flags(0);
+	ce->ce_namelen = len;
+	ce->ce_mode = create_ce_mode(mode);
+	oidcpy(&ce->oid, oid);
+	fill_stat_cache_info(istate, ce, &st);
+	if (add_index_entry(istate, ce, ADD_CACHE_OK_TO_ADD)) {
+		discard_cache_entry(ce);
+		return -1;
+	}
+	return 0;
+}
+
+int checkout_stream_load(struct index_state *istate,
+			 const struct object_id *tree)
+{
+	const struct git_hash_algo *algop = istate->repo->hash_algo;
+	char *list = repo_git_path(istate->repo, CHECKOUT_STREAM_LIST);
+	struct strbuf buf = STRBUF_INIT;
+	const char *p, *end, *eol;
+	struct object_id oid;
+	int usable = 0, nr = 0;
+
+	if (strbuf_read_file(&buf, list, 0) < 0)
+		goto out;
+	p = buf.buf;
+	end = buf.buf + buf.len;
+
+	eol = memchr(p, '\n', end - p);
+	if (!eol)
+		goto out;
+	if (tree && skip_prefix(p, "tree ", &p) &&
+	    !parse_oid_hex_algop(p, &oid, &p, algop) && p == eol &&
+	    oideq(&oid, tree))
+		usable = 1;
+
+	for (p = eol + 1; p < end; p += strlen(p) + 1) {
+		const char *path = NULL;
+		unsigned long mode;
+		char *q;
+
+		mode = strtoul(p, &q, 8);
+		if (*q == ' ' && !parse_oid_hex_algop(q + 1, &oid, &p, algop) &&
+		    *p == ' ')
+			path = p + 1;
+		if (!path)
+			break;
+		if (usable && !add_streamed(istate, path, mode, &oid))
+			nr++;
+		else
+			unlink(path);
+	}
+
+out:
+	unlink(list);
+	free(list);
+	strbuf_release(&buf);
+	return nr;
+}
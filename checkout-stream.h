@@ -0,0 +1,86 @@
+#ifndef CHECKOUT_STREAM_H
+#define CHECKOUT_STREAM_H
+
+#include "object.h"
+
+struct index_state;
+struct repository;
+
+/*
+ * checkout-stream - write out the files of a commit while its pack is
+ * still being received.
+ *
+ * "git index-pack --stream-checkout" feeds every object it has hashed to
+ * checkout_stream_object(). Once the commit to check out comes by, its
+ * tree and then every subtree that shows up are taken apart, and the
+ * regular files below it are written to the working tree as their blobs
+ * come in, in the background when checkout.workers allows it. Blobs
+ * that arrive before the tree naming them are read back from the pack
+ * once it has been received in full; trees are kept in memory for a
+ * while. Whatever still misses is left for the real checkout to write.
+ *
+ * What was written is listed in $GIT_DIR/STREAMED_CHECKOUT, from where
+ * checkout_stream_load() puts it into the index, so that the checkout
+ * that follows finds these files up to date and leaves them alone.
+ */
+
+#define CHECKOUT_STREAM_LIST "STREAMED_CHECKOUT"
+
+struct checkout_stream;
+
+/*
+ * Read back the blob passed as "handle" to checkout_stream_object(),
+ * storing its size in "size".
+ */
+typedef void *(*checkout_stream_reread_fn)(void *handle, unsigned long *size);
+
+/*
+ * Return whether files written without looking at attributes or the
+ * end-of-line configuration would be the same as those checkout writes.
+ */
+int checkout_stream_possible(struct repository *r);
+
+/*
+ * Start writing the files of "commit" (or of the commit a tag by that
+ * name points at) below the existing, otherwise empty, directory
+ * "worktree".
+ */
+struct checkout_stream *checkout_stream_start(struct repository *r,
+					      const struct object_id *commit,
+					      const char *worktree,
+					      checkout_stream_reread_fn reread);
+
+/*
+ * Offer an object of the pack. Blobs too big to be in memory are passed
+ * with a NULL "data" and skipped. A blob that can be read back later has
+ * a non-NULL "handle" for "reread", which is called in the thread that
+ * offers the object making it wanted, or the one that calls
+ * checkout_stream_received(). May be called from several threads.
+ */
+void checkout_stream_object(struct checkout_stream *cs,
+			    const struct object_id *oid,
+			    enum object_type type,
+			    const void *data, unsigned long size,
+			    void *handle);
+
+/* Tell that the whole pack has been received and blobs can be read back. */
+void checkout_stream_received(struct checkout_stream *cs);
+
+/*
+ * Wait for the files still being written and list them all in
+ * $GIT_DIR/STREAMED_CHECKOUT. If the tree turned out to have attributes
+ * of its own, remove them again instead.
+ */
+void checkout_stream_finish(struct checkout_stream *cs);
+
+/*
+ * Add the files listed in $GIT_DIR/STREAMED_CHECKOUT to "istate" if the
+ * list was written for the tree "tree", and remove the list. Files that
+ * cannot be used, or all of them when "tree" is NULL or another one, are
+ * deleted so that checkout does not take them for untracked files.
+ * Return the number of entries added.
+ */
+int checkout_stream_load(struct index_state *istate,
+			 const struct object_id *tree);
+
+#endif
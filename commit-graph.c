@@ -6,6 +6,7 @@
 #include "environment.h"
 #include "gettext.h"
 #include "hex.h"
+#include "ident.h"
 #include "lockfile.h"
 #include "packfile.h"
 #include "commit.h"
@@ -24,9 +25,11 @@
 #include "commit-slab.h"
 #include "shallow.h"
 #include "json-writer.h"
+#include "strmap.h"
 #include "trace2.h"
 #include "tree.h"
 #include "chunk-format.h"
+#include "thread-utils.h"
 
 void git_test_write_commit_graph_or_die(struct odb_source *source)
 {
@@ -51,6 +54,11 @@ void git_test_write_commit_graph_or_die(struct odb_source *source)
 #define GRAPH_CHUNKID_BLOOMINDEXES 0x42494458 /* "BIDX" */
 #define GRAPH_CHUNKID_BLOOMDATA 0x42444154 /* "BDAT" */
 #define GRAPH_CHUNKID_BASE 0x42415345 /* "BASE" */
+#define GRAPH_CHUNKID_PATHINDEX 0x50494458 /* "PIDX" */
+#define GRAPH_CHUNKID_PATHNAMES 0x504e414d /* "PNAM" */
+#define GRAPH_CHUNKID_PATHCOMMITS 0x50434f4d /* "PCOM" */
+#define GRAPH_CHUNKID_IDENTS 0x49444e54 /* "IDNT" */
+#define GRAPH_CHUNKID_COMMITIDENTS 0x43494454 /* "CIDT" */
 
 #define GRAPH_VERSION_1 0x1
 #define GRAPH_VERSION GRAPH_VERSION_1
@@ -63,6 +71,9 @@ void git_test_write_commit_graph_or_die(struct odb_source *source)
 
 #define GRAPH_HEADER_SIZE 8
 #define GRAPH_FANOUT_SIZE (4 * 256)
+#define PATH_INDEX_ENTRY_SIZE (2 * sizeof(uint32_t))
+#define COMMIT_IDENTS_WIDTH (4 * sizeof(uint32_t))
+#define GRAPH_IDENT_NONE 0xffffffff
 
 #define CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW (1ULL << 31)
 
@@ -370,6 +381,34 @@ static int graph_read_bloom_data(const unsigned char *chunk_start,
 	return 0;
 }
 
+static int graph_read_path_index(const unsigned char *chunk_start,
+				 size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+
+	/* the entry for the empty path and the end marker at least */
+	if (chunk_size % PATH_INDEX_ENTRY_SIZE ||
+	    chunk_size < 2 * PATH_INDEX_ENTRY_SIZE) {
+		warning(_("commit-graph changed-path history index chunk is the wrong size"));
+		return -1;
+	}
+	g->chunk_path_index = chunk_start;
+	g->num_index_paths = chunk_size / PATH_INDEX_ENTRY_SIZE - 1;
+	return 0;
+}
+
+static int graph_read_commit_idents(const unsigned char *chunk_start,
+				    size_t chunk_size, void *data)
+{
+	struct commit_graph *g = data;
+	if (chunk_size / COMMIT_IDENTS_WIDTH != g->num_commits) {
+		warning(_("commit-graph commit idents chunk is wrong size"));
+		return -1;
+	}
+	g->chunk_commit_idents = chunk_start;
+	return 0;
+}
+
 struct commit_graph *parse_commit_graph(struct repository *r,
 					void *graph_map, size_t graph_size)
 {
@@ -447,6 +486,12 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 		   &graph->chunk_extra_edges_size);
 	pair_chunk(cf, GRAPH_CHUNKID_BASE, &graph->chunk_base_graphs,
 		   &graph->chunk_base_graphs_size);
+	pair_chunk(cf, GRAPH_CHUNKID_IDENTS, &graph->chunk_idents,
+		   &graph->chunk_idents_size);
+	read_chunk(cf, GRAPH_CHUNKID_COMMITIDENTS, graph_read_commit_idents,
+		   graph);
+	if (!graph->chunk_idents)
+		graph->chunk_commit_idents = NULL;
 
 	prepare_repo_settings(r);
 
@@ -466,6 +511,14 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 			   graph_read_bloom_index, graph);
 		read_chunk(cf, GRAPH_CHUNKID_BLOOMDATA,
 			   graph_read_bloom_data, graph);
+		read_chunk(cf, GRAPH_CHUNKID_PATHINDEX,
+			   graph_read_path_index, graph);
+		pair_chunk(cf, GRAPH_CHUNKID_PATHNAMES,
+			   &graph->chunk_path_names,
+			   &graph->chunk_path_names_size);
+		pair_chunk(cf, GRAPH_CHUNKID_PATHCOMMITS,
+			   &graph->chunk_path_commits,
+			   &graph->chunk_path_commits_size);
 	}
 
 	if (graph->chunk_bloom_indexes && graph->chunk_bloom_data) {
@@ -477,6 +530,15 @@ struct commit_graph *parse_commit_graph(struct repository *r,
 		FREE_AND_NULL(graph->bloom_filter_settings);
 	}
 
+	/* The history index is only used together with the filters */
+	if (!graph->chunk_bloom_data || !graph->chunk_path_index ||
+	    !graph->chunk_path_names || !graph->chunk_path_commits) {
+		graph->chunk_path_index = NULL;
+		graph->chunk_path_names = NULL;
+		graph->chunk_path_commits = NULL;
+		graph->num_index_paths = 0;
+	}
+
 	oidread(&graph->oid, graph->data + graph->data_len - graph->hash_algo->rawsz,
 		r->hash_algo);
 
@@ -821,6 +883,206 @@ struct bloom_filter_settings *get_bloom_filter_settings(struct repository *r)
 	return NULL;
 }
 
+struct path_index_layer {
+	struct commit_graph *g;
+	unsigned indexed:1;
+	/* commits of this layer the index says nothing about */
+	const unsigned char *unindexed;
+	uint32_t unindexed_nr;
+	/* commits of this layer that changed the path */
+	const unsigned char *changed;
+	uint32_t changed_nr;
+};
+
+struct commit_graph_path_query {
+	struct path_index_layer *layers;
+	size_t nr, alloc;
+};
+
+/*
+ * Read the i-th entry of the history index of "g", checking it against
+ * the chunk sizes as we go.
+ */
+static int read_path_index_entry(struct commit_graph *g, uint32_t i,
+				 const char **name,
+				 const unsigned char **commits,
+				 uint32_t *commits_nr)
+{
+	const unsigned char *e = g->chunk_path_index +
+		st_mult(PATH_INDEX_ENTRY_SIZE, i);
+	uint32_t name_start = get_be32(e);
+	uint32_t commits_start = get_be32(e + 4);
+	uint32_t name_end = get_be32(e + PATH_INDEX_ENTRY_SIZE);
+	uint32_t commits_end = get_be32(e + PATH_INDEX_ENTRY_SIZE + 4);
+
+	if (name_start >= name_end ||
+	    name_end > g->chunk_path_names_size ||
+	    g->chunk_path_names[name_end - 1] ||
+	    commits_start > commits_end ||
+	    commits_end > g->chunk_path_commits_size / sizeof(uint32_t))
+		return error(_("commit-graph changed-path history index entry %"PRIu32" is corrupt"),
+			     i);
+
+	*name = (const char *)g->chunk_path_names + name_start;
+	*commits = g->chunk_path_commits + st_mult(sizeof(uint32_t), commits_start);
+	*commits_nr = commits_end - commits_start;
+	return 0;
+}
+
+static int lookup_path_index(struct commit_graph *g, const char *path,
+			     const unsigned char **commits,
+			     uint32_t *commits_nr)
+{
+	uint32_t lo = 0, hi = g->num_index_paths;
+
+	*commits_nr = 0;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		const char *name;
+		int cmp;
+
+		if (read_path_index_entry(g, mi, &name, commits, commits_nr))
+			return -1;
+		cmp = strcmp(path, name);
+		if (!cmp)
+			return 0;
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	*commits_nr = 0;
+	return 0;
+}
+
+static int contains_be32(const unsigned char *list, uint32_t nr, uint32_t v)
+{
+	uint32_t lo = 0, hi = nr;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		uint32_t cur = get_be32(list + st_mult(sizeof(uint32_t), mi));
+
+		if (cur == v)
+			return 1;
+		if (v < cur)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+struct commit_graph_path_query *commit_graph_path_query_new(struct repository *r,
+							    const char *path)
+{
+	struct commit_graph_path_query *q;
+	struct commit_graph *g;
+	int found = 0;
+
+	CALLOC_ARRAY(q, 1);
+	for (g = r->objects->commit_graph; g; g = g->base_graph) {
+		struct path_index_layer *l;
+
+		ALLOC_GROW(q->layers, q->nr + 1, q->alloc);
+		l = &q->layers[q->nr++];
+		memset(l, 0, sizeof(*l));
+		l->g = g;
+		if (!g->num_index_paths)
+			continue;
+
+		/* the empty path lists the commits that were not indexed */
+		if (lookup_path_index(g, "", &l->unindexed, &l->unindexed_nr) ||
+		    lookup_path_index(g, path, &l->changed, &l->changed_nr))
+			continue;
+		l->indexed = 1;
+		found = 1;
+	}
+
+	if (!found) {
+		commit_graph_path_query_free(q);
+		return NULL;
+	}
+	return q;
+}
+
+int commit_graph_path_query_changed(struct commit_graph_path_query *q,
+				    struct commit *c)
+{
+	uint32_t pos = commit_graph_position(c);
+	size_t i;
+
+	if (pos == COMMIT_NOT_FROM_GRAPH)
+		return -1;
+
+	for (i = 0; i < q->nr; i++) {
+		struct path_index_layer *l = &q->layers[i];
+
+		if (pos < l->g->num_commits_in_base)
+			continue;
+
+		pos -= l->g->num_commits_in_base;
+		if (!l->indexed ||
+		    contains_be32(l->unindexed, l->unindexed_nr, pos))
+			return -1;
+		return contains_be32(l->changed, l->changed_nr, pos);
+	}
+	return -1;
+}
+
+void commit_graph_path_query_free(struct commit_graph_path_query *q)
+{
+	if (!q)
+		return;
+	free(q->layers);
+	free(q);
+}
+
+static const char *commit_graph_ident(struct commit_graph *g, uint32_t offset)
+{
+	if (offset >= g->chunk_idents_size ||
+	    !memchr(g->chunk_idents + offset, '\0', g->chunk_idents_size - offset)) {
+		warning(_("commit-graph has an out-of-range ident offset"));
+		return NULL;
+	}
+	return (const char *)g->chunk_idents + offset;
+}
+
+int repo_commit_graph_idents(struct repository *r, const struct commit *c,
+			     struct commit_graph_idents *idents)
+{
+	struct commit_graph *g = r->objects->commit_graph;
+	uint32_t pos = commit_graph_position(c);
+	const unsigned char *row;
+	uint32_t author, committer;
+	uint64_t date_high, date_low;
+
+	if (pos == COMMIT_NOT_FROM_GRAPH)
+		return -1;
+	while (g && pos < g->num_commits_in_base)
+		g = g->base_graph;
+	if (!g || !g->chunk_commit_idents ||
+	    pos >= g->num_commits + g->num_commits_in_base)
+		return -1;
+
+	row = g->chunk_commit_idents +
+		st_mult(COMMIT_IDENTS_WIDTH, pos - g->num_commits_in_base);
+	author = get_be32(row);
+	committer = get_be32(row + 4);
+	if (author == GRAPH_IDENT_NONE || committer == GRAPH_IDENT_NONE)
+		return -1;
+
+	idents->author = commit_graph_ident(g, author);
+	idents->committer = commit_graph_ident(g, committer);
+	if (!idents->author || !idents->committer)
+		return -1;
+
+	date_high = get_be32(row + 8);
+	date_low = get_be32(row + 12);
+	idents->author_date = (timestamp_t)((date_high << 32) | date_low);
+	return 0;
+}
+
 void close_commit_graph(struct object_database *o)
 {
 	if (!o->commit_graph)
@@ -877,12 +1139,49 @@ static struct commit_list **insert_parent_or_die(struct commit_graph *g,
 	return &commit_list_insert(c, pptr)->next;
 }
 
+/*
+ * Return the generation number of the commit at "lex_index" of "g", whose
+ * commit data is at "commit_data" and whose commit date is "date".
+ */
+static timestamp_t graph_generation_at(struct commit_graph *g, uint32_t lex_index,
+				       const unsigned char *commit_data,
+				       timestamp_t date)
+{
+	uint32_t offset_pos;
+	uint64_t offset;
+
+	if (!g->read_generation_data)
+		return get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
+
+	offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
+
+	if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
+		if (!g->chunk_generation_data_overflow)
+			die(_("commit-graph requires overflow generation data but has none"));
+
+		offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
+		if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
+			die(_("commit-graph overflow generation data is too small"));
+		return date + get_be64(g->chunk_generation_data_overflow + sizeof(uint64_t) * offset_pos);
+	}
+	return date + offset;
+}
+
+static timestamp_t graph_commit_date(struct commit_graph *g,
+				     const unsigned char *commit_data)
+{
+	uint64_t date_high, date_low;
+
+	date_high = get_be32(commit_data + g->hash_algo->rawsz + 8) & 0x3;
+	date_low = get_be32(commit_data + g->hash_algo->rawsz + 12);
+	return (timestamp_t)((date_high << 32) | date_low);
+}
+
 static void fill_commit_graph_info(struct commit *item, struct commit_graph *g, uint32_t pos)
 {
 	const unsigned char *commit_data;
 	struct commit_graph_data *graph_data;
-	uint32_t lex_index, offset_pos;
-	uint64_t date_high, date_low, offset;
+	uint32_t lex_index;
 
 	while (pos < g->num_commits_in_base)
 		g = g->base_graph;
@@ -896,26 +1195,9 @@ static void fill_commit_graph_info(struct commit *item, struct commit_graph *g,
 	graph_data = commit_graph_data_at(item);
 	graph_data->graph_pos = pos;
 
-	date_high = get_be32(commit_data + g->hash_algo->rawsz + 8) & 0x3;
-	date_low = get_be32(commit_data + g->hash_algo->rawsz + 12);
-	item->date = (timestamp_t)((date_high << 32) | date_low);
-
-	if (g->read_generation_data) {
-		offset = (timestamp_t)get_be32(g->chunk_generation_data + st_mult(sizeof(uint32_t), lex_index));
-
-		if (offset & CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW) {
-			if (!g->chunk_generation_data_overflow)
-				die(_("commit-graph requires overflow generation data but has none"));
-
-			offset_pos = offset ^ CORRECTED_COMMIT_DATE_OFFSET_OVERFLOW;
-			if (g->chunk_generation_data_overflow_size / sizeof(uint64_t) <= offset_pos)
-				die(_("commit-graph overflow generation data is too small"));
-			graph_data->generation = item->date +
-				get_be64(g->chunk_generation_data_overflow + sizeof(uint64_t) * offset_pos);
-		} else
-			graph_data->generation = item->date + offset;
-	} else
-		graph_data->generation = get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
+	item->date = graph_commit_date(g, commit_data);
+	graph_data->generation = graph_generation_at(g, lex_index, commit_data,
+						     item->date);
 
 	if (g->topo_levels)
 		*topo_level_slab_at(g->topo_levels, item) = get_be32(commit_data + g->hash_algo->rawsz + 8) >> 2;
@@ -1045,6 +1327,189 @@ struct commit *lookup_commit_in_graph(struct repository *repo, const struct obje
 	return commit;
 }
 
+struct graph_walk_entry {
+	timestamp_t generation;
+	uint32_t pos;
+};
+
+struct graph_walk {
+	struct commit_graph *g;
+	uint32_t nr_commits;
+	/* one byte of GRAPH_WALK_* flags per commit-graph position */
+	unsigned char *flags;
+	/* max-heap of queued positions by generation */
+	struct graph_walk_entry *queue;
+	size_t queue_nr, queue_alloc;
+	/* number of queued positions not marked GRAPH_WALK_UNINTERESTING */
+	size_t interesting;
+};
+
+#define GRAPH_WALK_QUEUED	(1u<<0)
+#define GRAPH_WALK_UNINTERESTING	(1u<<1)
+
+static const unsigned char *graph_walk_data(struct commit_graph **g, uint32_t pos,
+					    uint32_t *lex_index)
+{
+	while (pos < (*g)->num_commits_in_base)
+		*g = (*g)->base_graph;
+	*lex_index = pos - (*g)->num_commits_in_base;
+	return (*g)->chunk_commit_data +
+		st_mult(graph_data_width((*g)->hash_algo), *lex_index);
+}
+
+/*
+ * Queue "pos" with "flags", or add them to those of the already queued
+ * entry. Return -1 if the commit has no generation number to order the
+ * walk by.
+ */
+static int graph_walk_push(struct graph_walk *w, uint32_t pos, unsigned flags)
+{
+	struct commit_graph *g = w->g;
+	const unsigned char *commit_data;
+	uint32_t lex_index;
+	timestamp_t generation;
+	size_t i;
+
+	if (pos >= w->nr_commits)
+		die(_("invalid parent position %"PRIu32), pos);
+
+	if (w->flags[pos] & GRAPH_WALK_QUEUED) {
+		if ((flags & GRAPH_WALK_UNINTERESTING) &&
+		    !(w->flags[pos] & GRAPH_WALK_UNINTERESTING))
+			w->interesting--;
+		w->flags[pos] |= flags;
+		return 0;
+	}
+
+	commit_data = graph_walk_data(&g, pos, &lex_index);
+	generation = graph_generation_at(g, lex_index, commit_data,
+					 graph_commit_date(g, commit_data));
+	if (generation == GENERATION_NUMBER_ZERO)
+		return -1;
+
+	w->flags[pos] = flags | GRAPH_WALK_QUEUED;
+	if (!(flags & GRAPH_WALK_UNINTERESTING))
+		w->interesting++;
+
+	ALLOC_GROW(w->queue, w->queue_nr + 1, w->queue_alloc);
+	for (i = w->queue_nr++; i; i = (i - 1) / 2) {
+		struct graph_walk_entry *parent = &w->queue[(i - 1) / 2];
+		if (parent->generation >= generation)
+			break;
+		w->queue[i] = *parent;
+	}
+	w->queue[i].generation = generation;
+	w->queue[i].pos = pos;
+	return 0;
+}
+
+static uint32_t graph_walk_pop(struct graph_walk *w)
+{
+	uint32_t pos = w->queue[0].pos;
+	struct graph_walk_entry last = w->queue[--w->queue_nr];
+	size_t i = 0, child;
+
+	while ((child = 2 * i + 1) < w->queue_nr) {
+		if (child + 1 < w->queue_nr &&
+		    w->queue[child + 1].generation > w->queue[child].generation)
+			child++;
+		if (last.generation >= w->queue[child].generation)
+			break;
+		w->queue[i] = w->queue[child];
+		i = child;
+	}
+	if (w->queue_nr)
+		w->queue[i] = last;
+
+	if (!(w->flags[pos] & GRAPH_WALK_UNINTERESTING))
+		w->interesting--;
+	return pos;
+}
+
+static int graph_walk_push_parents(struct graph_walk *w, uint32_t pos)
+{
+	struct commit_graph *g = w->g;
+	const unsigned char *commit_data;
+	uint32_t lex_index, edge_value, parent_data_pos;
+	unsigned flags = w->flags[pos] & GRAPH_WALK_UNINTERESTING;
+
+	commit_data = graph_walk_data(&g, pos, &lex_index);
+
+	edge_value = get_be32(commit_data + g->hash_algo->rawsz);
+	if (edge_value == GRAPH_PARENT_NONE)
+		return 0;
+	if (graph_walk_push(w, edge_value, flags))
+		return -1;
+
+	edge_value = get_be32(commit_data + g->hash_algo->rawsz + 4);
+	if (edge_value == GRAPH_PARENT_NONE)
+		return 0;
+	if (!(edge_value & GRAPH_EXTRA_EDGES_NEEDED))
+		return graph_walk_push(w, edge_value, flags);
+
+	parent_data_pos = edge_value & GRAPH_EDGE_LAST_MASK;
+	do {
+		if (g->chunk_extra_edges_size / sizeof(uint32_t) <= parent_data_pos)
+			return error(_("commit-graph extra-edges pointer out of bounds"));
+		edge_value = get_be32(g->chunk_extra_edges +
+				      sizeof(uint32_t) * parent_data_pos);
+		if (graph_walk_push(w, edge_value & GRAPH_EDGE_LAST_MASK, flags))
+			return -1;
+		parent_data_pos++;
+	} while (!(edge_value & GRAPH_LAST_EDGE));
+
+	return 0;
+}
+
+int commit_graph_count_reachable(struct repository *r,
+				 const struct oid_array *include,
+				 const struct oid_array *exclude,
+				 uint32_t *count)
+{
+	struct graph_walk w = { 0 };
+	uint32_t pos, nr = 0;
+	intmax_t visited = 0;
+	int ret = -1;
+
+	if (!prepare_commit_graph(r))
+		return -1;
+	w.g = r->objects->commit_graph;
+	w.nr_commits = w.g->num_commits + w.g->num_commits_in_base;
+	w.flags = xcalloc(w.nr_commits, 1);
+
+	for (size_t i = 0; i < include->nr; i++)
+		if (!search_commit_pos_in_graph(&include->oid[i], w.g, &pos) ||
+		    graph_walk_push(&w, pos, 0))
+			goto out;
+	for (size_t i = 0; i < exclude->nr; i++)
+		if (!search_commit_pos_in_graph(&exclude->oid[i], w.g, &pos) ||
+		    graph_walk_push(&w, pos, GRAPH_WALK_UNINTERESTING))
+			goto out;
+
+	/*
+	 * Commits come out of the queue after all of their descendants in
+	 * it, so a commit that is still interesting when it comes out is
+	 * not reachable from any excluded tip. Once only uninteresting
+	 * commits are left, nothing else can be counted.
+	 */
+	while (w.interesting) {
+		pos = graph_walk_pop(&w);
+		visited++;
+		if (!(w.flags[pos] & GRAPH_WALK_UNINTERESTING))
+			nr++;
+		if (graph_walk_push_parents(&w, pos))
+			goto out;
+	}
+
+	*count = nr;
+	ret = 0;
+	trace2_data_intmax("commit-graph", r, "count-walk/visited", visited);
+out:
+	free(w.flags);
+	free(w.queue);
+	return ret;
+}
+
 static int parse_commit_in_graph_one(struct commit_graph *g,
 				     struct commit *item)
 {
@@ -1149,6 +1614,8 @@ struct write_commit_graph_context {
 		 report_progress:1,
 		 split:1,
 		 changed_paths:1,
+		 write_path_index:1,
+		 write_idents:1,
 		 order_by_pack:1,
 		 write_generation_data:1,
 		 trust_generation_numbers:1;
@@ -1163,6 +1630,29 @@ struct write_commit_graph_context {
 	int count_bloom_filter_trunc_empty;
 	int count_bloom_filter_trunc_large;
 	int count_bloom_filter_upgraded;
+
+	/* path => struct path_index_commits, while computing the filters */
+	struct strmap path_index;
+	/* the same, sorted by path for writing the index chunks */
+	struct string_list path_index_sorted;
+	size_t path_index_names_size;
+	size_t path_index_commits_nr;
+
+	/* the interned idents, and where each commit's are in there */
+	struct strintmap ident_offsets;
+	struct strbuf idents;
+	struct commit_ident_row *ident_rows;
+};
+
+struct commit_ident_row {
+	uint32_t author, committer;
+	timestamp_t author_date;
+};
+
+/* The lexicographic positions of the commits that changed one path */
+struct path_index_commits {
+	uint32_t *pos;
+	size_t nr, alloc;
 };
 
 static int write_graph_chunk_fanout(struct hashfile *f,
@@ -1475,6 +1965,85 @@ static int write_graph_chunk_bloom_data(struct hashfile *f,
 	return 0;
 }
 
+static int write_graph_chunk_path_index(struct hashfile *f,
+					void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	uint32_t name_pos = 0, commits_pos = 0;
+	size_t i;
+
+	for (i = 0; i < ctx->path_index_sorted.nr; i++) {
+		struct string_list_item *item = &ctx->path_index_sorted.items[i];
+		struct path_index_commits *commits = item->util;
+
+		hashwrite_be32(f, name_pos);
+		hashwrite_be32(f, commits_pos);
+		name_pos += strlen(item->string) + 1;
+		commits_pos += commits->nr;
+	}
+	hashwrite_be32(f, name_pos);
+	hashwrite_be32(f, commits_pos);
+
+	return 0;
+}
+
+static int write_graph_chunk_path_names(struct hashfile *f,
+					void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->path_index_sorted.nr; i++) {
+		const char *path = ctx->path_index_sorted.items[i].string;
+		hashwrite(f, path, strlen(path) + 1);
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_path_commits(struct hashfile *f,
+					  void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i, j;
+
+	for (i = 0; i < ctx->path_index_sorted.nr; i++) {
+		struct path_index_commits *commits =
+			ctx->path_index_sorted.items[i].util;
+
+		for (j = 0; j < commits->nr; j++)
+			hashwrite_be32(f, commits->pos[j]);
+	}
+
+	return 0;
+}
+
+static int write_graph_chunk_idents(struct hashfile *f,
+				    void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	hashwrite(f, ctx->idents.buf, ctx->idents.len);
+	return 0;
+}
+
+static int write_graph_chunk_commit_idents(struct hashfile *f,
+					   void *data)
+{
+	struct write_commit_graph_context *ctx = data;
+	size_t i;
+
+	for (i = 0; i < ctx->commits.nr; i++) {
+		struct commit_ident_row *row = &ctx->ident_rows[i];
+
+		hashwrite_be32(f, row->author);
+		hashwrite_be32(f, row->committer);
+		hashwrite_be32(f, (uint32_t)((uint64_t)row->author_date >> 32));
+		hashwrite_be32(f, (uint32_t)row->author_date);
+	}
+
+	return 0;
+}
+
 static int add_packed_commits(const struct object_id *oid,
 			      struct packed_git *pack,
 			      uint32_t pos,
@@ -1779,12 +2348,115 @@ static void trace2_bloom_filter_write_statistics(struct write_commit_graph_conte
 			   ctx->count_bloom_filter_upgraded);
 }
 
+static void path_index_add(struct write_commit_graph_context *ctx,
+			   const char *path, uint32_t pos)
+{
+	struct path_index_commits *commits = strmap_get(&ctx->path_index, path);
+
+	if (!commits) {
+		CALLOC_ARRAY(commits, 1);
+		strmap_put(&ctx->path_index, path, commits);
+	}
+	ALLOC_GROW(commits->pos, commits->nr + 1, commits->alloc);
+	commits->pos[commits->nr++] = pos;
+}
+
+static void add_commit_to_path_index(struct write_commit_graph_context *ctx,
+				     struct commit *c,
+				     enum bloom_filter_computed computed,
+				     const struct string_list *paths)
+{
+	int pos = oid_pos(&c->object.oid, ctx->commits.list, ctx->commits.nr,
+			  commit_to_oid);
+	size_t i;
+
+	if (pos < 0)
+		BUG("commit %s is not in the commit-graph being written",
+		    oid_to_hex(&c->object.oid));
+
+	/* the empty path lists the commits whose paths are not known */
+	if (!(computed & BLOOM_PATHS))
+		path_index_add(ctx, "", pos);
+	for (i = 0; i < paths->nr; i++)
+		path_index_add(ctx, paths->items[i].string, pos);
+}
+
+static int cmp_uint32(const void *a_, const void *b_)
+{
+	uint32_t a = *((uint32_t *)a_);
+	uint32_t b = *((uint32_t *)b_);
+
+	return (a < b) ? -1 : (a != b);
+}
+
+static void clear_path_index(struct write_commit_graph_context *ctx)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	strmap_for_each_entry(&ctx->path_index, &iter, e) {
+		struct path_index_commits *commits = e->value;
+		free(commits->pos);
+	}
+	strmap_clear(&ctx->path_index, 1);
+	string_list_clear(&ctx->path_index_sorted, 0);
+}
+
+static void prepare_path_index(struct write_commit_graph_context *ctx)
+{
+	struct hashmap_iter iter;
+	struct strmap_entry *e;
+
+	if (!strmap_get(&ctx->path_index, ""))
+		strmap_put(&ctx->path_index, "",
+			   xcalloc(1, sizeof(struct path_index_commits)));
+
+	strmap_for_each_entry(&ctx->path_index, &iter, e) {
+		struct path_index_commits *commits = e->value;
+
+		QSORT(commits->pos, commits->nr, cmp_uint32);
+		string_list_append(&ctx->path_index_sorted, e->key)->util = commits;
+		ctx->path_index_names_size =
+			st_add3(ctx->path_index_names_size, strlen(e->key), 1);
+		ctx->path_index_commits_nr =
+			st_add(ctx->path_index_commits_nr, commits->nr);
+	}
+	string_list_sort(&ctx->path_index_sorted);
+
+	if (ctx->path_index_names_size > UINT32_MAX ||
+	    ctx->path_index_commits_nr > UINT32_MAX) {
+		warning(_("too many changed paths to write the changed-path history index"));
+		ctx->write_path_index = 0;
+		return;
+	}
+
+	trace2_data_intmax("commit-graph", ctx->r, "path-index-paths",
+			   ctx->path_index_sorted.nr - 1);
+}
+
+/* how many commits to diff on threads before turning them into filters */
+#define BLOOM_PATHS_BATCH 2048
+
+static int get_bloom_filter_threads(struct repository *r)
+{
+	int nr_threads = 1;
+
+	if (!HAVE_THREADS)
+		return 1;
+	repo_config_get_int(r, "commitgraph.changedpathsthreads", &nr_threads);
+	if (nr_threads < 1)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
 static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 {
 	int i;
 	struct progress *progress = NULL;
 	struct commit **sorted_commits;
 	int max_new_filters;
+	int nr_threads = get_bloom_filter_threads(ctx->r);
+	int precomputed_end = 0;
 
 	init_bloom_filters();
 
@@ -1804,15 +2476,42 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 	max_new_filters = ctx->opts && ctx->opts->max_new_filters >= 0 ?
 		ctx->opts->max_new_filters : ctx->commits.nr;
 
+	trace2_data_intmax("commit-graph", ctx->r, "bloom_filter_threads",
+			   nr_threads);
+
 	for (i = 0; i < ctx->commits.nr; i++) {
 		enum bloom_filter_computed computed = 0;
 		struct commit *c = sorted_commits[i];
-		struct bloom_filter *filter = get_or_compute_bloom_filter(
+		struct bloom_filter *filter;
+		struct string_list paths = STRING_LIST_INIT_DUP;
+
+		/*
+		 * Diff the next batch of commits on threads. The filters
+		 * themselves are still built below, in order, so that the
+		 * counters and max_new_filters behave as without threads.
+		 */
+		if (nr_threads > 1 && i >= precomputed_end &&
+		    ctx->count_bloom_filter_computed < max_new_filters) {
+			size_t scanned = precompute_bloom_filter_paths(
+				ctx->r, sorted_commits + i,
+				ctx->commits.nr - i < BLOOM_PATHS_BATCH ?
+				ctx->commits.nr - i : BLOOM_PATHS_BATCH,
+				max_new_filters - ctx->count_bloom_filter_computed,
+				ctx->bloom_settings, nr_threads);
+			precomputed_end = i + scanned;
+		}
+
+		filter = get_or_compute_bloom_filter_paths(
 			ctx->r,
 			c,
 			ctx->count_bloom_filter_computed < max_new_filters,
 			ctx->bloom_settings,
-			&computed);
+			&computed,
+			ctx->write_path_index ? &paths : NULL);
+		if (ctx->write_path_index) {
+			add_commit_to_path_index(ctx, c, computed, &paths);
+			string_list_clear(&paths, 0);
+		}
 		if (computed & BLOOM_COMPUTED) {
 			ctx->count_bloom_filter_computed++;
 			if (computed & BLOOM_TRUNC_EMPTY)
@@ -1830,11 +2529,127 @@ static void compute_bloom_filters(struct write_commit_graph_context *ctx)
 
 	if (trace2_is_enabled())
 		trace2_bloom_filter_write_statistics(ctx);
+	if (ctx->write_path_index)
+		prepare_path_index(ctx);
 
 	free(sorted_commits);
 	stop_progress(&progress);
 }
 
+/*
+ * The part of an ident line that "git log --author" matches against,
+ * i.e. without the date, or NULL if there is no such part.
+ */
+static const char *ident_without_date(const char *ident, const char *eol)
+{
+	while (ident < --eol)
+		if (*eol == '>')
+			return eol + 1;
+	return NULL;
+}
+
+static uint32_t intern_ident(struct write_commit_graph_context *ctx,
+			     const char *ident, const char *end)
+{
+	char *str = xmemdupz(ident, end - ident);
+	uint32_t offset;
+
+	if (strintmap_contains(&ctx->ident_offsets, str)) {
+		offset = strintmap_get(&ctx->ident_offsets, str);
+	} else if (ctx->idents.len >= INT_MAX - (end - ident)) {
+		offset = GRAPH_IDENT_NONE;
+	} else {
+		offset = ctx->idents.len;
+		strbuf_add(&ctx->idents, str, end - ident + 1);
+		strintmap_set(&ctx->ident_offsets, str, offset);
+	}
+	free(str);
+	return offset;
+}
+
+static void fill_commit_ident_row(struct write_commit_graph_context *ctx,
+				  struct commit *c,
+				  struct commit_ident_row *row)
+{
+	const char *buffer = repo_get_commit_buffer(ctx->r, c, NULL);
+	const char *line, *eol;
+	const char *author = NULL, *author_eol = NULL;
+	const char *committer = NULL, *committer_eol = NULL;
+	const char *author_end, *committer_end;
+	struct ident_split ident;
+	char *date_end;
+
+	row->author = row->committer = GRAPH_IDENT_NONE;
+	row->author_date = 0;
+
+	/*
+	 * Only record the idents that "git log --author" and friends
+	 * would see as they are: there must be exactly one of each, and
+	 * no encoding to convert them from.
+	 */
+	for (line = buffer; *line && *line != '\n'; line = *eol ? eol + 1 : eol) {
+		const char *v;
+
+		eol = strchrnul(line, '\n');
+		if (skip_prefix(line, "author ", &v)) {
+			if (author)
+				goto out;
+			author = v;
+			author_eol = eol;
+		} else if (skip_prefix(line, "committer ", &v)) {
+			if (committer)
+				goto out;
+			committer = v;
+			committer_eol = eol;
+		} else if (starts_with(line, "encoding ")) {
+			goto out;
+		}
+	}
+	if (!author || !committer)
+		goto out;
+
+	author_end = ident_without_date(author, author_eol);
+	committer_end = ident_without_date(committer, committer_eol);
+	if (!author_end || !committer_end)
+		goto out;
+
+	if (split_ident_line(&ident, author, author_eol - author) ||
+	    !ident.date_begin || !ident.date_end)
+		goto out;
+	row->author_date = parse_timestamp(ident.date_begin, &date_end, 10);
+	if (date_end != ident.date_end)
+		goto out;
+
+	row->author = intern_ident(ctx, author, author_end);
+	row->committer = intern_ident(ctx, committer, committer_end);
+	if (row->author == GRAPH_IDENT_NONE || row->committer == GRAPH_IDENT_NONE)
+		row->author = row->committer = GRAPH_IDENT_NONE;
+
+out:
+	repo_unuse_commit_buffer(ctx->r, c, buffer);
+}
+
+static void compute_commit_idents(struct write_commit_graph_context *ctx)
+{
+	struct progress *progress = NULL;
+	size_t i;
+
+	if (ctx->report_progress)
+		progress = start_delayed_progress(
+			ctx->r,
+			_("Collecting commit authors and committers"),
+			ctx->commits.nr);
+
+	CALLOC_ARRAY(ctx->ident_rows, ctx->commits.nr);
+	for (i = 0; i < ctx->commits.nr; i++) {
+		fill_commit_ident_row(ctx, ctx->commits.list[i],
+				      &ctx->ident_rows[i]);
+		display_progress(progress, i + 1);
+	}
+
+	stop_progress(&progress);
+}
+
 struct refs_cb_data {
 	struct repository *repo;
 	struct oidset *commits;
@@ -2121,6 +2936,25 @@ static int write_commit_graph_file(struct write_commit_graph_context *ctx)
 				 ctx->total_bloom_filter_data_size),
 			  write_graph_chunk_bloom_data);
 	}
+	if (ctx->write_idents) {
+		add_chunk(cf, GRAPH_CHUNKID_IDENTS, ctx->idents.len,
+			  write_graph_chunk_idents);
+		add_chunk(cf, GRAPH_CHUNKID_COMMITIDENTS,
+			  st_mult(COMMIT_IDENTS_WIDTH, ctx->commits.nr),
+			  write_graph_chunk_commit_idents);
+	}
+	if (ctx->write_path_index) {
+		add_chunk(cf, GRAPH_CHUNKID_PATHINDEX,
+			  st_mult(PATH_INDEX_ENTRY_SIZE,
+				  st_add(ctx->path_index_sorted.nr, 1)),
+			  write_graph_chunk_path_index);
+		add_chunk(cf, GRAPH_CHUNKID_PATHNAMES,
+			  ctx->path_index_names_size,
+			  write_graph_chunk_path_names);
+		add_chunk(cf, GRAPH_CHUNKID_PATHCOMMITS,
+			  st_mult(sizeof(uint32_t), ctx->path_index_commits_nr),
+			  write_graph_chunk_path_commits);
+	}
 	if (ctx->num_commit_graphs_after > 1)
 		add_chunk(cf, GRAPH_CHUNKID_BASE,
 			  st_mult(hashsz, ctx->num_commit_graphs_after - 1),
@@ -2513,12 +3347,16 @@ int write_commit_graph(struct odb_source *source,
 		.total_bloom_filter_data_size = 0,
 		.write_generation_data = (get_configured_generation_version(r) == 2),
 		.num_generation_data_overflows = 0,
+		.path_index = STRMAP_INIT,
+		.ident_offsets = STRINTMAP_INIT,
+		.idents = STRBUF_INIT,
 	};
 	uint32_t i;
 	int res = 0;
 	int replace = 0;
 	struct bloom_filter_settings bloom_settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 	struct topo_level_slab topo_levels;
+	int write_idents;
 
 	prepare_repo_settings(r);
 	if (!r->settings.core_commit_graph) {
@@ -2579,6 +3417,17 @@ int write_commit_graph(struct odb_source *source,
 
 	bloom_settings.hash_version = bloom_settings.hash_version == 2 ? 2 : 1;
 
+	if (!repo_config_get_bool(r, "commitgraph.commitidents", &write_idents))
+		ctx.write_idents = !!write_idents;
+
+	if (ctx.changed_paths) {
+		int path_index = 0;
+
+		repo_config_get_bool(r, "commitgraph.changedpathsindex",
+				     &path_index);
+		ctx.write_path_index = !!path_index;
+	}
+
 	if (ctx.split) {
 		struct commit_graph *g = ctx.r->objects->commit_graph;
 
@@ -2659,6 +3508,8 @@ int write_commit_graph(struct odb_source *source,
 
 	if (ctx.changed_paths)
 		compute_bloom_filters(&ctx);
+	if (ctx.write_idents)
+		compute_commit_idents(&ctx);
 
 	res = write_commit_graph_file(&ctx);
 
@@ -2674,6 +3525,10 @@ int write_commit_graph(struct odb_source *source,
 	free(ctx.graph_name);
 	free(ctx.base_graph_name);
 	free(ctx.commits.list);
+	clear_path_index(&ctx);
+	strintmap_clear(&ctx.ident_offsets);
+	strbuf_release(&ctx.idents);
+	free(ctx.ident_rows);
 	oid_array_clear(&ctx.oids);
 	clear_topo_level_slab(&topo_levels);
 
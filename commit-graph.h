@@ -27,6 +27,7 @@ struct commit;
 struct bloom_filter_settings;
 struct repository;
 struct object_database;
+struct oid_array;
 struct string_list;
 
 char *get_commit_graph_filename(struct odb_source *source);
@@ -109,6 +110,15 @@ struct commit_graph {
 	const unsigned char *chunk_bloom_indexes;
 	const unsigned char *chunk_bloom_data;
 	size_t chunk_bloom_data_size;
+	const unsigned char *chunk_path_index;
+	uint32_t num_index_paths;
+	const unsigned char *chunk_path_names;
+	size_t chunk_path_names_size;
+	const unsigned char *chunk_path_commits;
+	size_t chunk_path_commits_size;
+	const unsigned char *chunk_idents;
+	size_t chunk_idents_size;
+	const unsigned char *chunk_commit_idents;
 
 	struct topo_level_slab *topo_levels;
 	struct bloom_filter_settings *bloom_filter_settings;
@@ -205,6 +215,54 @@ struct commit_graph_data {
 timestamp_t commit_graph_generation(const struct commit *);
 uint32_t commit_graph_position(const struct commit *);
 
+/*
+ * Ask the changed-path history index of the commit-graph, when it was
+ * written with commitGraph.changedPathsIndex, which commits changed
+ * "path" (a file, or a directory without a trailing slash). Returns
+ * NULL if no commit-graph layer has such an index.
+ */
+struct commit_graph_path_query;
+struct commit_graph_path_query *commit_graph_path_query_new(struct repository *r,
+							    const char *path);
+
+/*
+ * Return 1 if "c" changed the path of "q" (or anything below it) compared
+ * to its first parent, 0 if it did not, and -1 if the index does not know.
+ */
+int commit_graph_path_query_changed(struct commit_graph_path_query *q,
+				    struct commit *c);
+
+void commit_graph_path_query_free(struct commit_graph_path_query *q);
+
+struct commit_graph_idents {
+	/* "Name <email>", without the date */
+	const char *author;
+	const char *committer;
+	timestamp_t author_date;
+};
+
+/*
+ * Look up the author and committer of "c" and its author date in the
+ * commit-graph, when it was written with commitGraph.commitIdents, so
+ * that they can be had without reading the commit. Returns -1 if the
+ * commit-graph does not know them; the idents of commits that have an
+ * "encoding" header are never recorded.
+ */
+int repo_commit_graph_idents(struct repository *r, const struct commit *c,
+			     struct commit_graph_idents *idents);
+
+/*
+ * Count the commits reachable from the commits in "include" but not from
+ * those in "exclude" by walking the commit-graph by position, without
+ * looking up or parsing a "struct commit" for any of them. Returns -1,
+ * for the caller to fall back to a regular walk, unless all of the tips
+ * are in the commit-graph and it has generation numbers.
+ */
+int commit_graph_count_reachable(struct repository *r,
+				 const struct oid_array *include,
+				 const struct oid_array *exclude,
+				 uint32_t *count);
+
 /*
  * After this method, all commits reachable from those in the given
  * list will have non-zero, non-infinite generation numbers.
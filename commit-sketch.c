@@ -0,0 +1,285 @@
+#include "git-compat-util.h"
+#include "commit-sketch.h"
+#include "base85.h"
+#include "commit.h"
+#include "oidset.h"
+#include "pkt-line.h"
+#include "prio-queue.h"
+#include "repository.h"
+#include "strbuf.h"
+
+/*
+ * Object ids are already uniformly distributed, but the checksum that
+ * tells a cell holding a single commit from one holding several must not
+ * be linear in the key bytes, or XOR-ing keys would XOR checksums along.
+ */
+static uint64_t mix64(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static uint64_t key_hash(const struct git_hash_algo *algop,
+			 const unsigned char *key)
+{
+	uint64_t h = 0;
+	size_t i;
+
+	for (i = 0; i + 8 <= algop->rawsz; i += 8)
+		h = mix64(h ^ get_be64(key + i));
+	if (i + 4 <= algop->rawsz)
+		h = mix64(h ^ get_be32(key + i));
+	return h;
+}
+
+static size_t cell_index(const struct commit_sketch *s, uint64_t hash,
+			 int part)
+{
+	size_t part_nr = s->nr / COMMIT_SKETCH_PARTS;
+	uint64_t h = mix64(hash + 0x9e3779b97f4a7c15ULL * (part + 1));
+
+	return part * part_nr + h % part_nr;
+}
+
+static void toggle(struct commit_sketch *s, const unsigned char *key,
+		   uint64_t hash, int32_t count)
+{
+	for (int part = 0; part < COMMIT_SKETCH_PARTS; part++) {
+		struct commit_sketch_cell *c = &s->cells[cell_index(s, hash, part)];
+
+		c->count = (int32_t)((uint32_t)c->count + (uint32_t)count);
+		c->hash ^= hash;
+		for (size_t i = 0; i < s->algop->rawsz; i++)
+			c->key[i] ^= key[i];
+	}
+}
+
+size_t commit_sketch_cells_for(size_t nr)
+{
+	size_t cells = nr + nr / 2 + 32;
+
+	return DIV_ROUND_UP(cells, COMMIT_SKETCH_PARTS) * COMMIT_SKETCH_PARTS;
+}
+
+void commit_sketch_init(struct commit_sketch *s,
+			const struct git_hash_algo *algop, size_t nr)
+{
+	if (!nr || nr % COMMIT_SKETCH_PARTS)
+		BUG("sketch size %"PRIuMAX" is not a multiple of %d",
+		    (uintmax_t)nr, COMMIT_SKETCH_PARTS);
+	s->algop = algop;
+	s->nr = nr;
+	CALLOC_ARRAY(s->cells, nr);
+}
+
+void commit_sketch_release(struct commit_sketch *s)
+{
+	FREE_AND_NULL(s->cells);
+	s->nr = 0;
+}
+
+void commit_sketch_add(struct commit_sketch *s, const struct object_id *oid)
+{
+	toggle(s, oid->hash, key_hash(s->algop, oid->hash), 1);
+}
+
+void commit_sketch_subtract(struct commit_sketch *s,
+			    const struct commit_sketch *other)
+{
+	if (s->nr != other->nr)
+		BUG("subtracting sketches of different sizes");
+
+	for (size_t n = 0; n < s->nr; n++) {
+		struct commit_sketch_cell *c = &s->cells[n];
+		const struct commit_sketch_cell *o = &other->cells[n];
+
+		c->count = (int32_t)((uint32_t)c->count - (uint32_t)o->count);
+		c->hash ^= o->hash;
+		for (size_t i = 0; i < s->algop->rawsz; i++)
+			c->key[i] ^= o->key[i];
+	}
+}
+
+static int is_pure(const struct commit_sketch *s,
+		   const struct commit_sketch_cell *c)
+{
+	return (c->count == 1 || c->count == -1) &&
+		c->hash == key_hash(s->algop, c->key);
+}
+
+static int is_empty(const struct commit_sketch *s,
+		    const struct commit_sketch_cell *c)
+{
+	if (c->count || c->hash)
+		return 0;
+	for (size_t i = 0; i < s->algop->rawsz; i++)
+		if (c->key[i])
+			return 0;
+	return 1;
+}
+
+int commit_sketch_decode(struct commit_sketch *s,
+			 struct oidset *ours, struct oidset *theirs)
+{
+	size_t *pending = NULL, pending_nr = 0, pending_alloc = 0;
+	size_t peeled = 0;
+	int ret = 0;
+
+	for (size_t n = 0; n < s->nr; n++)
+		if (is_pure(s, &s->cells[n])) {
+			ALLOC_GROW(pending, pending_nr + 1, pending_alloc);
+			pending[pending_nr++] = n;
+		}
+
+	/*
+	 * Peel off the cells holding a single commit; removing that commit
+	 * from its other cells may leave one of them pure in turn. A sketch
+	 * that decodes never holds more commits than it has cells, so give
+	 * up on one (possibly made up by the other side) that seems to.
+	 */
+	while (pending_nr && peeled < s->nr) {
+		struct commit_sketch_cell *c = &s->cells[pending[--pending_nr]];
+		unsigned char key[GIT_MAX_RAWSZ];
+		struct object_id oid;
+		uint64_t hash;
+		int32_t count;
+
+		if (!is_pure(s, c))
+			continue;
+
+		memcpy(key, c->key, s->algop->rawsz);
+		hash = c->hash;
+		count = c->count;
+		oidread(&oid, key, s->algop);
+		if (count > 0 && ours)
+			oidset_insert(ours, &oid);
+		else if (count < 0 && theirs)
+			oidset_insert(theirs, &oid);
+
+		toggle(s, key, hash, -count);
+		peeled++;
+		for (int part = 0; part < COMMIT_SKETCH_PARTS; part++) {
+			size_t n = cell_index(s, hash, part);
+
+			if (is_pure(s, &s->cells[n])) {
+				ALLOC_GROW(pending, pending_nr + 1, pending_alloc);
+				pending[pending_nr++] = n;
+			}
+		}
+	}
+
+	for (size_t n = 0; n < s->nr; n++)
+		if (!is_empty(s, &s->cells[n])) {
+			ret = -1;
+			break;
+		}
+
+	memset(s->cells, 0, st_mult(s->nr, sizeof(*s->cells)));
+	free(pending);
+	return ret;
+}
+
+static size_t cell_size(const struct git_hash_algo *algop)
+{
+	return 4 + 8 + algop->rawsz;
+}
+
+void commit_sketch_write(const struct commit_sketch *s, struct strbuf *buf)
+{
+	size_t size = cell_size(s->algop);
+	unsigned char *raw;
+	char *encoded;
+
+	raw = xmalloc(st_mult(size, COMMIT_SKETCH_CELLS_PER_LINE));
+	encoded = xmalloc(st_mult(size, COMMIT_SKETCH_CELLS_PER_LINE) / 4 * 5 + 1);
+
+	for (size_t n = 0; n < s->nr; n += COMMIT_SKETCH_CELLS_PER_LINE) {
+		size_t nr = s->nr - n;
+		unsigned char *p = raw;
+
+		if (nr > COMMIT_SKETCH_CELLS_PER_LINE)
+			nr = COMMIT_SKETCH_CELLS_PER_LINE;
+		for (size_t i = 0; i < nr; i++) {
+			const struct commit_sketch_cell *c = &s->cells[n + i];
+
+			put_be32(p, (uint32_t)c->count);
+			put_be64(p + 4, c->hash);
+			memcpy(p + 12, c->key, s->algop->rawsz);
+			p += size;
+		}
+		encode_85(encoded, raw, p - raw);
+		packet_buf_write(buf, "sketch-data %s\n", encoded);
+	}
+
+	free(encoded);
+	free(raw);
+}
+
+int commit_sketch_read(struct commit_sketch *s, size_t *pos, const char *data)
+{
+	size_t size = cell_size(s->algop);
+	size_t len = strlen(data), raw_len, nr;
+	unsigned char *raw;
+	int ret = 0;
+
+	/* cell sizes are multiples of 4, which encode to 5 characters */
+	if (!len || len % 5)
+		return -1;
+	raw_len = len / 5 * 4;
+	if (raw_len % size)
+		return -1;
+	nr = raw_len / size;
+	if (nr > s->nr - *pos)
+		return -1;
+
+	raw = xmalloc(raw_len);
+	if (decode_85((char *)raw, data, raw_len)) {
+		ret = -1;
+		goto out;
+	}
+	for (size_t i = 0; i < nr; i++) {
+		struct commit_sketch_cell *c = &s->cells[*pos + i];
+		const unsigned char *p = raw + i * size;
+
+		c->count = (int32_t)get_be32(p);
+		c->hash = get_be64(p + 4);
+		memcpy(c->key, p + 12, s->algop->rawsz);
+	}
+	*pos += nr;
+
+out:
+	free(raw);
+	return ret;
+}
+
+void commit_sketch_collect(struct repository *r, struct commit_list *tips,
+			   timestamp_t since, struct oidset *out)
+{
+	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct commit *commit;
+
+	for (; tips; tips = tips->next)
+		if (!repo_parse_commit(r, tips->item) &&
+		    tips->item->date >= since)
+			prio_queue_put(&queue, tips->item);
+
+	while ((commit = prio_queue_get(&queue))) {
+		struct commit_list *p;
+
+		if (oidset_insert(out, &commit->object.oid))
+			continue;
+		for (p = commit->parents; p; p = p->next) {
+			if (repo_parse_commit(r, p->item) ||
+			    p->item->date < since ||
+			    oidset_contains(out, &p->item->object.oid))
+				continue;
+			prio_queue_put(&queue, p->item);
+		}
+	}
+
+	clear_prio_queue(&queue);
+}
@@ -0,0 +1,88 @@
+#ifndef COMMIT_SKETCH_H
+#define COMMIT_SKETCH_H
+
+#include "hash.h"
+
+struct commit_list;
+struct oidset;
+struct repository;
+struct strbuf;
+
+/*
+ * commit-sketch - an invertible Bloom lookup table over commit ids, used by
+ * the "sketch" fetch negotiation.
+ *
+ * The client adds its recent commits to a sketch and sends it along with
+ * its first request. The server builds a sketch of the same size over its
+ * own recent commits, subtracts the client's, and decodes the difference:
+ * the commits only it has and the commits only the client has. As long as
+ * the difference is small enough for the size of the sketch (about two
+ * thirds of the number of cells), this tells the server exactly which of
+ * its recent commits the client already has, whatever their number.
+ */
+
+/* Cells are kept in three equal parts, so "nr" is a multiple of this. */
+#define COMMIT_SKETCH_PARTS 3
+
+/* The most cells a sketch may have. */
+#define COMMIT_SKETCH_MAX_CELLS (1 << 18)
+
+/* The most cells sent on one "sketch-data" line. */
+#define COMMIT_SKETCH_CELLS_PER_LINE 1024
+
+struct commit_sketch_cell {
+	int32_t count;
+	uint64_t hash;
+	unsigned char key[GIT_MAX_RAWSZ];
+};
+
+struct commit_sketch {
+	const struct git_hash_algo *algop;
+	struct commit_sketch_cell *cells;
+	size_t nr;
+};
+
+/* Return the number of cells needed to decode a difference of "nr" commits. */
+size_t commit_sketch_cells_for(size_t nr);
+
+/* Initialize an empty sketch of "nr" cells, a multiple of COMMIT_SKETCH_PARTS. */
+void commit_sketch_init(struct commit_sketch *s,
+			const struct git_hash_algo *algop, size_t nr);
+void commit_sketch_release(struct commit_sketch *s);
+
+void commit_sketch_add(struct commit_sketch *s, const struct object_id *oid);
+
+/* Remove every commit of "other", which must have the same size, from "s". */
+void commit_sketch_subtract(struct commit_sketch *s,
+			    const struct commit_sketch *other);
+
+/*
+ * Take apart the difference left in "s" by commit_sketch_subtract(),
+ * adding the commits that were only in "s" to "ours" and those only in the
+ * subtracted sketch to "theirs" (either may be NULL). Return 0 when the
+ * whole difference was recovered, or -1 when it is too large for the size
+ * of the sketch, in which case what was added is incomplete. "s" is
+ * emptied either way.
+ */
+int commit_sketch_decode(struct commit_sketch *s,
+			 struct oidset *ours, struct oidset *theirs);
+
+/* Append the cells of "s" as "sketch-data" pkt-lines to "buf". */
+void commit_sketch_write(const struct commit_sketch *s, struct strbuf *buf);
+
+/*
+ * Read the cells on the "sketch-data" line "data" into "s", starting at
+ * cell "*pos" and advancing it. Return -1 if the line is malformed or
+ * holds more cells than are left.
+ */
+int commit_sketch_read(struct commit_sketch *s, size_t *pos, const char *data);
+
+/*
+ * Walk from "tips" in commit date order, adding every commit dated "since"
+ * or later to "out". Commits only reachable through older ones are not
+ * found, which at worst makes the difference look larger than it is.
+ */
+void commit_sketch_collect(struct repository *r, struct commit_list *tips,
+			   timestamp_t since, struct oidset *out);
+
+#endif
@@ -827,14 +827,20 @@ define_commit_slab(author_date_slab, timestamp_t);
 void record_author_date(struct author_date_slab *author_date,
 			struct commit *commit)
 {
-	const char *buffer = repo_get_commit_buffer(the_repository, commit,
-						    NULL);
+	const char *buffer;
+	struct commit_graph_idents idents;
 	struct ident_split ident;
 	const char *ident_line;
 	size_t ident_len;
 	char *date_end;
 	timestamp_t date;
 
+	if (!repo_commit_graph_idents(the_repository, commit, &idents)) {
+		*(author_date_slab_at(author_date, commit)) = idents.author_date;
+		return;
+	}
+
+	buffer = repo_get_commit_buffer(the_repository, commit, NULL);
 	ident_line = find_commit_header(buffer, "author", &ident_len);
 	if (!ident_line)
 		goto fail_exit; /* no author line */
@@ -136,6 +136,9 @@
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#ifndef NO_WRITEV
+#include <sys/uio.h>
+#endif
 #include <sys/statvfs.h>
 #include <termios.h>
 #ifndef NO_SYS_SELECT_H
@@ -323,6 +326,15 @@ int git_lstat(const char *, struct stat *);
 ssize_t git_pread(int fd, void *buf, size_t count, off_t offset);
 #endif
 
+#ifdef NO_WRITEV
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#define writev git_writev
+ssize_t git_writev(int fd, const struct iovec *iov, int iovcnt);
+#endif
+
 #ifdef NO_SETENV
 #define setenv gitsetenv
 int gitsetenv(const char *, const char *, int);
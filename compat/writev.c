@@ -0,0 +1,20 @@
+#include "../git-compat-util.h"
+
+ssize_t git_writev(int fd, const struct iovec *iov, int iovcnt)
+{
+	ssize_t total = 0;
+
+	for (int i = 0; i < iovcnt; i++) {
+		ssize_t rc;
+
+		if (!iov[i].iov_len)
+			continue;
+		rc = write(fd, iov[i].iov_base, iov[i].iov_len);
+		if (rc < 0)
+			return total ? total : -1;
+		total += rc;
+		if ((size_t)rc < iov[i].iov_len)
+			break;
+	}
+	return total;
+}
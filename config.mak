@@ -0,0 +1,5 @@
+NO_GETTEXT=YesPlease
+NO_TCLTK=YesPlease
+NO_PERL=YesPlease
+NO_PYTHON=YesPlease
+DEVELOPER=1
@@ -991,6 +991,7 @@ static struct convert_driver {
 	char *clean;
 	char *process;
 	int required;
+	int parallel;
 } *user_convert, **user_convert_tail;
 
 static int apply_filter(const char *path, const char *src, size_t len,
@@ -1074,6 +1075,11 @@ static int read_convert_config(const char *var, const char *value,
 		return 0;
 	}
 
+	if (!strcmp("parallel", key)) {
+		drv->parallel = git_config_bool(var, value);
+		return 0;
+	}
+
 	return 0;
 }
 
@@ -1316,18 +1322,23 @@ static int git_path_check_ident(struct attr_check_item *check)
 
 static struct attr_check *check;
 
+static void init_convert_attrs(void)
+{
+	if (check)
+		return;
+	check = attr_check_initl("crlf", "ident", "filter",
+				 "eol", "text", "working-tree-encoding",
+				 NULL);
+	user_convert_tail = &user_convert;
+	repo_config(the_repository, read_convert_config, NULL);
+}
+
 void convert_attrs(struct index_state *istate,
 		   struct conv_attrs *ca, const char *path)
 {
 	struct attr_check_item *ccheck = NULL;
 
-	if (!check) {
-		check = attr_check_initl("crlf", "ident", "filter",
-					 "eol", "text", "working-tree-encoding",
-					 NULL);
-		user_convert_tail = &user_convert;
-		repo_config(the_repository, read_convert_config, NULL);
-	}
+	init_convert_attrs();
 
 	git_check_attr(istate, path, check);
 	ccheck = check->items;
@@ -1361,6 +1372,25 @@ void convert_attrs(struct index_state *istate,
 		ca->crlf_action = CRLF_AUTO_INPUT;
 }
 
+const char *get_parallel_process_filter(const struct conv_attrs *ca)
+{
+	if (!ca->drv || !ca->drv->process || !ca->drv->parallel)
+		return NULL;
+	return ca->drv->name;
+}
+
+int set_conv_attrs_driver(struct conv_attrs *ca, const char *name)
+{
+	struct convert_driver *drv;
+
+	init_convert_attrs();
+	for (drv = user_convert; drv; drv = drv->next)
+		if (!strcmp(name, drv->name))
+			break;
+	ca->drv = drv;
+	return drv ? 0 : -1;
+}
+
 void reset_parsed_attributes(void)
 {
 	struct convert_driver *drv, *next;
@@ -91,6 +91,21 @@ struct conv_attrs {
 void convert_attrs(struct index_state *istate,
 		   struct conv_attrs *ca, const char *path);
 
+/*
+ * Return the name of the long-running process filter driver that `ca`
+ * uses if that driver is configured with "filter.<driver>.parallel",
+ * i.e. if several instances of it may run concurrently. Return NULL
+ * otherwise.
+ */
+const char *get_parallel_process_filter(const struct conv_attrs *ca);
+
+/*
+ * Make `ca` use the filter driver configured as "filter.<name>". This is
+ * meant for processes that receive conversion attributes without access
+ * to the attribute stack. Return -1 if no such driver is configured.
+ */
+int set_conv_attrs_driver(struct conv_attrs *ca, const char *name);
+
 extern enum eol core_eol;
 extern char *check_roundtrip_encoding;
 const char *get_cached_convert_stats_ascii(struct index_state *istate,
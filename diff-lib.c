@@ -25,6 +25,9 @@
 #include "dir.h"
 #include "fsmonitor.h"
 #include "commit-reach.h"
+#include "config.h"
+#include "string-list.h"
+#include "thread-utils.h"
 
 /*
  * diff-files
@@ -77,6 +80,38 @@ static int check_removed(const struct cache_entry *ce, struct stat *st)
 	return 0;
 }
 
+/*
+ * Like ie_match_stat(), but with the submodule configuration applied to
+ * a gitlink.  "*wants_status" tells whether the submodule also has to
+ * be asked if its work tree is dirty, and "*ignore_untracked" how.
+ */
+static int match_stat_submodule_config(struct diff_options *diffopt,
+				       const struct cache_entry *ce,
+				       struct stat *st, unsigned ce_option,
+				       int *wants_status,
+				       int *ignore_untracked)
+{
+	int changed = ie_match_stat(diffopt->repo->index, ce, st, ce_option);
+
+	*wants_status = 0;
+	if (S_ISGITLINK(ce->ce_mode)) {
+		struct diff_flags orig_flags = diffopt->flags;
+
+		if (!diffopt->flags.override_submodule_config)
+			set_diffopt_flags_from_submodule_config(diffopt, ce->name);
+		if (diffopt->flags.ignore_submodules)
+			changed = 0;
+		else if (!diffopt->flags.ignore_dirty_submodules &&
+			 (!changed || diffopt->flags.dirty_submodules)) {
+			*wants_status = 1;
+			*ignore_untracked =
+				diffopt->flags.ignore_untracked_in_submodules;
+		}
+		diffopt->flags = orig_flags;
+	}
+	return changed;
+}
+
 /*
  * Has a file changed or has a submodule new commits or a dirty work tree?
  *
@@ -88,24 +123,159 @@ static int check_removed(const struct cache_entry *ce, struct stat *st)
 static int match_stat_with_submodule(struct diff_options *diffopt,
 				     const struct cache_entry *ce,
 				     struct stat *st, unsigned ce_option,
-				     unsigned *dirty_submodule)
+				     unsigned *dirty_submodule,
+				     struct string_list *submodule_status)
 {
-	int changed = ie_match_stat(diffopt->repo->index, ce, st, ce_option);
-	if (S_ISGITLINK(ce->ce_mode)) {
-		struct diff_flags orig_flags = diffopt->flags;
-		if (!diffopt->flags.override_submodule_config)
-			set_diffopt_flags_from_submodule_config(diffopt, ce->name);
-		if (diffopt->flags.ignore_submodules)
-			changed = 0;
-		else if (!diffopt->flags.ignore_dirty_submodules &&
-			 (!changed || diffopt->flags.dirty_submodules))
+	int wants_status, ignore_untracked;
+	int changed = match_stat_submodule_config(diffopt, ce, st, ce_option,
+						  &wants_status,
+						  &ignore_untracked);
+
+	if (wants_status) {
+		struct string_list_item *item = NULL;
+
+		if (submodule_status)
+			item = string_list_lookup(submodule_status, ce->name);
+		if (item)
+			*dirty_submodule = ((struct submodule_status *)
+					    item->util)->dirty_submodule;
+		else
 			*dirty_submodule = is_submodule_modified(ce->name,
-								 diffopt->flags.ignore_untracked_in_submodules);
-		diffopt->flags = orig_flags;
+								 ignore_untracked);
 	}
 	return changed;
 }
 
+/*
+ * Is "ce" one of the paths run_diff_files() is asked about?
+ */
+static int diff_files_path_matches(struct rev_info *revs,
+				   const struct cache_entry *ce,
+				   char *ps_matched)
+{
+	/*
+	 * NEEDSWORK:
+	 * Here we filter with pathspec but the result is further
+	 * filtered out when --relative is in effect.  To end-users,
+	 * a pathspec element that matched only to paths outside the
+	 * current directory is like not matching anything at all;
+	 * the handling of ps_matched[] here may become problematic
+	 * if/when we add the "--error-unmatch" option to "git diff".
+	 */
+	if (!ce_path_match(revs->diffopt.repo->index, ce, &revs->prune_data,
+			   ps_matched))
+		return 0;
+
+	if (revs->diffopt.prefix &&
+	    strncmp(ce->name, revs->diffopt.prefix, revs->diffopt.prefix_length))
+		return 0;
+	return 1;
+}
+
+enum diff_files_worktree {
+	/* up to date, or not in the work tree by design */
+	DIFF_FILES_UPTODATE,
+	/* known not to be modified, without looking at the work tree */
+	DIFF_FILES_VALID,
+	DIFF_FILES_ERROR,
+	DIFF_FILES_REMOVED,
+	/* intent-to-add, and those are shown as new files */
+	DIFF_FILES_INTENT_TO_ADD,
+	/* there, and "st" describes it */
+	DIFF_FILES_PRESENT,
+};
+
+/*
+ * Find out how the work tree of "ce" has to be compared with the index.
+ */
+static enum diff_files_worktree diff_files_check_worktree(struct rev_info *revs,
+							  const struct cache_entry *ce,
+							  struct stat *st)
+{
+	int removed;
+
+	if (ce_uptodate(ce) || ce_skip_worktree(ce))
+		return DIFF_FILES_UPTODATE;
+
+	/*
+	 * When CE_VALID is set (via "update-index --assume-unchanged"
+	 * or via adding paths while core.ignorestat is set to true),
+	 * the user has promised that the working tree file for that
+	 * path will not be modified.  When CE_FSMONITOR_VALID is true,
+	 * the fsmonitor knows that the path hasn't been modified since
+	 * we refreshed the cached stat information.  In either case,
+	 * we do not have to stat to see if the path has been removed
+	 * or modified.
+	 */
+	if (ce->ce_flags & (CE_VALID | CE_FSMONITOR_VALID))
+		return DIFF_FILES_VALID;
+
+	removed = check_removed(ce, st);
+	if (removed < 0)
+		return DIFF_FILES_ERROR;
+	if (removed)
+		return DIFF_FILES_REMOVED;
+	if (revs->diffopt.ita_invisible_in_index && ce_intent_to_add(ce))
+		return DIFF_FILES_INTENT_TO_ADD;
+	return DIFF_FILES_PRESENT;
+}
+
+static int get_submodule_diff_jobs(struct repository *r)
+{
+	int jobs;
+
+	if (repo_config_get_int(r, "submodule.diffjobs", &jobs))
+		return 1;
+	if (jobs < 0)
+		die(_("negative values not allowed for submodule.diffJobs"));
+	if (!jobs)
+		jobs = online_cpus();
+	return jobs;
+}
+
+/*
+ * Find the submodules for which the loop in run_diff_files() will
+ * need is_submodule_modified(), and run "git status" in all of them
+ * in parallel up front.  Unmerged submodules are left for the loop to
+ * handle.
+ */
+static void prefetch_submodule_status(struct rev_info *revs,
+				      unsigned ce_option,
+				      struct string_list *submodule_status)
+{
+	struct diff_options *diffopt = &revs->diffopt;
+	struct index_state *istate = diffopt->repo->index;
+
+	for (int i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		struct submodule_status *status;
+		struct stat st;
+		int wants_status, ignore_untracked;
+
+		if (!S_ISGITLINK(ce->ce_mode) || ce_stage(ce) ||
+		    !diff_files_path_matches(revs, ce, NULL) ||
+		    diff_files_check_worktree(revs, ce, &st) != DIFF_FILES_PRESENT)
+			continue;
+
+		match_stat_submodule_config(diffopt, ce, &st, ce_option,
+					    &wants_status, &ignore_untracked);
+		if (!wants_status)
+			continue;
+		CALLOC_ARRAY(status, 1);
+		status->ignore_untracked = ignore_untracked;
+		string_list_append(submodule_status, ce->name)->util = status;
+	}
+
+	if (submodule_status->nr > 1) {
+		string_list_sort(submodule_status);
+		get_submodules_modified(submodule_status,
+					get_submodule_diff_jobs(diffopt->repo));
+	} else {
+		/* nothing to gain, let the loop do it */
+		string_list_clear(submodule_status, 1);
+	}
+}
+
 void run_diff_files(struct rev_info *revs, unsigned int option)
 {
 	int entries, i;
@@ -114,6 +284,7 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 			      ? CE_MATCH_RACY_IS_DIRTY : 0);
 	uint64_t start = getnanotime();
 	struct index_state *istate = revs->diffopt.repo->index;
+	struct string_list submodule_status = STRING_LIST_INIT_DUP;
 
 	if (revs->diffopt.max_depth_valid)
 		die(_("max-depth is not supported for worktree diffs"));
@@ -124,6 +295,9 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 
 	if (diff_unmerged_stage < 0)
 		diff_unmerged_stage = 2;
+	if (!revs->diffopt.flags.quick &&
+	    get_submodule_diff_jobs(revs->diffopt.repo) > 1)
+		prefetch_submodule_status(revs, ce_option, &submodule_status);
 	entries = istate->cache_nr;
 	for (i = 0; i < entries; i++) {
 		unsigned int oldmode, newmode;
@@ -131,24 +305,12 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 		int changed;
 		unsigned dirty_submodule = 0;
 		const struct object_id *old_oid, *new_oid;
+		struct stat st;
 
 		if (diff_can_quit_early(&revs->diffopt))
 			break;
 
-		/*
-		 * NEEDSWORK:
-		 * Here we filter with pathspec but the result is further
-		 * filtered out when --relative is in effect.  To end-users,
-		 * a pathspec element that matched only to paths outside the
-		 * current directory is like not matching anything at all;
-		 * the handling of ps_matched[] here may become problematic
-		 * if/when we add the "--error-unmatch" option to "git diff".
-		 */
-		if (!ce_path_match(istate, ce, &revs->prune_data, revs->ps_matched))
-			continue;
-
-		if (revs->diffopt.prefix &&
-		    strncmp(ce->name, revs->diffopt.prefix, revs->diffopt.prefix_length))
+		if (!diff_files_path_matches(revs, ce, revs->ps_matched))
 			continue;
 
 		if (ce_stage(ce)) {
@@ -156,7 +318,6 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 			struct diff_filepair *pair;
 			unsigned int wt_mode = 0;
 			int num_compare_stages = 0;
-			struct stat st;
 
 			changed = check_removed(ce, &st);
 			if (!changed)
@@ -226,47 +387,34 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 				continue;
 		}
 
-		if (ce_uptodate(ce) || ce_skip_worktree(ce))
+		switch (diff_files_check_worktree(revs, ce, &st)) {
+		case DIFF_FILES_UPTODATE:
 			continue;
-
-		/*
-		 * When CE_VALID is set (via "update-index --assume-unchanged"
-		 * or via adding paths while core.ignorestat is set to true),
-		 * the user has promised that the working tree file for that
-		 * path will not be modified.  When CE_FSMONITOR_VALID is true,
-		 * the fsmonitor knows that the path hasn't been modified since
-		 * we refreshed the cached stat information.  In either case,
-		 * we do not have to stat to see if the path has been removed
-		 * or modified.
-		 */
-		if (ce->ce_flags & (CE_VALID | CE_FSMONITOR_VALID)) {
+		case DIFF_FILES_VALID:
 			changed = 0;
 			newmode = ce->ce_mode;
-		} else {
-			struct stat st;
-
-			changed = check_removed(ce, &st);
-			if (changed) {
-				if (changed < 0) {
-					perror(ce->name);
-					continue;
-				}
-				diff_addremove(&revs->diffopt, '-', ce->ce_mode,
-					       &ce->oid,
-					       !is_null_oid(&ce->oid),
-					       ce->name, 0);
-				continue;
-			} else if (revs->diffopt.ita_invisible_in_index &&
-				   ce_intent_to_add(ce)) {
-				newmode = ce_mode_from_stat(ce, st.st_mode);
-				diff_addremove(&revs->diffopt, '+', newmode,
-					       null_oid(the_hash_algo), 0, ce->name, 0);
-				continue;
-			}
-
+			break;
+		case DIFF_FILES_ERROR:
+			perror(ce->name);
+			continue;
+		case DIFF_FILES_REMOVED:
+			diff_addremove(&revs->diffopt, '-', ce->ce_mode,
+				       &ce->oid,
+				       !is_null_oid(&ce->oid),
+				       ce->name, 0);
+			continue;
+		case DIFF_FILES_INTENT_TO_ADD:
+			newmode = ce_mode_from_stat(ce, st.st_mode);
+			diff_addremove(&revs->diffopt, '+', newmode,
+				       null_oid(the_hash_algo), 0, ce->name, 0);
+			continue;
+		case DIFF_FILES_PRESENT:
+		default:
 			changed = match_stat_with_submodule(&revs->diffopt, ce, &st,
-							    ce_option, &dirty_submodule);
+							    ce_option, &dirty_submodule,
+							    &submodule_status);
 			newmode = ce_mode_from_stat(ce, st.st_mode);
+			break;
 		}
 
 		if (!changed && !dirty_submodule) {
@@ -285,6 +433,7 @@ void run_diff_files(struct rev_info *revs, unsigned int option)
 			    ce->name, 0, dirty_submodule);
 
 	}
+	string_list_clear(&submodule_status, 1);
 	diffcore_std(&revs->diffopt);
 	diff_flush(&revs->diffopt);
 	trace_performance_since(start, "diff-files");
@@ -330,7 +479,7 @@ static int get_stat_data(const struct cache_entry *ce,
 			return -1;
 		}
 		changed = match_stat_with_submodule(diffopt, ce, &st,
-						    0, dirty_submodule);
+						    0, dirty_submodule, NULL);
 		if (changed) {
 			mode = ce_mode_from_stat(ce, st.st_mode);
 			oid = null_oid(the_hash_algo);
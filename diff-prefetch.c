@@ -0,0 +1,372 @@
+#include "git-compat-util.h"
+#include "diff-prefetch.h"
+#include "diff.h"
+#include "gettext.h"
+#include "odb.h"
+#include "oid-array.h"
+#include "oidmap.h"
+#include "pathspec.h"
+#include "promisor-remote.h"
+#include "repository.h"
+#include "repo-settings.h"
+#include "thread-utils.h"
+#include "trace2.h"
+
+struct prefetched_blob {
+	struct oidmap_entry entry;
+	void *data;
+	unsigned long size;
+	/* number of queued diffs this blob was read for */
+	unsigned refs;
+};
+
+struct prefetch_job {
+	struct object_id old_tree, new_tree;
+	unsigned has_old : 1,
+		 finished : 1,
+		 dropped : 1;
+	/* blobs this job holds a reference to */
+	struct oid_array blobs;
+	struct prefetch_job *next;
+};
+
+struct diff_prefetch {
+	struct repository *repo;
+	struct pathspec pathspec;
+	unsigned long big_file_threshold;
+
+	pthread_t *threads;
+	int nr_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stopping;
+
+	/*
+	 * Queued jobs from the oldest one not yet released by
+	 * diff_prefetch_done() to the newest one; "todo" is the first one
+	 * no worker has taken yet.
+	 */
+	struct prefetch_job *head, **tail, *todo;
+
+	struct oidmap blobs;
+	size_t bytes, max_bytes;
+	intmax_t hits;
+};
+
+static struct diff_prefetch *active_prefetch;
+
+/* Must be called with the mutex held. */
+static void release_job(struct diff_prefetch *p, struct prefetch_job *job)
+{
+	for (size_t i = 0; i < job->blobs.nr; i++) {
+		struct prefetched_blob *b = oidmap_get(&p->blobs,
+						       &job->blobs.oid[i]);
+
+		if (--b->refs)
+			continue;
+		oidmap_remove(&p->blobs, &b->entry.oid);
+		p->bytes -= b->size;
+		free(b->data);
+		free(b);
+	}
+	oid_array_clear(&job->blobs);
+	free(job);
+}
+
+static void collect_blob(struct diff_options *opt, unsigned mode,
+			 const struct object_id *oid)
+{
+	struct oid_array *wanted = opt->change_fn_data;
+
+	if (S_ISREG(mode) || S_ISLNK(mode))
+		oid_array_append(wanted, oid);
+}
+
+static void prefetch_addremove(struct diff_options *opt,
+			       int addremove UNUSED, unsigned mode,
+			       const struct object_id *oid,
+			       int oid_valid UNUSED,
+			       const char *fullpath UNUSED,
+			       unsigned dirty_submodule UNUSED)
+{
+	collect_blob(opt, mode, oid);
+}
+
+static void prefetch_change(struct diff_options *opt,
+			    unsigned old_mode, unsigned new_mode,
+			    const struct object_id *old_oid,
+			    const struct object_id *new_oid,
+			    int old_oid_valid UNUSED, int new_oid_valid UNUSED,
+			    const char *fullpath UNUSED,
+			    unsigned old_dirty_submodule UNUSED,
+			    unsigned new_dirty_submodule UNUSED)
+{
+	collect_blob(opt, old_mode, old_oid);
+	collect_blob(opt, new_mode, new_oid);
+}
+
+/*
+ * Read one blob for "job" unless it is already held, is too big to be
+ * worth keeping, or would not fit. Return -1 when the job has been
+ * dropped in the meantime and the worker should move on.
+ */
+static int prefetch_blob(struct diff_prefetch *p, struct prefetch_job *job,
+			 const struct object_id *oid)
+{
+	struct prefetched_blob *b;
+	struct object_info info = OBJECT_INFO_INIT;
+	unsigned long size;
+	void *data;
+	unsigned flags = OBJECT_INFO_LOOKUP_REPLACE |
+			 OBJECT_INFO_SKIP_FETCH_OBJECT;
+
+	pthread_mutex_lock(&p->mutex);
+	if (job->dropped || p->stopping)
+		goto dropped;
+	b = oidmap_get(&p->blobs, oid);
+	if (b) {
+		b->refs++;
+		oid_array_append(&job->blobs, oid);
+	}
+	pthread_mutex_unlock(&p->mutex);
+	if (b)
+		return 0;
+
+	/*
+	 * Leave missing objects to the diff machinery, which knows how to
+	 * report or fetch them, and big ones, which it may not read at all.
+	 * Have the missing ones fetched in the background meanwhile, though.
+	 */
+	info.sizep = &size;
+	if (odb_read_object_info_extended(p->repo->objects, oid, &info, flags)) {
+		promisor_remote_queue(p->repo, oid);
+		return 0;
+	}
+	if (size > p->big_file_threshold)
+		return 0;
+
+	pthread_mutex_lock(&p->mutex);
+	if (p->bytes + size > p->max_bytes) {
+		pthread_mutex_unlock(&p->mutex);
+		return 0;
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	info.contentp = &data;
+	if (odb_read_object_info_extended(p->repo->objects, oid, &info, flags))
+		return 0;
+
+	pthread_mutex_lock(&p->mutex);
+	if (job->dropped || p->stopping) {
+		free(data);
+		goto dropped;
+	}
+	b = oidmap_get(&p->blobs, oid);
+	if (b) {
+		/* another worker read it first */
+		free(data);
+		b->refs++;
+	} else if (p->bytes + size <= p->max_bytes) {
+		CALLOC_ARRAY(b, 1);
+		oidcpy(&b->entry.oid, oid);
+		b->data = data;
+		b->size = size;
+		b->refs = 1;
+		oidmap_put(&p->blobs, b);
+		p->bytes += size;
+	} else {
+		free(data);
+		pthread_mutex_unlock(&p->mutex);
+		return 0;
+	}
+	oid_array_append(&job->blobs, oid);
+	pthread_mutex_unlock(&p->mutex);
+	return 0;
+
+dropped:
+	pthread_mutex_unlock(&p->mutex);
+	return -1;
+}
+
+static void *prefetch_thread(void *data)
+{
+	struct diff_prefetch *p = data;
+
+	while (1) {
+		struct oid_array wanted = OID_ARRAY_INIT;
+		struct diff_options diffopt;
+		struct prefetch_job *job;
+
+		pthread_mutex_lock(&p->mutex);
+		while (!p->todo && !p->stopping)
+			pthread_cond_wait(&p->cond, &p->mutex);
+		if (p->stopping) {
+			pthread_mutex_unlock(&p->mutex);
+			break;
+		}
+		job = p->todo;
+		p->todo = job->next;
+
+		repo_diff_setup(p->repo, &diffopt);
+		diffopt.flags.recursive = 1;
+		copy_pathspec(&diffopt.pathspec, &p->pathspec);
+		diffopt.add_remove = prefetch_addremove;
+		diffopt.change = prefetch_change;
+		diffopt.change_fn_data = &wanted;
+		diff_setup_done(&diffopt);
+		pthread_mutex_unlock(&p->mutex);
+
+		diff_tree_oid(job->has_old ? &job->old_tree : NULL,
+			      &job->new_tree, "", &diffopt);
+		diff_free(&diffopt);
+
+		for (size_t i = 0; i < wanted.nr; i++)
+			if (prefetch_blob(p, job, &wanted.oid[i]))
+				break;
+		oid_array_clear(&wanted);
+
+		pthread_mutex_lock(&p->mutex);
+		job->finished = 1;
+		if (job->dropped)
+			release_job(p, job);
+		pthread_mutex_unlock(&p->mutex);
+	}
+
+	return NULL;
+}
+
+struct diff_prefetch *diff_prefetch_start(struct repository *r,
+					  const struct pathspec *pathspec,
+					  int nr_threads, size_t max_bytes)
+{
+	struct diff_prefetch *p;
+
+	if (active_prefetch)
+		BUG("only one diff prefetcher may run at a time");
+
+	CALLOC_ARRAY(p, 1);
+	p->repo = r;
+	if (pathspec)
+		copy_pathspec(&p->pathspec, pathspec);
+	p->big_file_threshold = repo_settings_get_big_file_threshold(r);
+	p->max_bytes = max_bytes;
+	p->tail = &p->head;
+	oidmap_init(&p->blobs, 0);
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+
+	enable_obj_read_lock();
+	promisor_remote_start_batching(r);
+	p->nr_threads = nr_threads;
+	CALLOC_ARRAY(p->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&p->threads[i], NULL,
+					 prefetch_thread, p);
+		if (err)
+			die(_("unable to create diff prefetch thread: %s"),
+			    strerror(err));
+	}
+
+	active_prefetch = p;
+	return p;
+}
+
+void diff_prefetch_add(struct diff_prefetch *p,
+		       const struct object_id *old_tree,
+		       const struct object_id *new_tree)
+{
+	struct prefetch_job *job;
+
+	CALLOC_ARRAY(job, 1);
+	if (old_tree) {
+		oidcpy(&job->old_tree, old_tree);
+		job->has_old = 1;
+	}
+	oidcpy(&job->new_tree, new_tree);
+
+	pthread_mutex_lock(&p->mutex);
+	*p->tail = job;
+	p->tail = &job->next;
+	if (!p->todo)
+		p->todo = job;
+	pthread_cond_signal(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+}
+
+void diff_prefetch_done(struct diff_prefetch *p)
+{
+	struct prefetch_job *job;
+
+	pthread_mutex_lock(&p->mutex);
+	job = p->head;
+	if (!job)
+		BUG("diff_prefetch_done() without a queued diff");
+	p->head = job->next;
+	if (!p->head)
+		p->tail = &p->head;
+
+	if (p->todo == job) {
+		/* never started, it is ours to free */
+		p->todo = job->next;
+		release_job(p, job);
+	} else if (job->finished) {
+		release_job(p, job);
+	} else {
+		/* its worker releases it once it notices */
+		job->dropped = 1;
+	}
+	pthread_mutex_unlock(&p->mutex);
+}
+
+void diff_prefetch_stop(struct diff_prefetch *p)
+{
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->stopping = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+
+	for (int i = 0; i < p->nr_threads; i++)
+		pthread_join(p->threads[i], NULL);
+	free(p->threads);
+	promisor_remote_stop_batching();
+	disable_obj_read_lock();
+	active_prefetch = NULL;
+
+	while (p->head) {
+		struct prefetch_job *job = p->head;
+		p->head = job->next;
+		release_job(p, job);
+	}
+	trace2_data_intmax("diff", p->repo, "prefetch/hits", p->hits);
+
+	oidmap_clear(&p->blobs, 1);
+	clear_pathspec(&p->pathspec);
+	pthread_cond_destroy(&p->cond);
+	pthread_mutex_destroy(&p->mutex);
+	free(p);
+}
+
+int diff_prefetch_get(const struct object_id *oid, unsigned long *size,
+		      void **data)
+{
+	struct diff_prefetch *p = active_prefetch;
+	struct prefetched_blob *b;
+
+	if (!p)
+		return -1;
+
+	pthread_mutex_lock(&p->mutex);
+	b = oidmap_get(&p->blobs, oid);
+	if (b) {
+		*size = b->size;
+		if (data)
+			*data = xmemdupz(b->data, b->size);
+		p->hits++;
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return b ? 0 : -1;
+}
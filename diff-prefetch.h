@@ -0,0 +1,54 @@
+#ifndef DIFF_PREFETCH_H
+#define DIFF_PREFETCH_H
+
+/*
+ * diff-prefetch - read the blobs of upcoming tree diffs on worker
+ * threads, so that a command showing a series of diffs (e.g. "git log
+ * -p") finds them in memory when it gets to them.
+ *
+ * The diffs are queued with diff_prefetch_add() in the order they will
+ * be shown and released with diff_prefetch_done() in that same order.
+ * The caller does not wait for the workers: diff_populate_filespec()
+ * takes a blob from the prefetcher when it has already been read and
+ * reads it itself otherwise, so the output is the same either way.
+ */
+
+struct diff_prefetch;
+struct object_id;
+struct pathspec;
+struct repository;
+
+/*
+ * Start "nr_threads" threads reading the blobs changed by the queued
+ * diffs, limited to "pathspec" (which may be NULL), and keeping at most
+ * "max_bytes" of blob data in memory. Only one prefetcher may run at a
+ * time.
+ */
+struct diff_prefetch *diff_prefetch_start(struct repository *r,
+					  const struct pathspec *pathspec,
+					  int nr_threads, size_t max_bytes);
+
+/*
+ * Queue the diff between the trees "old_tree" (NULL for the empty tree)
+ * and "new_tree".
+ */
+void diff_prefetch_add(struct diff_prefetch *p,
+		       const struct object_id *old_tree,
+		       const struct object_id *new_tree);
+
+/* Release the blobs of the oldest queued diff, once it has been shown. */
+void diff_prefetch_done(struct diff_prefetch *p);
+
+/* Stop the threads and release everything still held. */
+void diff_prefetch_stop(struct diff_prefetch *p);
+
+/*
+ * Look up a blob read ahead of time by the running prefetcher. On a hit,
+ * store its size in "size" and, when "data" is not NULL, a copy of its
+ * contents the caller must free in "data", and return 0. Return -1 when
+ * the blob is not available.
+ */
+int diff_prefetch_get(const struct object_id *oid, unsigned long *size,
+		      void **data);
+
+#endif
@@ -16,6 +16,7 @@
 #include "revision.h"
 #include "quote.h"
 #include "diff.h"
+#include "diff-prefetch.h"
 #include "diffcore.h"
 #include "delta.h"
 #include "hex.h"
@@ -4238,6 +4239,13 @@ int diff_populate_filespec(struct repository *r,
 			.sizep = &s->size
 		};
 
+		if (!diff_prefetch_get(&s->oid, &s->size,
+				       size_only ? NULL : &s->data)) {
+			if (!size_only)
+				s->should_free = 1;
+			return 0;
+		}
+
 		if (!(size_only || check_binary))
 			/*
 			 * Set contentp, since there is no chance that merely
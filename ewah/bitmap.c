@@ -18,6 +18,7 @@
  */
 #include "git-compat-util.h"
 #include "ewok.h"
+#include "ewok_rlw.h"
 
 #define EWAH_MASK(x) ((eword_t)1 << (x % BITS_IN_EWORD))
 #define EWAH_BLOCK(x) (x / BITS_IN_EWORD)
@@ -100,18 +101,63 @@ struct ewah_bitmap *bitmap_to_ewah(struct bitmap *bitmap)
 	return ewah;
 }
 
-struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
+/*
+ * A marker word of an EWAH bitmap and the literal words following it:
+ * `len` words that are all zeroes or all ones (according to `bit`),
+ * then `nr_literals` verbatim words.
+ */
+struct ewah_run {
+	int bit;
+	size_t len;
+	size_t nr_literals;
+	const eword_t *literals;
+};
+
+/*
+ * Read the run starting at `*pointer` in the buffer of `ewah` and
+ * advance `*pointer` past it. Return 0 at the end of the buffer.
+ *
+ * Working a run at a time rather than a word at a time, like
+ * ewah_iterator_next() does, lets the callers skip runs of zeroes
+ * outright and process the literal words in tight loops.
+ */
+static int next_ewah_run(const struct ewah_bitmap *ewah, size_t *pointer,
+			 struct ewah_run *run)
 {
-	struct bitmap *bitmap = bitmap_new();
-	struct ewah_iterator it;
-	eword_t blowup;
-	size_t i = 0;
+	const eword_t *rlw;
+	size_t remaining;
+
+	if (*pointer >= ewah->buffer_size)
+		return 0;
+
+	rlw = &ewah->buffer[*pointer];
+	remaining = ewah->buffer_size - *pointer - 1;
 
-	ewah_iterator_init(&it, ewah);
+	run->bit = rlw_get_run_bit(rlw);
+	run->len = rlw_get_running_len(rlw);
+	run->nr_literals = rlw_get_literal_words(rlw);
+	if (run->nr_literals > remaining)
+		run->nr_literals = remaining;
+	run->literals = rlw + 1;
+
+	*pointer += run->nr_literals + 1;
+	return 1;
+}
 
-	while (ewah_iterator_next(&blowup, &it)) {
-		ALLOC_GROW(bitmap->words, i + 1, bitmap->word_alloc);
-		bitmap->words[i++] = blowup;
+struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
+{
+	struct bitmap *bitmap = bitmap_new();
+	struct ewah_run run;
+	size_t pointer = 0, i = 0;
+
+	while (next_ewah_run(ewah, &pointer, &run)) {
+		ALLOC_GROW(bitmap->words, i + run.len + run.nr_literals,
+			   bitmap->word_alloc);
+		memset(bitmap->words + i, run.bit ? 0xff : 0x0,
+		       run.len * sizeof(eword_t));
+		i += run.len;
+		COPY_ARRAY(bitmap->words + i, run.literals, run.nr_literals);
+		i += run.nr_literals;
 	}
 
 	bitmap->word_alloc = i;
@@ -181,13 +227,30 @@ int ewah_bitmap_is_subset(struct ewah_bitmap *self, struct bitmap *other)
 	return 1;
 }
 
+int ewah_bitmap_intersects(struct ewah_bitmap *self, struct bitmap *other)
+{
+	struct ewah_iterator it;
+	eword_t word;
+	size_t i;
+
+	ewah_iterator_init(&it, self);
+
+	for (i = 0; i < other->word_alloc; i++) {
+		if (!ewah_iterator_next(&word, &it))
+			break;
+		if (word & other->words[i])
+			return 1;
+	}
+
+	return 0;
+}
+
 void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 {
 	size_t original_size = self->word_alloc;
 	size_t other_final = (other->bit_size / BITS_IN_EWORD) + 1;
-	size_t i = 0;
-	struct ewah_iterator it;
-	eword_t word;
+	size_t pointer = 0, i = 0, j;
+	struct ewah_run run;
 
 	if (self->word_alloc < other_final) {
 		self->word_alloc = other_final;
@@ -196,10 +259,18 @@ void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 			(self->word_alloc - original_size) * sizeof(eword_t));
 	}
 
-	ewah_iterator_init(&it, other);
+	while (next_ewah_run(other, &pointer, &run)) {
+		if (self->word_alloc < i + run.len + run.nr_literals)
+			bitmap_grow(self, i + run.len + run.nr_literals);
 
-	while (ewah_iterator_next(&word, &it))
-		self->words[i++] |= word;
+		if (run.bit)
+			memset(self->words + i, 0xff, run.len * sizeof(eword_t));
+		i += run.len;
+
+		for (j = 0; j < run.nr_literals; j++)
+			self->words[i + j] |= run.literals[j];
+		i += run.nr_literals;
+	}
 }
 
 size_t bitmap_popcount(struct bitmap *self)
@@ -214,14 +285,15 @@ size_t bitmap_popcount(struct bitmap *self)
 
 size_t ewah_bitmap_popcount(struct ewah_bitmap *self)
 {
-	struct ewah_iterator it;
-	eword_t word;
-	size_t count = 0;
-
-	ewah_iterator_init(&it, self);
-
-	while (ewah_iterator_next(&word, &it))
-		count += ewah_bit_popcount64(word);
+	struct ewah_run run;
+	size_t pointer = 0, count = 0, j;
+
+	while (next_ewah_run(self, &pointer, &run)) {
+		if (run.bit)
+			count += run.len * BITS_IN_EWORD;
+		for (j = 0; j < run.nr_literals; j++)
+			count += ewah_bit_popcount64(run.literals[j]);
+	}
 
 	return count;
 }
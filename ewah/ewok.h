@@ -200,6 +200,12 @@ int bitmap_equals_ewah(struct bitmap *self, struct ewah_bitmap *other);
 int bitmap_is_subset(struct bitmap *self, struct bitmap *other);
 int ewah_bitmap_is_subset(struct ewah_bitmap *self, struct bitmap *other);
 
+/*
+ * Returns 1 if 'self' and 'other' have at least one bit in common, 0
+ * otherwise.
+ */
+int ewah_bitmap_intersects(struct ewah_bitmap *self, struct bitmap *other);
+
 struct ewah_bitmap * bitmap_to_ewah(struct bitmap *bitmap);
 struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah);
 
@@ -19,6 +19,7 @@ void fetch_negotiator_init(struct repository *r,
 		return;
 
 	case FETCH_NEGOTIATION_CONSECUTIVE:
+	case FETCH_NEGOTIATION_SKETCH:
 		default_negotiator_init(negotiator);
 		return;
 	}
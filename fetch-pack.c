@@ -32,6 +32,7 @@
 #include "shallow.h"
 #include "commit-reach.h"
 #include "commit-graph.h"
+#include "commit-sketch.h"
 #include "sigchain.h"
 #include "mergesort.h"
 #include "prio-queue.h"
@@ -998,6 +999,12 @@ static int get_pack(struct fetch_pack_args *args,
 			 * it is missing).
 			 */
 			strvec_push(&cmd.args, "--promisor");
+		if (!index_pack_args && args->stream_checkout) {
+			strvec_pushf(&cmd.args, "--stream-checkout=%s",
+				     oid_to_hex(args->stream_checkout));
+			strvec_pushf(&cmd.args, "--stream-checkout-dir=%s",
+				     args->stream_checkout_dir);
+		}
 	}
 	else {
 		cmd_name = "unpack-objects";
@@ -1322,6 +1329,106 @@ static int add_haves(struct fetch_negotiator *negotiator,
 	return haves_added;
 }
 
+/*
+ * The sketch starts this long before the newest commit we got from a
+ * remote, so that the commits we last had in common with the server fall
+ * inside it.
+ */
+#define SKETCH_SLACK (24 * 60 * 60)
+
+/* Look at most this far back to guess how much the server has moved on. */
+#define SKETCH_MAX_SAMPLE (90 * 24 * 60 * 60)
+
+struct sketch_tips {
+	struct commit_list *list;
+	timestamp_t newest, newest_remote;
+};
+
+static void add_sketch_tip(struct sketch_tips *tips, const char *refname,
+			   const struct object_id *oid)
+{
+	struct commit *c = deref_without_lazy_fetch(oid, 0);
+
+	if (!c || repo_parse_commit(the_repository, c))
+		return;
+	commit_list_insert(c, &tips->list);
+	if (c->date > tips->newest)
+		tips->newest = c->date;
+	if (refname && starts_with(refname, "refs/remotes/") &&
+	    c->date > tips->newest_remote)
+		tips->newest_remote = c->date;
+}
+
+static int add_sketch_tip_oid(const char *refname,
+			      const char *referent UNUSED,
+			      const struct object_id *oid,
+			      int flag UNUSED,
+			      void *cb_data)
+{
+	add_sketch_tip(cb_data, refname, oid);
+	return 0;
+}
+
+/*
+ * Send a sketch of our recent commits, from which the server can tell
+ * in this one round which of its commits we have, as long as the two sides
+ * do not differ by more commits than the sketch was sized for. Most of the
+ * difference is usually what was pushed upstream since we last fetched,
+ * which we guess from how many commits we have from a period as long
+ * before that.
+ */
+static void add_sketch(struct fetch_pack_args *args, struct strbuf *req_buf)
+{
+	struct sketch_tips tips = { 0 };
+	struct oidset recent = OIDSET_INIT, sample = OIDSET_INIT;
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	struct commit_sketch sketch;
+	timestamp_t anchor, since, elapsed, now = time(NULL);
+	size_t cells;
+
+	if (args->negotiation_tips) {
+		for (size_t i = 0; i < args->negotiation_tips->nr; i++)
+			add_sketch_tip(&tips, NULL,
+				       &args->negotiation_tips->oid[i]);
+	} else {
+		refs_for_each_rawref(get_main_ref_store(the_repository),
+				     add_sketch_tip_oid, &tips);
+	}
+	if (!tips.list)
+		return;
+
+	anchor = tips.newest_remote ? tips.newest_remote : tips.newest;
+	since = anchor > SKETCH_SLACK ? anchor - SKETCH_SLACK : 0;
+	elapsed = now > anchor ? now - anchor : 0;
+	if (elapsed > SKETCH_MAX_SAMPLE)
+		elapsed = SKETCH_MAX_SAMPLE;
+
+	commit_sketch_collect(the_repository, tips.list, since, &recent);
+	commit_sketch_collect(the_repository, tips.list,
+			      since > elapsed ? since - elapsed : 0, &sample);
+	cells = commit_sketch_cells_for(oidset_size(&sample));
+	trace2_data_intmax("negotiation_v2", the_repository, "sketch_cells",
+			   cells);
+	if (cells > COMMIT_SKETCH_MAX_CELLS)
+		goto out;
+
+	commit_sketch_init(&sketch, the_hash_algo, cells);
+	oidset_iter_init(&recent, &iter);
+	while ((oid = oidset_iter_next(&iter)))
+		commit_sketch_add(&sketch, oid);
+
+	packet_buf_write(req_buf, "sketch %"PRItime" %"PRIuMAX"\n",
+			 since, (uintmax_t)cells);
+	commit_sketch_write(&sketch, req_buf);
+	commit_sketch_release(&sketch);
+
+out:
+	oidset_clear(&recent);
+	oidset_clear(&sample);
+	free_commit_list(tips.list);
+}
+
 static void write_fetch_command_and_capabilities(struct strbuf *req_buf,
 						 const struct string_list *server_options)
 {
@@ -1358,7 +1465,7 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 			      struct fetch_pack_args *args,
 			      const struct ref *wants, struct oidset *common,
 			      int *haves_to_send, int *in_vain,
-			      int sideband_all, int seen_ack)
+			      int sideband_all, int seen_ack, int sketch)
 {
 	int haves_added;
 	int done_sent = 0;
@@ -1421,6 +1528,8 @@ static int send_fetch_request(struct fetch_negotiator *negotiator, int fd_out,
 		/* Send Done */
 		packet_buf_write(&req_buf, "done\n");
 		done_sent = 1;
+	} else if (sketch) {
+		add_sketch(args, &req_buf);
 	}
 
 	/* Send request */
@@ -1464,7 +1573,7 @@ static int process_section_header(struct packet_reader *reader,
 static int process_ack(struct fetch_negotiator *negotiator,
 		       struct packet_reader *reader,
 		       struct object_id *common_oid,
-		       int *received_ready)
+		       int *received_ready, int verify)
 {
 	while (packet_reader_read(reader) == PACKET_READ_NORMAL) {
 		const char *arg;
@@ -1475,6 +1584,16 @@ static int process_ack(struct fetch_negotiator *negotiator,
 		if (skip_prefix(reader->line, "ACK ", &arg)) {
 			if (!get_oid_hex(arg, common_oid)) {
 				struct commit *commit;
+
+				/*
+				 * Commits acknowledged from a sketch were not
+				 * named by us; the pack will not contain them.
+				 */
+				if (verify &&
+				    !odb_has_object(the_repository->objects,
+						    common_oid, 0))
+					die(_("server acknowledged %s, which we do not have"),
+					    oid_to_hex(common_oid));
 				commit = lookup_commit(the_repository, common_oid);
 				if (negotiator)
 					negotiator->ack(negotiator, commit);
@@ -1666,6 +1785,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 	int seen_ack = 0;
 	struct object_id common_oid;
 	int received_ready = 0;
+	int use_sketch = 0, sketch_sent = 0;
 	struct string_list packfile_uris = STRING_LIST_INIT_DUP;
 	int i;
 	struct strvec index_pack_args = STRVEC_INIT;
@@ -1708,6 +1828,11 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			mark_tips(negotiator, args->negotiation_tips);
 			for_each_cached_alternate(negotiator,
 						  insert_one_alternate_object);
+
+			use_sketch = !args->refetch && !args->deepen &&
+				r->settings.fetch_negotiation_algorithm == FETCH_NEGOTIATION_SKETCH &&
+				server_supports_feature("fetch", "sketch", 0) &&
+				!is_repository_shallow(r);
 			break;
 		case FETCH_SEND_REQUEST:
 			if (!negotiation_started) {
@@ -1724,7 +1849,7 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 					       &common,
 					       &haves_to_send, &in_vain,
 					       reader.use_sideband,
-					       seen_ack)) {
+					       seen_ack, use_sketch)) {
 				trace2_region_leave_printf("negotiation_v2", "round",
 							   the_repository, "%d",
 							   negotiation_round);
@@ -1732,12 +1857,14 @@ static struct ref *do_fetch_pack_v2(struct fetch_pack_args *args,
 			}
 			else
 				state = FETCH_PROCESS_ACKS;
+			sketch_sent |= use_sketch;
+			use_sketch = 0;
 			break;
 		case FETCH_PROCESS_ACKS:
 			/* Process ACKs/NAKs */
 			process_section_header(&reader, "acknowledgments", 0);
 			while (process_ack(negotiator, &reader, &common_oid,
-					   &received_ready)) {
+					   &received_ready, sketch_sent)) {
 				in_vain = 0;
 				seen_ack = 1;
 				oidset_insert(&common, &common_oid);
@@ -2215,7 +2342,7 @@ void negotiate_using_fetch(const struct oid_array *negotiation_tips,
 		/* Process ACKs/NAKs */
 		process_section_header(&reader, "acknowledgments", 0);
 		while (process_ack(&negotiator, &reader, &common_oid,
-				   &received_ready)) {
+				   &received_ready, 0)) {
 			struct commit *commit = lookup_commit(the_repository,
 							      &common_oid);
 			if (commit) {
@@ -23,6 +23,13 @@ struct fetch_pack_args {
 	 */
 	const struct oid_array *negotiation_tips;
 
+	/*
+	 * If not NULL, have index-pack write the files of this commit to
+	 * stream_checkout_dir as they come in; see checkout-stream.h.
+	 */
+	const struct object_id *stream_checkout;
+	const char *stream_checkout_dir;
+
 	unsigned deepen_relative:1;
 	unsigned quiet:1;
 	unsigned keep_pack:1;
@@ -16,7 +16,13 @@
 #include "packfile.h"
 #include "odb.h"
 #include "trace.h"
+#include "trace2.h"
 #include "environment.h"
+#include "config.h"
+#include "oid-array.h"
+#include "oidmap.h"
+#include "oidset.h"
+#include "thread-utils.h"
 
 struct traversal_context {
 	struct rev_info *revs;
@@ -24,6 +30,7 @@ struct traversal_context {
 	show_commit_fn show_commit;
 	void *show_data;
 	struct filter *filter;
+	struct tree_prefetch *prefetch;
 	int depth;
 };
 
@@ -48,6 +55,270 @@ static void show_object(struct traversal_context *ctx,
 	ctx->show_object(object, name, ctx->show_data);
 }
 
+/*
+ * With core.objectWalkThreads, the trees of the final walk over the
+ * pending objects are read ahead of process_tree() on worker threads.
+ * The walk itself stays on the main thread, which owns the objects and
+ * their flags, so the objects are shown in the same order as before.
+ *
+ * Whenever process_tree() needs a tree that has not been read yet, the
+ * workers are woken up to read the queued trees, depth-first from the
+ * top of the stack where the missing tree is pushed, until the stack is
+ * empty or TREE_PREFETCH_MAX_BYTES of tree data are waiting to be used.
+ * The main thread waits for them meanwhile, so the object store is
+ * never used by both at the same time.
+ */
+#define TREE_PREFETCH_MAX_BYTES (32 * 1024 * 1024)
+
+struct tree_prefetch_entry {
+	struct oidmap_entry entry;
+	void *buffer;
+	unsigned long size;
+	/* taken off the stack by a worker */
+	unsigned read : 1;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	/* trees the walk will not enter */
+	struct oidset skip;
+	/* every tree queued so far */
+	struct oidmap trees;
+	struct object_id *stack;
+	size_t stack_nr, stack_alloc;
+	size_t bytes;
+
+	pthread_t *threads;
+	int nr_threads;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int busy, running, exiting;
+	intmax_t nr_phases, nr_misses;
+};
+
+/* Must be called with the mutex held, or with no worker running. */
+static void tree_prefetch_push(struct tree_prefetch *p,
+			       const struct object_id *oid)
+{
+	struct tree_prefetch_entry *e = oidmap_get(&p->trees, oid);
+
+	if (!e) {
+		if (oidset_contains(&p->skip, oid))
+			return;
+		CALLOC_ARRAY(e, 1);
+		oidcpy(&e->entry.oid, oid);
+		oidmap_put(&p->trees, e);
+	} else if (e->read) {
+		return;
+	}
+	ALLOC_GROW(p->stack, p->stack_nr + 1, p->stack_alloc);
+	oidcpy(&p->stack[p->stack_nr++], oid);
+}
+
+static void tree_prefetch_read(struct tree_prefetch *p,
+			       struct tree_prefetch_entry *e)
+{
+	struct object_info oi = OBJECT_INFO_INIT;
+	struct oid_array subtrees = OID_ARRAY_INIT;
+	enum object_type type;
+	unsigned long size;
+	void *buffer;
+	struct tree_desc desc;
+	struct name_entry entry;
+
+	oi.typep = &type;
+	oi.sizep = &size;
+	oi.contentp = &buffer;
+	if (odb_read_object_info_extended(p->repo->objects, &e->entry.oid, &oi,
+					  OBJECT_INFO_LOOKUP_REPLACE |
+					  OBJECT_INFO_SKIP_FETCH_OBJECT))
+		buffer = NULL;
+	else if (type != OBJ_TREE)
+		FREE_AND_NULL(buffer);
+
+	/* leave the errors for process_tree() to report */
+	if (buffer &&
+	    !init_tree_desc_gently(&desc, &e->entry.oid, buffer, size, 0)) {
+		while (tree_entry_gently(&desc, &entry))
+			if (S_ISDIR(entry.mode))
+				oid_array_append(&subtrees, &entry.oid);
+	}
+
+	pthread_mutex_lock(&p->mutex);
+	if (buffer) {
+		e->buffer = buffer;
+		e->size = size;
+		p->bytes += size;
+	}
+	/* push them backwards so that the first one is read first */
+	for (size_t i = subtrees.nr; i; i--)
+		tree_prefetch_push(p, &subtrees.oid[i - 1]);
+	pthread_mutex_unlock(&p->mutex);
+
+	oid_array_clear(&subtrees);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *p = data;
+
+	pthread_mutex_lock(&p->mutex);
+	while (!p->exiting) {
+		struct tree_prefetch_entry *e;
+
+		if (!p->running || !p->stack_nr ||
+		    p->bytes >= TREE_PREFETCH_MAX_BYTES) {
+			if (p->running && !p->busy) {
+				p->running = 0;
+				pthread_cond_broadcast(&p->cond);
+			}
+			pthread_cond_wait(&p->cond, &p->mutex);
+			continue;
+		}
+
+		e = oidmap_get(&p->trees, &p->stack[--p->stack_nr]);
+		if (e->read)
+			continue;
+		e->read = 1;
+		p->busy++;
+		pthread_mutex_unlock(&p->mutex);
+
+		tree_prefetch_read(p, e);
+
+		pthread_mutex_lock(&p->mutex);
+		p->busy--;
+		pthread_cond_broadcast(&p->cond);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	return NULL;
+}
+
+static struct tree_prefetch *tree_prefetch_start(struct rev_info *revs)
+{
+	struct tree_prefetch *p;
+	int nr_threads = 1;
+	unsigned int nr_objects;
+
+	repo_config_get_int(revs->repo, "core.objectwalkthreads", &nr_threads);
+	if (nr_threads < 1)
+		nr_threads = online_cpus();
+	if (!HAVE_THREADS || nr_threads == 1)
+		return NULL;
+
+	/*
+	 * Filters, pathspecs and include checks decide on the fly which
+	 * trees are entered; leave those walks alone.
+	 */
+	if (!revs->tree_objects || revs->filter.choice ||
+	    revs->diffopt.pathspec.nr || revs->include_check_obj)
+		return NULL;
+
+	CALLOC_ARRAY(p, 1);
+	p->repo = revs->repo;
+	oidset_init(&p->skip, 0);
+	oidmap_init(&p->trees, 0);
+
+	nr_objects = get_max_object_index(revs->repo);
+	for (unsigned int i = 0; i < nr_objects; i++) {
+		struct object *obj = get_indexed_object(revs->repo, i);
+
+		if (obj && obj->type == OBJ_TREE &&
+		    obj->flags & (UNINTERESTING | SEEN))
+			oidset_insert(&p->skip, &obj->oid);
+	}
+
+	for (size_t i = revs->pending.nr; i; i--) {
+		struct object *obj = revs->pending.objects[i - 1].item;
+
+		if (obj->type == OBJ_TREE)
+			tree_prefetch_push(p, &obj->oid);
+	}
+
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->cond, NULL);
+	enable_obj_read_lock();
+
+	p->nr_threads = nr_threads;
+	CALLOC_ARRAY(p->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&p->threads[i], NULL,
+					 tree_prefetch_thread, p);
+		if (err)
+			die(_("unable to create tree prefetch thread: %s"),
+			    strerror(err));
+	}
+
+	return p;
+}
+
+/*
+ * Hand over the contents of the tree "oid", reading it and the trees
+ * queued after it first if needed. Return NULL when the tree could not
+ * be read, for the caller to read it itself.
+ */
+static void *tree_prefetch_take(struct tree_prefetch *p,
+				const struct object_id *oid,
+				unsigned long *size)
+{
+	struct tree_prefetch_entry *e;
+	void *buffer;
+
+	pthread_mutex_lock(&p->mutex);
+	tree_prefetch_push(p, oid);
+	e = oidmap_get(&p->trees, oid);
+	if (e && !e->read && p->bytes < TREE_PREFETCH_MAX_BYTES) {
+		p->running = 1;
+		p->nr_phases++;
+		pthread_cond_broadcast(&p->cond);
+		while (p->running)
+			pthread_cond_wait(&p->cond, &p->mutex);
+	}
+	pthread_mutex_unlock(&p->mutex);
+
+	if (!e || !e->buffer) {
+		p->nr_misses++;
+		return NULL;
+	}
+	buffer = e->buffer;
+	*size = e->size;
+	e->buffer = NULL;
+	p->bytes -= e->size;
+	return buffer;
+}
+
+static void tree_prefetch_stop(struct tree_prefetch *p)
+{
+	struct oidmap_iter iter;
+	struct tree_prefetch_entry *e;
+
+	if (!p)
+		return;
+
+	pthread_mutex_lock(&p->mutex);
+	p->exiting = 1;
+	pthread_cond_broadcast(&p->cond);
+	pthread_mutex_unlock(&p->mutex);
+	for (int i = 0; i < p->nr_threads; i++)
+		pthread_join(p->threads[i], NULL);
+	free(p->threads);
+	disable_obj_read_lock();
+	pthread_cond_destroy(&p->cond);
+	trace2_data_intmax("list-objects", p->repo, "tree-prefetch/phases",
+			   p->nr_phases);
+	trace2_data_intmax("list-objects", p->repo, "tree-prefetch/misses",
+			   p->nr_misses);
+	pthread_mutex_destroy(&p->mutex);
+
+	oidmap_iter_init(&p->trees, &iter);
+	while ((e = oidmap_iter_next(&iter)))
+		free(e->buffer);
+	oidmap_clear(&p->trees, 1);
+	oidset_clear(&p->skip);
+	free(p->stack);
+	free(p);
+}
+
 static void process_blob(struct traversal_context *ctx,
 			 struct blob *blob,
 			 struct strbuf *path,
@@ -170,6 +441,14 @@ static void process_tree(struct traversal_context *ctx,
 	if (ctx->depth > max_allowed_tree_depth)
 		die("exceeded maximum allowed tree depth");
 
+	if (ctx->prefetch && !obj->parsed) {
+		unsigned long size;
+		void *buffer = tree_prefetch_take(ctx->prefetch, &obj->oid,
+						  &size);
+		if (buffer)
+			parse_tree_buffer(tree, buffer, size);
+	}
+
 	failed_parse = parse_tree_gently(tree, 1);
 	if (failed_parse) {
 		if (revs->ignore_missing_links)
@@ -419,7 +698,11 @@ static void do_traverse(struct traversal_context *ctx)
 			 */
 			traverse_non_commits(ctx, &csp);
 	}
+	if (!ctx->revs->tree_blobs_in_commit_order)
+		ctx->prefetch = tree_prefetch_start(ctx->revs);
 	traverse_non_commits(ctx, &csp);
+	tree_prefetch_stop(ctx->prefetch);
+	ctx->prefetch = NULL;
 	strbuf_release(&csp);
 }
 
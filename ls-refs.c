@@ -71,6 +71,7 @@ struct ls_refs_data {
 	unsigned symrefs;
 	struct strvec prefixes;
 	struct strbuf buf;
+	struct packet_writer writer;
 	struct strvec hidden_refs;
 	unsigned unborn : 1;
 };
@@ -114,8 +115,7 @@ static int send_ref(const char *refname, const char *referent UNUSED, const stru
 			strbuf_addf(&data->buf, " peeled:%s", oid_to_hex(&peeled));
 	}
 
-	strbuf_addch(&data->buf, '\n');
-	packet_fwrite(stdout, data->buf.buf, data->buf.len);
+	packet_writer_write(&data->writer, "%s\n", data->buf.buf);
 
 	return 0;
 }
@@ -157,6 +157,8 @@ int ls_refs(struct repository *r, struct packet_reader *request)
 	memset(&data, 0, sizeof(data));
 	strvec_init(&data.prefixes);
 	strbuf_init(&data.buf, 0);
+	packet_writer_init(&data.writer, 1);
+	packet_writer_buffer(&data.writer);
 	strvec_init(&data.hidden_refs);
 
 	repo_config(the_repository, ls_refs_config, &data);
@@ -197,9 +199,10 @@ int ls_refs(struct repository *r, struct packet_reader *request)
 					  get_git_namespace(), data.prefixes.v,
 					  hidden_refs_to_excludes(&data.hidden_refs),
 					  send_ref, &data);
-	packet_fflush(stdout);
+	packet_writer_flush(&data.writer);
 	strvec_clear(&data.prefixes);
 	strbuf_release(&data.buf);
+	packet_writer_release(&data.writer);
 	strvec_clear(&data.hidden_refs);
 	return 0;
 }
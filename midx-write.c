@@ -19,6 +19,7 @@
 #include "list-objects.h"
 #include "path.h"
 #include "pack-revindex.h"
+#include "thread-utils.h"
 
 #define PACK_EXPIRED UINT_MAX
 #define BITMAP_POS_UNKNOWN (~((uint32_t)0))
@@ -835,6 +836,22 @@ static struct commit **find_commits_for_midx_bitmap(uint32_t *indexed_commits_nr
 	return cb.commits;
 }
 
+/*
+ * Like pack-objects, use "pack.threads" threads to build the bitmaps,
+ * defaulting to the number of CPUs.
+ */
+static int midx_bitmap_threads(struct repository *r)
+{
+	int threads = 0;
+
+	repo_config_get_int(r, "pack.threads", &threads);
+	if (threads < 0)
+		die(_("invalid number of threads specified (%d)"), threads);
+	if (!threads)
+		threads = online_cpus();
+	return threads;
+}
+
 static int write_midx_bitmap(struct write_midx_context *ctx,
 			     const char *object_dir,
 			     const unsigned char *midx_hash,
@@ -877,6 +894,7 @@ static int write_midx_bitmap(struct write_midx_context *ctx,
 	bitmap_writer_init(&writer, ctx->repo, pdata,
 			   ctx->incremental ? ctx->base_midx : NULL);
 	bitmap_writer_show_progress(&writer, flags & MIDX_PROGRESS);
+	bitmap_writer_set_threads(&writer, midx_bitmap_threads(ctx->repo));
 	bitmap_writer_build_type_index(&writer, index);
 
 	/*
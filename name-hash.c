@@ -732,11 +732,53 @@ void adjust_dirname_case(struct index_state *istate, char *name)
 	}
 }
 
+/*
+ * Building the name hash costs O(index), which dominates commands that
+ * only look up a handful of paths, like "git add one/file" run in a
+ * loop.  For case-sensitive lookups a binary search in the (sorted)
+ * index gives the same answer, so put off building the hash until
+ * enough lookups have been made for it to pay for itself.
+ */
+#define NAME_HASH_LOOKUPS_PER_ENTRY 32
+
+static int defer_name_hash(struct index_state *istate, int icase)
+{
+	if (istate->name_hash_initialized || icase)
+		return 0;
+	return istate->unhashed_lookups++ <
+		istate->cache_nr / NAME_HASH_LOOKUPS_PER_ENTRY;
+}
+
+static struct cache_entry *index_file_exists_sorted(struct index_state *istate,
+						    const char *name, int namelen)
+{
+	int pos = index_name_pos_sparse(istate, name, namelen);
+
+	if (pos < 0)
+		pos = -pos - 1;
+	for (; pos < istate->cache_nr; pos++) {
+		struct cache_entry *ce = istate->cache[pos];
+
+		if (ce_namelen(ce) != namelen || memcmp(ce->name, name, namelen))
+			break;
+		/* like hash_index_entry(), ignore sparse directories */
+		if (!S_ISSPARSEDIR(ce->ce_mode))
+			return ce;
+	}
+	return NULL;
+}
+
 struct cache_entry *index_file_exists(struct index_state *istate, const char *name, int namelen, int icase)
 {
 	struct cache_entry *ce;
-	unsigned int hash = memihash(name, namelen);
+	unsigned int hash;
+
+	if (defer_name_hash(istate, icase)) {
+		expand_to_path(istate, name, namelen, icase);
+		return index_file_exists_sorted(istate, name, namelen);
+	}
 
+	hash = memihash(name, namelen);
 	lazy_init_name_hash(istate);
 	expand_to_path(istate, name, namelen, icase);
 
@@ -711,10 +711,26 @@ static int do_oid_object_info_extended(struct object_database *odb,
 
 		/* Check if it is a missing object */
 		if (fetch_if_missing && repo_has_promisor_remote(odb->repo) &&
-		    !already_retried &&
+		    already_retried < 2 &&
 		    !(flags & OBJECT_INFO_SKIP_FETCH_OBJECT)) {
-			promisor_remote_get_direct(odb->repo, real, 1);
-			already_retried = 1;
+			int batched = -1;
+
+			/*
+			 * Join a batched fetch first, if one is running, and
+			 * let other threads read meanwhile. Should the object
+			 * still be missing, fetch it on its own.
+			 */
+			if (!already_retried) {
+				obj_read_unlock();
+				batched = promisor_remote_get_batched(odb->repo, real);
+				obj_read_lock();
+			}
+			if (batched) {
+				promisor_remote_get_direct(odb->repo, real, 1);
+				already_retried = 2;
+			} else {
+				already_retried = 1;
+			}
 			continue;
 		}
 
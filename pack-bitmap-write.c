@@ -27,6 +27,7 @@
 #include "strmap.h"
 #include "midx.h"
 #include "pack-revindex.h"
+#include "thread-utils.h"
 
 struct bitmapped_commit {
 	struct commit *commit;
@@ -110,6 +111,11 @@ void bitmap_writer_show_progress(struct bitmap_writer *writer, int show)
 	writer->show_progress = show;
 }
 
+void bitmap_writer_set_threads(struct bitmap_writer *writer, int threads)
+{
+	writer->threads = threads;
+}
+
 /**
  * Build the initial type index for the packfile or multi-pack-index
  */
@@ -302,6 +308,7 @@ struct bb_commit {
 		 maximal:1,
 		 pseudo_merge:1;
 	unsigned idx; /* within selected array */
+	unsigned pending; /* parents whose bitmaps are not yet built */
 };
 
 static void clear_bb_commit(struct bb_commit *commit)
@@ -460,10 +467,13 @@ static void bitmap_builder_clear(struct bitmap_builder *bb)
 
 static int fill_bitmap_tree(struct bitmap_writer *writer,
 			    struct bitmap *bitmap,
-			    struct tree *tree)
+			    const struct object_id *oid)
 {
 	int found;
 	uint32_t pos;
+	enum object_type type;
+	unsigned long size;
+	void *buf;
 	struct tree_desc desc;
 	struct name_entry entry;
 
@@ -471,29 +481,36 @@ static int fill_bitmap_tree(struct bitmap_writer *writer,
 	 * If our bit is already set, then there is nothing to do. Both this
 	 * tree and all of its children will be set.
 	 */
-	pos = find_object_pos(writer, &tree->object.oid, &found);
+	pos = find_object_pos(writer, oid, &found);
 	if (!found)
 		return -1;
 	if (bitmap_get(bitmap, pos))
 		return 0;
 	bitmap_set(bitmap, pos);
 
-	if (parse_tree(tree) < 0)
-		die("unable to load tree object %s",
-		    oid_to_hex(&tree->object.oid));
-	init_tree_desc(&desc, &tree->object.oid, tree->buffer, tree->size);
+	/*
+	 * Read the tree by its object ID, without going through the
+	 * object hash, so that several threads can fill bitmaps at once.
+	 */
+	buf = odb_read_object(writer->repo->objects, oid, &type, &size);
+	if (!buf || type != OBJ_TREE)
+		die("unable to load tree object %s", oid_to_hex(oid));
+	init_tree_desc(&desc, oid, buf, size);
 
 	while (tree_entry(&desc, &entry)) {
 		switch (object_type(entry.mode)) {
 		case OBJ_TREE:
-			if (fill_bitmap_tree(writer, bitmap,
-					     lookup_tree(writer->repo, &entry.oid)) < 0)
+			if (fill_bitmap_tree(writer, bitmap, &entry.oid) < 0) {
+				free(buf);
 				return -1;
+			}
 			break;
 		case OBJ_BLOB:
 			pos = find_object_pos(writer, &entry.oid, &found);
-			if (!found)
+			if (!found) {
+				free(buf);
 				return -1;
+			}
 			bitmap_set(bitmap, pos);
 			break;
 		default:
@@ -502,14 +519,18 @@ static int fill_bitmap_tree(struct bitmap_writer *writer,
 		}
 	}
 
-	free_tree_buffer(tree);
+	free(buf);
 	return 0;
 }
 
 static int reused_bitmaps_nr;
 static int reused_pseudo_merge_bitmaps_nr;
 
-static int fill_bitmap_commit(struct bitmap_writer *writer,
+/*
+ * Walk the commits reachable from "commit" that are not in ent->bitmap yet,
+ * setting their bits and queueing their root trees in "tree_queue".
+ */
+static int walk_bitmap_commit(struct bitmap_writer *writer,
 			      struct bb_commit *ent,
 			      struct commit *commit,
 			      struct prio_queue *queue,
@@ -578,9 +599,24 @@ static int fill_bitmap_commit(struct bitmap_writer *writer,
 		}
 	}
 
+	return 0;
+}
+
+static int fill_bitmap_commit(struct bitmap_writer *writer,
+			      struct bb_commit *ent,
+			      struct commit *commit,
+			      struct prio_queue *queue,
+			      struct prio_queue *tree_queue,
+			      struct bitmap_index *old_bitmap,
+			      const uint32_t *mapping)
+{
+	if (walk_bitmap_commit(writer, ent, commit, queue, tree_queue,
+			       old_bitmap, mapping) < 0)
+		return -1;
+
 	while (tree_queue->nr) {
-		if (fill_bitmap_tree(writer, ent->bitmap,
-				     prio_queue_get(tree_queue)) < 0)
+		struct tree *tree = prio_queue_get(tree_queue);
+		if (fill_bitmap_tree(writer, ent->bitmap, &tree->object.oid) < 0)
 			return -1;
 	}
 	return 0;
@@ -605,6 +641,200 @@ static void store_selected(struct bitmap_writer *writer,
 	kh_value(writer->bitmaps, hash_pos) = stored;
 }
 
+/*
+ * Store the bitmap of "commit" if it was selected, and hand it down to
+ * the commits which are waiting for it. When "ready" is given, the
+ * commits whose last pending parent this was are appended to it.
+ */
+static void finish_bitmap_commit(struct bitmap_writer *writer,
+				 struct bitmap_builder *bb,
+				 struct bb_commit *ent, struct commit *commit,
+				 int *nr_stored,
+				 struct commit ***ready, size_t *ready_nr,
+				 size_t *ready_alloc)
+{
+	struct commit *child;
+	int reused = 0;
+
+	if (ent->selected) {
+		store_selected(writer, ent, commit);
+		(*nr_stored)++;
+		display_progress(writer->progress, *nr_stored);
+	}
+
+	while ((child = pop_commit(&ent->reverse_edges))) {
+		struct bb_commit *child_ent =
+			bb_data_at(&bb->data, child);
+
+		if (child_ent->bitmap)
+			bitmap_or(child_ent->bitmap, ent->bitmap);
+		else if (reused)
+			child_ent->bitmap = bitmap_dup(ent->bitmap);
+		else {
+			child_ent->bitmap = ent->bitmap;
+			reused = 1;
+		}
+
+		if (ready && !--child_ent->pending) {
+			ALLOC_GROW(*ready, *ready_nr + 1, *ready_alloc);
+			(*ready)[(*ready_nr)++] = child;
+		}
+	}
+	if (!reused)
+		bitmap_free(ent->bitmap);
+	ent->bitmap = NULL;
+}
+
+struct bitmap_build_threads {
+	struct bitmap_writer *writer;
+	struct bitmap_builder *bb;
+	struct bitmap_index *old_bitmap;
+	const uint32_t *mapping;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* commits whose parents' bitmaps are all built */
+	struct commit **ready;
+	size_t ready_nr, ready_alloc;
+
+	size_t remaining;
+	int nr_stored;
+	int failed;
+};
+
+/*
+ * Each thread builds the bitmap of one commit at a time. The commit walk
+ * goes through the shared object hash and the old bitmap, so it happens
+ * under the mutex; the tree walk, where the time goes, only reads objects
+ * by their IDs and works on a bitmap that no other thread touches.
+ *
+ * A commit is only handed out once the bitmaps of all the commits feeding
+ * into it are complete. Bitmaps are sets, so the result does not depend
+ * on the order in which the threads get to them.
+ */
+static void *build_bitmaps_thread(void *data)
+{
+	struct bitmap_build_threads *bt = data;
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct prio_queue tree_queue = { NULL };
+	struct oid_array trees = OID_ARRAY_INIT;
+
+	pthread_mutex_lock(&bt->mutex);
+	while (1) {
+		struct commit *commit;
+		struct bb_commit *ent;
+		size_t i;
+		int ret;
+
+		while (!bt->ready_nr && bt->remaining && !bt->failed)
+			pthread_cond_wait(&bt->cond, &bt->mutex);
+		if (!bt->ready_nr || bt->failed)
+			break;
+
+		commit = bt->ready[--bt->ready_nr];
+		ent = bb_data_at(&bt->bb->data, commit);
+
+		ret = walk_bitmap_commit(bt->writer, ent, commit, &queue,
+					 &tree_queue, bt->old_bitmap,
+					 bt->mapping);
+		while (tree_queue.nr) {
+			struct tree *tree = prio_queue_get(&tree_queue);
+			oid_array_append(&trees, &tree->object.oid);
+		}
+		pthread_mutex_unlock(&bt->mutex);
+
+		for (i = 0; !ret && i < trees.nr; i++)
+			ret = fill_bitmap_tree(bt->writer, ent->bitmap,
+					       &trees.oid[i]);
+		oid_array_clear(&trees);
+
+		pthread_mutex_lock(&bt->mutex);
+		if (ret < 0) {
+			bt->failed = 1;
+			pthread_cond_broadcast(&bt->cond);
+			break;
+		}
+
+		finish_bitmap_commit(bt->writer, bt->bb, ent, commit,
+				     &bt->nr_stored, &bt->ready, &bt->ready_nr,
+				     &bt->ready_alloc);
+		bt->remaining--;
+		pthread_cond_broadcast(&bt->cond);
+	}
+	pthread_mutex_unlock(&bt->mutex);
+
+	clear_prio_queue(&queue);
+	clear_prio_queue(&tree_queue);
+	return NULL;
+}
+
+static int build_bitmaps_threaded(struct bitmap_writer *writer,
+				  struct bitmap_builder *bb,
+				  struct bitmap_index *old_bitmap,
+				  const uint32_t *mapping)
+{
+	struct bitmap_build_threads bt = {
+		.writer = writer,
+		.bb = bb,
+		.old_bitmap = old_bitmap,
+		.mapping = mapping,
+		.remaining = bb->commits_nr,
+	};
+	pthread_t *threads;
+	int nr_threads = writer->threads;
+	size_t i;
+
+	for (i = 0; i < bb->commits_nr; i++) {
+		struct bb_commit *ent = bb_data_at(&bb->data, bb->commits[i]);
+		struct commit_list *c;
+
+		for (c = ent->reverse_edges; c; c = c->next)
+			bb_data_at(&bb->data, c->item)->pending++;
+	}
+	/*
+	 * Queue the starting points so that the first ones to be picked
+	 * up are those that the sequential build would do first.
+	 */
+	for (i = 0; i < bb->commits_nr; i++) {
+		struct commit *commit = bb->commits[i];
+
+		if (bb_data_at(&bb->data, commit)->pending)
+			continue;
+		ALLOC_GROW(bt.ready, bt.ready_nr + 1, bt.ready_alloc);
+		bt.ready[bt.ready_nr++] = commit;
+	}
+
+	trace2_data_intmax("pack-bitmap-write", writer->repo,
+			   "building_bitmaps_threads", nr_threads);
+
+	pthread_mutex_init(&bt.mutex, NULL);
+	pthread_cond_init(&bt.cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&threads[i], NULL,
+					 build_bitmaps_thread, &bt);
+		if (err)
+			die(_("unable to create bitmap thread: %s"),
+			    strerror(err));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&bt.cond);
+	pthread_mutex_destroy(&bt.mutex);
+	free(threads);
+	free(bt.ready);
+
+	if (!bt.failed && bt.remaining)
+		BUG("%"PRIuMAX" bitmaps left unbuilt",
+		    (uintmax_t)bt.remaining);
+	return bt.failed ? -1 : 0;
+}
+
 int bitmap_writer_build(struct bitmap_writer *writer)
 {
 	struct bitmap_builder bb;
@@ -630,40 +860,24 @@ int bitmap_writer_build(struct bitmap_writer *writer)
 		mapping = NULL;
 
 	bitmap_builder_init(&bb, writer, old_bitmap);
-	for (i = bb.commits_nr; i > 0; i--) {
-		struct commit *commit = bb.commits[i-1];
-		struct bb_commit *ent = bb_data_at(&bb.data, commit);
-		struct commit *child;
-		int reused = 0;
-
-		if (fill_bitmap_commit(writer, ent, commit, &queue, &tree_queue,
-				       old_bitmap, mapping) < 0) {
+	if (HAVE_THREADS && writer->threads > 1) {
+		if (build_bitmaps_threaded(writer, &bb, old_bitmap, mapping) < 0)
 			closed = 0;
-			break;
-		}
-
-		if (ent->selected) {
-			store_selected(writer, ent, commit);
-			nr_stored++;
-			display_progress(writer->progress, nr_stored);
-		}
-
-		while ((child = pop_commit(&ent->reverse_edges))) {
-			struct bb_commit *child_ent =
-				bb_data_at(&bb.data, child);
-
-			if (child_ent->bitmap)
-				bitmap_or(child_ent->bitmap, ent->bitmap);
-			else if (reused)
-				child_ent->bitmap = bitmap_dup(ent->bitmap);
-			else {
-				child_ent->bitmap = ent->bitmap;
-				reused = 1;
+	} else {
+		for (i = bb.commits_nr; i > 0; i--) {
+			struct commit *commit = bb.commits[i-1];
+			struct bb_commit *ent = bb_data_at(&bb.data, commit);
+
+			if (fill_bitmap_commit(writer, ent, commit, &queue,
+					       &tree_queue, old_bitmap,
+					       mapping) < 0) {
+				closed = 0;
+				break;
 			}
+
+			finish_bitmap_commit(writer, &bb, ent, commit,
+					     &nr_stored, NULL, NULL, NULL);
 		}
-		if (!reused)
-			bitmap_free(ent->bitmap);
-		ent->bitmap = NULL;
 	}
 	clear_prio_queue(&queue);
 	clear_prio_queue(&tree_queue);
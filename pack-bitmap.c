@@ -2569,6 +2569,43 @@ int bitmap_walk_contains(struct bitmap_index *bitmap_git,
 	return idx >= 0 && bitmap_get(bitmap, idx);
 }
 
+int bitmap_set_oid(struct bitmap_index *bitmap_git,
+		   struct bitmap *bitmap, const struct object_id *oid)
+{
+	int idx = bitmap_position(bitmap_git, oid);
+
+	if (idx < 0)
+		return -1;
+	bitmap_set(bitmap, idx);
+	return 0;
+}
+
+struct ewah_bitmap *bitmap_for_reachable_commits(struct bitmap_index *bitmap_git,
+						 struct commit *commit)
+{
+	struct rev_info revs;
+	struct object_list *roots = NULL;
+	struct bitmap *reachable;
+	struct ewah_bitmap *result;
+
+	repo_init_revisions(bitmap_repo(bitmap_git), &revs, NULL);
+	object_list_insert(&commit->object, &roots);
+
+	reachable = find_objects(bitmap_git, &revs, roots, NULL);
+	if (!reachable)
+		BUG("failed to perform bitmap walk");
+	clear_commit_marks(commit, ALL_REV_FLAGS);
+
+	/* trees and blobs only make the result bigger */
+	filter_bitmap_object_type(bitmap_git, NULL, reachable, OBJ_COMMIT);
+	result = bitmap_to_ewah(reachable);
+
+	bitmap_free(reachable);
+	object_list_free(&roots);
+	release_revisions(&revs);
+	return result;
+}
+
 void traverse_bitmap_commit_list(struct bitmap_index *bitmap_git,
 				 struct rev_info *revs,
 				 show_reachable_fn show_reachable)
@@ -115,6 +115,24 @@ void free_bitmap_index(struct bitmap_index *);
 int bitmap_walk_contains(struct bitmap_index *,
 			 struct bitmap *bitmap, const struct object_id *oid);
 
+/*
+ * Sets the bit of "oid" in "bitmap". Returns -1 and leaves "bitmap" alone
+ * if the object has no position in the bitmap index, 0 otherwise.
+ */
+int bitmap_set_oid(struct bitmap_index *,
+		   struct bitmap *bitmap, const struct object_id *oid);
+
+/*
+ * Returns a new bitmap of the commits reachable from "commit", taken from
+ * the on-disk and pseudo-merge bitmaps and from a walk over the commits
+ * they do not cover. Commits found by that walk but missing from the
+ * bitmapped pack(s) get positions in the extended index, so
+ * bitmap_set_oid() can name them afterwards. The caller frees the result
+ * with ewah_free().
+ */
+struct ewah_bitmap *bitmap_for_reachable_commits(struct bitmap_index *,
+						 struct commit *commit);
+
 /*
  * After a traversal has been performed by prepare_bitmap_walk(), this can be
  * queried to see if a particular object was reachable from any of the
@@ -144,6 +162,7 @@ struct bitmap_writer {
 
 	struct progress *progress;
 	int show_progress;
+	int threads;
 	unsigned char pack_checksum[GIT_MAX_RAWSZ];
 };
 
@@ -151,6 +170,7 @@ void bitmap_writer_init(struct bitmap_writer *writer, struct repository *r,
 			struct packing_data *pdata,
 			struct multi_pack_index *midx);
 void bitmap_writer_show_progress(struct bitmap_writer *writer, int show);
+void bitmap_writer_set_threads(struct bitmap_writer *writer, int threads);
 void bitmap_writer_set_checksum(struct bitmap_writer *writer,
 				const unsigned char *sha1);
 void bitmap_writer_build_type_index(struct bitmap_writer *writer,
@@ -2,6 +2,7 @@
 
 #include "git-compat-util.h"
 #include "environment.h"
+#include "gettext.h"
 #include "hex.h"
 #include "repository.h"
 #include "pack.h"
@@ -9,6 +10,7 @@
 #include "packfile.h"
 #include "object-file.h"
 #include "odb.h"
+#include "thread-utils.h"
 
 struct idx_entry {
 	off_t                offset;
@@ -48,11 +50,240 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 	return data_crc != ntohl(*index_crc);
 }
 
+/* What checking one object of the pack found, for the caller to report. */
+struct verify_result {
+	void *data;
+	enum object_type type;
+	unsigned long size;
+	unsigned crc_mismatch : 1,
+		 unpack_failed : 1,
+		 corrupt : 1,
+		 /* too big to unpack in-core, left for the streaming check */
+		 stream : 1,
+		 done : 1;
+};
+
+/*
+ * Check the CRC, unpack and hash the object entries[i]. When several
+ * threads do this at the same time, the object read lock protects the
+ * pack windows and the delta base cache; it is released while
+ * inflating and hashing.
+ */
+static void check_entry(struct repository *r, struct packed_git *p,
+			struct pack_window **w_curs, struct idx_entry *entries,
+			uint32_t i, const struct object_id *oid,
+			struct verify_result *res)
+{
+	off_t curpos;
+
+	obj_read_lock();
+	if (p->index_version > 1) {
+		off_t offset = entries[i].offset;
+		off_t len = entries[i+1].offset - offset;
+		unsigned int nr = entries[i].nr;
+		if (check_pack_crc(p, w_curs, offset, len, nr))
+			res->crc_mismatch = 1;
+	}
+
+	curpos = entries[i].offset;
+	res->type = unpack_object_header(p, w_curs, &curpos, &res->size);
+	unuse_pack(w_curs);
+
+	if (res->type == OBJ_BLOB &&
+	    repo_settings_get_big_file_threshold(r) <= res->size) {
+		/*
+		 * Let stream_object_signature() check it with
+		 * the streaming interface; no point slurping
+		 * the data in-core only to discard.
+		 */
+		res->stream = 1;
+		obj_read_unlock();
+		return;
+	}
+	res->data = unpack_entry(r, p, entries[i].offset, &res->type,
+				 &res->size);
+	obj_read_unlock();
+
+	if (!res->data)
+		res->unpack_failed = 1;
+	else if (check_object_signature(r, oid, res->data, res->size,
+					res->type) < 0)
+		res->corrupt = 1;
+}
+
+static int report_entry(struct repository *r, struct packed_git *p,
+			struct idx_entry *entries, uint32_t i,
+			const struct object_id *oid,
+			struct verify_result *res, verify_fn fn)
+{
+	int err = 0;
+
+	if (res->crc_mismatch)
+		err = error("index CRC mismatch for object %s "
+			    "from %s at offset %"PRIuMAX"",
+			    oid_to_hex(oid),
+			    p->pack_name, (uintmax_t)entries[i].offset);
+
+	if (res->unpack_failed)
+		err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
+			    oid_to_hex(oid), p->pack_name,
+			    (uintmax_t)entries[i].offset);
+	else if (res->corrupt ||
+		 (res->stream && stream_object_signature(r, oid) < 0))
+		err = error("packed %s from %s is corrupt",
+			    oid_to_hex(oid), p->pack_name);
+	else if (fn) {
+		int eaten = 0;
+		err |= fn(oid, res->type, res->size, res->data, &eaten);
+		if (eaten)
+			res->data = NULL;
+	}
+	FREE_AND_NULL(res->data);
+	return err;
+}
+
+static void entry_oid(struct packed_git *p, struct idx_entry *entries,
+		      uint32_t i, struct object_id *oid)
+{
+	if (nth_packed_object_id(oid, p, entries[i].nr) < 0)
+		BUG("unable to get oid of object %lu from %s",
+		    (unsigned long)entries[i].nr, p->pack_name);
+}
+
+/*
+ * With several threads, objects are checked ahead of the one being
+ * reported, at most VERIFY_WINDOW of them and VERIFY_MAX_BYTES of their
+ * data at a time, and reported in pack order on the calling thread.
+ */
+#define VERIFY_WINDOW 1024
+#define VERIFY_MAX_BYTES (256 * 1024 * 1024)
+
+struct verify_threads {
+	struct repository *r;
+	struct packed_git *p;
+	struct idx_entry *entries;
+	uint32_t nr_objects;
+	struct verify_result *results;
+	/* next object to check, next one to report */
+	uint32_t next, reported;
+	size_t bytes;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
+
+static void *verify_thread(void *data)
+{
+	struct verify_threads *vt = data;
+	struct pack_window *w_curs = NULL;
+
+	pthread_mutex_lock(&vt->mutex);
+	while (vt->next < vt->nr_objects) {
+		struct verify_result *res;
+		struct object_id oid;
+		uint32_t i;
+
+		if (vt->next - vt->reported >= VERIFY_WINDOW ||
+		    vt->bytes >= VERIFY_MAX_BYTES) {
+			pthread_cond_wait(&vt->cond, &vt->mutex);
+			continue;
+		}
+		i = vt->next++;
+		pthread_mutex_unlock(&vt->mutex);
+
+		res = &vt->results[i % VERIFY_WINDOW];
+		entry_oid(vt->p, vt->entries, i, &oid);
+		check_entry(vt->r, vt->p, &w_curs, vt->entries, i, &oid, res);
+
+		pthread_mutex_lock(&vt->mutex);
+		if (res->data)
+			vt->bytes += res->size;
+		res->done = 1;
+		pthread_cond_broadcast(&vt->cond);
+	}
+	pthread_mutex_unlock(&vt->mutex);
+
+	obj_read_lock();
+	unuse_pack(&w_curs);
+	obj_read_unlock();
+	return NULL;
+}
+
+static int verify_entries_threaded(struct repository *r, struct packed_git *p,
+				   struct idx_entry *entries,
+				   uint32_t nr_objects, verify_fn fn,
+				   struct progress *progress,
+				   uint32_t base_count, int nr_threads)
+{
+	struct verify_threads vt = {
+		.r = r,
+		.p = p,
+		.entries = entries,
+		.nr_objects = nr_objects,
+	};
+	pthread_t *threads;
+	uint32_t i;
+	int err = 0;
+
+	/* settings are loaded lazily, do it before the threads need them */
+	repo_settings_get_big_file_threshold(r);
+
+	CALLOC_ARRAY(vt.results, VERIFY_WINDOW);
+	pthread_mutex_init(&vt.mutex, NULL);
+	pthread_cond_init(&vt.cond, NULL);
+	enable_obj_read_lock();
+
+	CALLOC_ARRAY(threads, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		int ret = pthread_create(&threads[i], NULL, verify_thread, &vt);
+		if (ret)
+			die(_("unable to create pack verification thread: %s"),
+			    strerror(ret));
+	}
+
+	for (i = 0; i < nr_objects; i++) {
+		struct verify_result *res = &vt.results[i % VERIFY_WINDOW];
+		struct object_id oid;
+		size_t size;
+
+		pthread_mutex_lock(&vt.mutex);
+		while (!res->done)
+			pthread_cond_wait(&vt.cond, &vt.mutex);
+		pthread_mutex_unlock(&vt.mutex);
+
+		/* the callback may look objects up */
+		size = res->data ? res->size : 0;
+		entry_oid(p, entries, i, &oid);
+		obj_read_lock();
+		err |= report_entry(r, p, entries, i, &oid, res, fn);
+		obj_read_unlock();
+		if (((base_count + i) & 1023) == 0)
+			display_progress(progress, base_count + i);
+
+		pthread_mutex_lock(&vt.mutex);
+		memset(res, 0, sizeof(*res));
+		vt.bytes -= size;
+		vt.reported++;
+		pthread_cond_broadcast(&vt.cond);
+		pthread_mutex_unlock(&vt.mutex);
+	}
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	disable_obj_read_lock();
+	pthread_cond_destroy(&vt.cond);
+	pthread_mutex_destroy(&vt.mutex);
+	free(vt.results);
+	return err;
+}
+
 static int verify_packfile(struct repository *r,
 			   struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   int nr_threads)
 
 {
 	off_t index_size = p->index_size;
@@ -103,69 +334,26 @@ static int verify_packfile(struct repository *r,
 	}
 	QSORT(entries, nr_objects, compare_entries);
 
+	if (HAVE_THREADS && nr_threads > 1 && nr_objects > 1) {
+		err |= verify_entries_threaded(r, p, entries, nr_objects, fn,
+					       progress, base_count,
+					       nr_threads);
+		i = nr_objects;
+		goto done;
+	}
+
 	for (i = 0; i < nr_objects; i++) {
-		void *data;
+		struct verify_result res = { 0 };
 		struct object_id oid;
-		enum object_type type;
-		unsigned long size;
-		off_t curpos;
-		int data_valid;
-
-		if (nth_packed_object_id(&oid, p, entries[i].nr) < 0)
-			BUG("unable to get oid of object %lu from %s",
-			    (unsigned long)entries[i].nr, p->pack_name);
-
-		if (p->index_version > 1) {
-			off_t offset = entries[i].offset;
-			off_t len = entries[i+1].offset - offset;
-			unsigned int nr = entries[i].nr;
-			if (check_pack_crc(p, w_curs, offset, len, nr))
-				err = error("index CRC mismatch for object %s "
-					    "from %s at offset %"PRIuMAX"",
-					    oid_to_hex(&oid),
-					    p->pack_name, (uintmax_t)offset);
-		}
-
-		curpos = entries[i].offset;
-		type = unpack_object_header(p, w_curs, &curpos, &size);
-		unuse_pack(w_curs);
-
-		if (type == OBJ_BLOB &&
-		    repo_settings_get_big_file_threshold(r) <= size) {
-			/*
-			 * Let stream_object_signature() check it with
-			 * the streaming interface; no point slurping
-			 * the data in-core only to discard.
-			 */
-			data = NULL;
-			data_valid = 0;
-		} else {
-			data = unpack_entry(r, p, entries[i].offset, &type, &size);
-			data_valid = 1;
-		}
 
-		if (data_valid && !data)
-			err = error("cannot unpack %s from %s at offset %"PRIuMAX"",
-				    oid_to_hex(&oid), p->pack_name,
-				    (uintmax_t)entries[i].offset);
-		else if (data && check_object_signature(r, &oid, data, size,
-							type) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (!data && stream_object_signature(r, &oid) < 0)
-			err = error("packed %s from %s is corrupt",
-				    oid_to_hex(&oid), p->pack_name);
-		else if (fn) {
-			int eaten = 0;
-			err |= fn(&oid, type, size, data, &eaten);
-			if (eaten)
-				data = NULL;
-		}
+		entry_oid(p, entries, i, &oid);
+		check_entry(r, p, w_curs, entries, i, &oid, &res);
+		err |= report_entry(r, p, entries, i, &oid, &res, fn);
 		if (((base_count + i) & 1023) == 0)
 			display_progress(progress, base_count + i);
-		free(data);
-
 	}
+
+done:
 	display_progress(progress, base_count + i);
 	free(entries);
 
@@ -187,7 +375,7 @@ int verify_pack_index(struct packed_git *p)
 }
 
 int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count, int nr_threads)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
@@ -196,7 +384,8 @@ int verify_pack(struct repository *r, struct packed_git *p, verify_fn fn,
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count);
+	err |= verify_packfile(r, p, &w_curs, fn, progress, base_count,
+			       nr_threads);
 	unuse_pack(&w_curs);
 
 	return err;
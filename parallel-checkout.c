@@ -87,6 +87,7 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 					     const struct conv_attrs *ca)
 {
 	enum conv_attrs_classification c;
+	const char *filter_driver;
 	size_t packed_item_size;
 
 	/*
@@ -98,8 +99,10 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 	if (!S_ISREG(ce->ce_mode))
 		return 0;
 
+	filter_driver = get_parallel_process_filter(ca);
 	packed_item_size = sizeof(struct pc_item_fixed_portion) + ce->ce_namelen +
-		(ca->working_tree_encoding ? strlen(ca->working_tree_encoding) : 0);
+		(ca->working_tree_encoding ? strlen(ca->working_tree_encoding) : 0) +
+		(filter_driver ? strlen(filter_driver) : 0);
 
 	/*
 	 * The amount of data we send to the workers per checkout item is
@@ -140,8 +143,13 @@ static int is_eligible_for_parallel_checkout(const struct cache_entry *ce,
 		 * probably have to designate a single process to interact with
 		 * the filter and send all the necessary data to it, for each
 		 * entry.
+		 *
+		 * The exception are drivers marked with
+		 * "filter.<driver>.parallel": the user promised that instances
+		 * of it may run concurrently, so each worker starts its own
+		 * and the entries never go to the delayed queue.
 		 */
-		return 0;
+		return !!filter_driver;
 
 	case CA_CLASS_STREAMABLE:
 		return 1;
@@ -271,6 +279,7 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 {
 	int ret;
 	struct stream_filter *filter;
+	struct checkout_metadata meta;
 	struct strbuf buf = STRBUF_INIT;
 	char *blob;
 	size_t size;
@@ -297,12 +306,13 @@ static int write_pc_item_to_fd(struct parallel_checkout_item *pc_item, int fd,
 
 	/*
 	 * checkout metadata is used to give context for external process
-	 * filters. Files requiring such filters are not eligible for parallel
-	 * checkout, so pass NULL. Note: if that changes, the metadata must also
-	 * be passed from the main process to the workers.
+	 * filters. Only the filters marked as parallel are eligible for
+	 * parallel checkout and the workers do not know the refname or
+	 * treeish being checked out, so just pass the blob.
 	 */
+	init_checkout_metadata(&meta, NULL, NULL, &pc_item->ce->oid);
 	ret = convert_to_working_tree_ca(&pc_item->ca, pc_item->ce->name,
-					 blob, size, &buf, NULL);
+					 blob, size, &buf, &meta);
 
 	if (ret) {
 		size_t newsize;
@@ -412,16 +422,18 @@ static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 	char *data, *variant;
 	struct pc_item_fixed_portion *fixed_portion;
 	const char *working_tree_encoding = pc_item->ca.working_tree_encoding;
+	const char *filter_driver = get_parallel_process_filter(&pc_item->ca);
 	size_t name_len = pc_item->ce->ce_namelen;
 	size_t working_tree_encoding_len = working_tree_encoding ?
 					   strlen(working_tree_encoding) : 0;
+	size_t filter_driver_len = filter_driver ? strlen(filter_driver) : 0;
 
 	/*
 	 * Any changes in the calculation of the message size must also be made
 	 * in is_eligible_for_parallel_checkout().
 	 */
 	len_data = sizeof(struct pc_item_fixed_portion) + name_len +
-		   working_tree_encoding_len;
+		   working_tree_encoding_len + filter_driver_len;
 
 	data = xmalloc(len_data);
 
@@ -432,6 +444,7 @@ static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 	fixed_portion->ident = pc_item->ca.ident;
 	fixed_portion->name_len = name_len;
 	fixed_portion->working_tree_encoding_len = working_tree_encoding_len;
+	fixed_portion->filter_driver_len = filter_driver_len;
 	oidcpy(&fixed_portion->oid, &pc_item->ce->oid);
 
 	variant = data + sizeof(*fixed_portion);
@@ -439,6 +452,10 @@ static void send_one_item(int fd, struct parallel_checkout_item *pc_item)
 		memcpy(variant, working_tree_encoding, working_tree_encoding_len);
 		variant += working_tree_encoding_len;
 	}
+	if (filter_driver_len) {
+		memcpy(variant, filter_driver, filter_driver_len);
+		variant += filter_driver_len;
+	}
 	memcpy(variant, pc_item->ce->name, name_len);
 
 	packet_write(fd, data, len_data);
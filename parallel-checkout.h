@@ -78,9 +78,9 @@ struct parallel_checkout_item {
 
 /*
  * The fixed-size portion of `struct parallel_checkout_item` that is sent to the
- * workers. Following this will be 2 strings: ca.working_tree_encoding and
- * ce.name; These are NOT null terminated, since we have the size in the fixed
- * portion.
+ * workers. Following this will be 3 strings: ca.working_tree_encoding, the
+ * name of ca.drv (only for parallel process filters) and ce.name; These are
+ * NOT null terminated, since we have the size in the fixed portion.
  *
  * Note that not all fields of conv_attrs and cache_entry are passed, only the
  * ones that will be required by the workers to smudge and write the entry.
@@ -92,6 +92,7 @@ struct pc_item_fixed_portion {
 	enum convert_crlf_action crlf_action;
 	int ident;
 	size_t working_tree_encoding_len;
+	size_t filter_driver_len;
 	size_t name_len;
 };
 
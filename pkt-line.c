@@ -204,6 +204,7 @@ static int do_packet_write(const int fd_out, const char *buf, size_t size,
 {
 	char header[4];
 	size_t packet_size;
+	struct iovec iov[2];
 
 	if (size > LARGE_PACKET_DATA_MAX) {
 		strbuf_addstr(err, _("packet write failed - data exceeds max packet size"));
@@ -216,14 +217,17 @@ static int do_packet_write(const int fd_out, const char *buf, size_t size,
 	set_packet_header(header, packet_size);
 
 	/*
-	 * Write the header and the buffer in 2 parts so that we do
-	 * not need to allocate a buffer or rely on a static buffer.
-	 * This also avoids putting a large buffer on the stack which
-	 * might have multi-threading issues.
+	 * Write the header and the buffer as 2 parts of one write so
+	 * that we do not need to allocate a buffer or rely on a static
+	 * buffer. This also avoids putting a large buffer on the stack
+	 * which might have multi-threading issues.
 	 */
+	iov[0].iov_base = header;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = (char *)buf;
+	iov[1].iov_len = size;
 
-	if (write_in_full(fd_out, header, 4) < 0 ||
-	    write_in_full(fd_out, buf, size) < 0) {
+	if (writev_in_full(fd_out, iov, 2) < 0) {
 		strbuf_addf(err, _("packet write failed: %s"), strerror(errno));
 		return -1;
 	}
@@ -674,10 +678,50 @@ enum packet_read_status packet_reader_peek(struct packet_reader *reader)
 	return reader->status;
 }
 
+/* Write out what a buffered packet_writer has collected beyond this. */
+#define PACKET_WRITER_BUFFER_MAX (2 * LARGE_PACKET_MAX)
+
 void packet_writer_init(struct packet_writer *writer, int dest_fd)
 {
 	writer->dest_fd = dest_fd;
 	writer->use_sideband = 0;
+	writer->buffered = 0;
+	strbuf_init(&writer->buf, 0);
+}
+
+void packet_writer_buffer(struct packet_writer *writer)
+{
+	writer->buffered = 1;
+}
+
+void packet_writer_send(struct packet_writer *writer)
+{
+	if (!writer->buf.len)
+		return;
+	if (write_in_full(writer->dest_fd, writer->buf.buf, writer->buf.len) < 0) {
+		check_pipe(errno);
+		die_errno(_("packet write failed"));
+	}
+	strbuf_reset(&writer->buf);
+}
+
+void packet_writer_release(struct packet_writer *writer)
+{
+	strbuf_release(&writer->buf);
+}
+
+static void packet_writer_vwrite(struct packet_writer *writer,
+				 const char *prefix, const char *fmt,
+				 va_list args)
+{
+	if (!writer->buffered) {
+		packet_write_fmt_1(writer->dest_fd, 0, prefix, fmt, args);
+		return;
+	}
+
+	format_packet(&writer->buf, prefix, fmt, args);
+	if (writer->buf.len >= PACKET_WRITER_BUFFER_MAX)
+		packet_writer_send(writer);
 }
 
 void packet_writer_write(struct packet_writer *writer, const char *fmt, ...)
@@ -685,8 +729,8 @@ void packet_writer_write(struct packet_writer *writer, const char *fmt, ...)
 	va_list args;
 
 	va_start(args, fmt);
-	packet_write_fmt_1(writer->dest_fd, 0,
-			   writer->use_sideband ? "\001" : "", fmt, args);
+	packet_writer_vwrite(writer, writer->use_sideband ? "\001" : "",
+			     fmt, args);
 	va_end(args);
 }
 
@@ -695,17 +739,30 @@ void packet_writer_error(struct packet_writer *writer, const char *fmt, ...)
 	va_list args;
 
 	va_start(args, fmt);
-	packet_write_fmt_1(writer->dest_fd, 0,
-			   writer->use_sideband ? "\003" : "ERR ", fmt, args);
+	packet_writer_vwrite(writer, writer->use_sideband ? "\003" : "ERR ",
+			     fmt, args);
 	va_end(args);
+
+	/* errors are usually followed by death */
+	packet_writer_send(writer);
 }
 
 void packet_writer_delim(struct packet_writer *writer)
 {
-	packet_delim(writer->dest_fd);
+	if (!writer->buffered) {
+		packet_delim(writer->dest_fd);
+		return;
+	}
+	packet_buf_delim(&writer->buf);
+	packet_writer_send(writer);
 }
 
 void packet_writer_flush(struct packet_writer *writer)
 {
-	packet_flush(writer->dest_fd);
+	if (!writer->buffered) {
+		packet_flush(writer->dest_fd);
+		return;
+	}
+	packet_buf_flush(&writer->buf);
+	packet_writer_send(writer);
 }
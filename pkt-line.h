@@ -237,10 +237,33 @@ extern char packet_buffer[LARGE_PACKET_MAX];
 struct packet_writer {
 	int dest_fd;
 	unsigned use_sideband : 1;
+
+	/*
+	 * Set by packet_writer_buffer(): packets are collected in "buf"
+	 * instead of being written one by one.
+	 */
+	unsigned buffered : 1;
+	struct strbuf buf;
 };
 
 void packet_writer_init(struct packet_writer *writer, int dest_fd);
 
+/*
+ * Collect the packets written from now on and write them out together,
+ * at a flush or delim packet, on packet_writer_send(), or whenever a
+ * good amount has piled up. Error packets are written out right away.
+ */
+void packet_writer_buffer(struct packet_writer *writer);
+
+/*
+ * Write out the packets collected so far, e.g. before waiting for the
+ * other side, which may wait for them, or before writing to "dest_fd"
+ * directly.
+ */
+void packet_writer_send(struct packet_writer *writer);
+
+void packet_writer_release(struct packet_writer *writer);
+
 /* These functions die upon failure. */
 __attribute__((format (printf, 2, 3)))
 void packet_writer_write(struct packet_writer *writer, const char *fmt, ...);
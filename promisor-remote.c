@@ -3,6 +3,7 @@
 #include "git-compat-util.h"
 #include "gettext.h"
 #include "hex.h"
+#include "object-file.h"
 #include "odb.h"
 #include "promisor-remote.h"
 #include "config.h"
@@ -13,21 +14,38 @@
 #include "environment.h"
 #include "url.h"
 #include "version.h"
+#include "oid-array.h"
+#include "oidset.h"
+#include "thread-utils.h"
 
 struct promisor_remote_config {
 	struct promisor_remote *promisors;
 	struct promisor_remote **promisors_tail;
 };
 
-static int fetch_objects(struct repository *repo,
-			 const char *remote_name,
-			 const struct object_id *oids,
-			 int oid_nr)
+void promisor_remote_fetch_command(struct repository *repo,
+				   const char *remote_name, int quiet,
+				   struct child_process *child)
+{
+	child->git_cmd = 1;
+	if (repo != the_repository)
+		prepare_other_repo_env(&child->env, repo->gitdir);
+	strvec_pushl(&child->args, "-c", "fetch.negotiationAlgorithm=noop",
+		     "fetch", remote_name, "--no-tags",
+		     "--no-write-fetch-head", "--recurse-submodules=no",
+		     "--filter=blob:none", "--stdin", NULL);
+	if (quiet)
+		strvec_push(&child->args, "--quiet");
+}
+
+static int fetch_objects_1(struct repository *repo,
+			   const char *remote_name,
+			   const struct object_id *oids,
+			   int oid_nr, int quiet)
 {
 	struct child_process child = CHILD_PROCESS_INIT;
 	int i;
 	FILE *child_in;
-	int quiet;
 
 	if (git_env_bool(NO_LAZY_FETCH_ENVIRONMENT, 0)) {
 		static int warning_shown;
@@ -38,16 +56,8 @@ static int fetch_objects(struct repository *repo,
 		return -1;
 	}
 
-	child.git_cmd = 1;
+	promisor_remote_fetch_command(repo, remote_name, quiet, &child);
 	child.in = -1;
-	if (repo != the_repository)
-		prepare_other_repo_env(&child.env, repo->gitdir);
-	strvec_pushl(&child.args, "-c", "fetch.negotiationAlgorithm=noop",
-		     "fetch", remote_name, "--no-tags",
-		     "--no-write-fetch-head", "--recurse-submodules=no",
-		     "--filter=blob:none", "--stdin", NULL);
-	if (!repo_config_get_bool(the_repository, "promisor.quiet", &quiet) && quiet)
-		strvec_push(&child.args, "--quiet");
 	if (start_command(&child))
 		die(_("promisor-remote: unable to fork off fetch subprocess"));
 	child_in = xfdopen(child.in, "w");
@@ -66,6 +76,23 @@ static int fetch_objects(struct repository *repo,
 	return finish_command(&child) ? -1 : 0;
 }
 
+static int promisor_quiet(void)
+{
+	int quiet;
+
+	return !repo_config_get_bool(the_repository, "promisor.quiet", &quiet) &&
+		quiet;
+}
+
+static int fetch_objects(struct repository *repo,
+			 const char *remote_name,
+			 const struct object_id *oids,
+			 int oid_nr)
+{
+	return fetch_objects_1(repo, remote_name, oids, oid_nr,
+			       promisor_quiet());
+}
+
 static struct promisor_remote *promisor_remote_new(struct promisor_remote_config *config,
 						   const char *remote_name)
 {
@@ -307,6 +334,187 @@ void promisor_remote_get_direct(struct repository *repo,
 		free(remaining_oids);
 }
 
+/*
+ * How long the fetcher waits after the first object of a batch is asked
+ * for, so that the other threads about to miss an object get theirs into
+ * the same fetch.
+ */
+#define LAZY_FETCH_WINDOW_MS 10
+
+struct lazy_fetch {
+	struct repository *repo;
+	char *remote_name;
+	int quiet;
+	int users;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t wake;
+	pthread_cond_t fetched;
+	int stopping;
+
+	/* objects for the next batch, and those of the one being fetched */
+	struct oid_array pending;
+	struct oidset pending_set, in_flight;
+	/* batches taken off "pending" so far, and how many of them are done */
+	unsigned long taken, done;
+};
+
+static struct lazy_fetch *lazy_fetch;
+
+static void *lazy_fetch_thread(void *data)
+{
+	struct lazy_fetch *lf = data;
+
+	trace2_thread_start("lazy-fetch");
+	pthread_mutex_lock(&lf->mutex);
+	while (1) {
+		struct oid_array batch = OID_ARRAY_INIT;
+
+		while (!lf->pending.nr && !lf->stopping)
+			pthread_cond_wait(&lf->wake, &lf->mutex);
+		if (!lf->pending.nr)
+			break;
+
+		pthread_mutex_unlock(&lf->mutex);
+		sleep_millisec(LAZY_FETCH_WINDOW_MS);
+		pthread_mutex_lock(&lf->mutex);
+
+		SWAP(batch, lf->pending);
+		for (size_t i = 0; i < batch.nr; i++)
+			oidset_insert(&lf->in_flight, &batch.oid[i]);
+		oidset_clear(&lf->pending_set);
+		lf->taken++;
+		pthread_mutex_unlock(&lf->mutex);
+
+		/*
+		 * A failed batch is not retried here: each thread waiting on
+		 * it fetches its own object directly afterwards, which also
+		 * tries the other promisor remotes.
+		 */
+		trace2_data_intmax("promisor", lf->repo, "lazy_fetch_batch",
+				   batch.nr);
+		fetch_objects_1(lf->repo, lf->remote_name, batch.oid, batch.nr,
+				lf->quiet);
+		oid_array_clear(&batch);
+
+		pthread_mutex_lock(&lf->mutex);
+		oidset_clear(&lf->in_flight);
+		lf->done++;
+		pthread_cond_broadcast(&lf->fetched);
+	}
+	pthread_mutex_unlock(&lf->mutex);
+	trace2_thread_exit();
+	return NULL;
+}
+
+void promisor_remote_start_batching(struct repository *repo)
+{
+	struct lazy_fetch *lf;
+
+	if (!HAVE_THREADS || !fetch_if_missing ||
+	    !repo_has_promisor_remote(repo))
+		return;
+	if (lazy_fetch) {
+		if (lazy_fetch->repo != repo)
+			BUG("lazy fetch batching already started for another repository");
+		lazy_fetch->users++;
+		return;
+	}
+
+	CALLOC_ARRAY(lf, 1);
+	lf->repo = repo;
+	lf->remote_name = xstrdup(repo->promisor_remote_config->promisors->name);
+	lf->quiet = promisor_quiet();
+	lf->users = 1;
+	oidset_init(&lf->pending_set, 0);
+	oidset_init(&lf->in_flight, 0);
+	pthread_mutex_init(&lf->mutex, NULL);
+	pthread_cond_init(&lf->wake, NULL);
+	pthread_cond_init(&lf->fetched, NULL);
+	if (pthread_create(&lf->thread, NULL, lazy_fetch_thread, lf)) {
+		/* objects are simply fetched one at a time then */
+		pthread_cond_destroy(&lf->fetched);
+		pthread_cond_destroy(&lf->wake);
+		pthread_mutex_destroy(&lf->mutex);
+		free(lf->remote_name);
+		free(lf);
+		return;
+	}
+	lazy_fetch = lf;
+}
+
+void promisor_remote_stop_batching(void)
+{
+	struct lazy_fetch *lf = lazy_fetch;
+
+	if (!lf || --lf->users)
+		return;
+
+	pthread_mutex_lock(&lf->mutex);
+	lf->stopping = 1;
+	pthread_cond_signal(&lf->wake);
+	pthread_mutex_unlock(&lf->mutex);
+	pthread_join(lf->thread, NULL);
+	lazy_fetch = NULL;
+
+	oid_array_clear(&lf->pending);
+	oidset_clear(&lf->pending_set);
+	oidset_clear(&lf->in_flight);
+	pthread_cond_destroy(&lf->fetched);
+	pthread_cond_destroy(&lf->wake);
+	pthread_mutex_destroy(&lf->mutex);
+	free(lf->remote_name);
+	free(lf);
+}
+
+/*
+ * Make sure "oid" is part of a batch and return the number of the batch,
+ * counting those already taken. Must be called with the mutex held.
+ */
+static unsigned long lazy_fetch_add(struct lazy_fetch *lf,
+				    const struct object_id *oid)
+{
+	if (oidset_contains(&lf->in_flight, oid))
+		return lf->taken;
+	if (!oidset_insert(&lf->pending_set, oid)) {
+		oid_array_append(&lf->pending, oid);
+		pthread_cond_signal(&lf->wake);
+	}
+	return lf->taken + 1;
+}
+
+int promisor_remote_get_batched(struct repository *repo,
+				const struct object_id *oid)
+{
+	struct lazy_fetch *lf = lazy_fetch;
+	unsigned long batch;
+
+	if (!lf || lf->repo != repo)
+		return -1;
+
+	pthread_mutex_lock(&lf->mutex);
+	batch = lazy_fetch_add(lf, oid);
+	while (lf->done < batch)
+		pthread_cond_wait(&lf->fetched, &lf->mutex);
+	pthread_mutex_unlock(&lf->mutex);
+	return 0;
+}
+
+void promisor_remote_queue(struct repository *repo,
+			   const struct object_id *oid)
+{
+	struct lazy_fetch *lf = lazy_fetch;
+
+	if (!lf || lf->repo != repo ||
+	    odb_has_object(repo->objects, oid, 0))
+		return;
+
+	pthread_mutex_lock(&lf->mutex);
+	lazy_fetch_add(lf, oid);
+	pthread_mutex_unlock(&lf->mutex);
+}
+
 static int allow_unsanitized(char ch)
 {
 	if (ch == ',' || ch == ';' || ch == '%')
@@ -3,6 +3,7 @@
 
 #include "repository.h"
 
+struct child_process;
 struct object_id;
 
 /*
@@ -34,6 +35,44 @@ void promisor_remote_get_direct(struct repository *repo,
 				const struct object_id *oids,
 				int oid_nr);
 
+/*
+ * Set up "child" to run the "git fetch" that promisor_remote_get_direct()
+ * runs to fetch the objects whose ids it reads from its standard input,
+ * one per line, from the promisor remote "remote_name".
+ */
+void promisor_remote_fetch_command(struct repository *repo,
+				   const char *remote_name, int quiet,
+				   struct child_process *child);
+
+/*
+ * While batching is started, objects that reads find missing are not
+ * fetched one subprocess each: a background thread collects them, along
+ * with those queued ahead of time by promisor_remote_queue(), and fetches
+ * each batch from the first promisor remote in one go. Threads that miss
+ * an object wait for the batch holding it, letting the others keep
+ * reading (and add to the next batch) meanwhile.
+ *
+ * Starting is a no-op without threads support or promisor remotes, and
+ * calls nest: batching stops at the last promisor_remote_stop_batching().
+ */
+void promisor_remote_start_batching(struct repository *repo);
+void promisor_remote_stop_batching(void);
+
+/*
+ * Fetch "oid" in the next batch, or the one in flight if it holds it,
+ * and return 0 once that batch is done, whether or not the object came
+ * with it. Return -1 without waiting when batching is not running.
+ */
+int promisor_remote_get_batched(struct repository *repo,
+				const struct object_id *oid);
+
+/*
+ * Add "oid" to the next batch unless it is present, without waiting for
+ * it, for a caller that knows it will soon read the object.
+ */
+void promisor_remote_queue(struct repository *repo,
+			   const struct object_id *oid);
+
 /*
  * Prepare a "promisor-remote" advertisement by a server.
  * Check the value of "promisor.advertise" and maybe the configured
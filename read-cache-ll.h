@@ -180,6 +180,7 @@ struct index_state {
 	enum sparse_index_mode sparse_index;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
+	unsigned int unhashed_lookups; /* see index_file_exists() */
 	struct object_id oid;
 	struct untracked_cache *untracked;
 	char *fsmonitor_last_update;
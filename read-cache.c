@@ -2171,6 +2171,71 @@ static unsigned long load_cache_entries_threaded(struct index_state *istate, con
 	return consumed;
 }
 
+/*
+ * Entries in a version 2 or 3 index are not prefix-compressed, so the
+ * size of each one follows from its flags (and, for overlong names, the
+ * terminating NUL) without decoding it.  This lets us split an index
+ * that was written without the IEOT extension (by another
+ * implementation, or with index.recordOffsetTable disabled) into
+ * blocks for load_cache_entries_threaded(), and also tells us where the
+ * extensions start.  Returns NULL if the entries look malformed, in
+ * which case the caller falls back to loading them sequentially.
+ */
+static struct index_entry_offset_table *scan_ieot(const char *mmap, size_t mmap_size,
+						  unsigned int entries, int nr_blocks,
+						  size_t *extension_offset)
+{
+	const size_t flags_offset = offsetof(struct ondisk_cache_entry, data) +
+				    the_hash_algo->rawsz;
+	const size_t limit = mmap_size - the_hash_algo->rawsz;
+	size_t offset = sizeof(struct cache_header);
+	unsigned int per_block;
+	struct index_entry_offset_table *ieot;
+
+	if (!entries || nr_blocks < 1)
+		return NULL;
+	per_block = DIV_ROUND_UP(entries, nr_blocks);
+
+	ieot = xcalloc(1, sizeof(struct index_entry_offset_table)
+		       + (nr_blocks * sizeof(struct index_entry_offset)));
+	for (unsigned int i = 0; i < entries; i++) {
+		unsigned int flags;
+		size_t len;
+		const char *name;
+
+		if (!(i % per_block)) {
+			if (offset > INT_MAX)
+				goto malformed;
+			ieot->entries[ieot->nr++].offset = offset;
+		}
+		ieot->entries[ieot->nr - 1].nr++;
+
+		if (offset + flags_offset + 2 * sizeof(uint16_t) > limit)
+			goto malformed;
+		flags = get_be16(mmap + offset + flags_offset);
+		name = mmap + offset + flags_offset +
+		       ((flags & CE_EXTENDED) ? 2 : 1) * sizeof(uint16_t);
+		len = flags & CE_NAMEMASK;
+		if (len == CE_NAMEMASK) {
+			const char *nul = memchr(name, '\0', mmap + limit - name);
+			if (!nul)
+				goto malformed;
+			len = nul - name;
+		}
+
+		offset += ondisk_cache_entry_size(ondisk_data_size(flags, len));
+		if (offset > limit)
+			goto malformed;
+	}
+
+	*extension_offset = offset;
+	return ieot;
+
+malformed:
+	free(ieot);
+	return NULL;
+}
+
 static void set_new_index_sparsity(struct index_state *istate)
 {
 	/*
@@ -2259,6 +2324,20 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 
 	if (nr_threads > 1) {
 		extension_offset = read_eoie_extension(mmap, mmap_size);
+
+		/*
+		 * Without EOIE (and hence IEOT), find the block boundaries
+		 * and the start of the extensions ourselves, leaving one
+		 * thread for the extensions.
+		 */
+		if (!extension_offset && istate->version != 4) {
+			ieot = scan_ieot(mmap, mmap_size, istate->cache_nr,
+					 nr_threads - 1, &extension_offset);
+			if (ieot)
+				trace2_data_intmax("index", the_repository,
+						   "read/scanned_blocks", ieot->nr);
+		}
+
 		if (extension_offset) {
 			int err;
 
@@ -2275,8 +2354,10 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	 * Locate and read the index entry offset table so that we can use it
 	 * to multi-thread the reading of the cache entries.
 	 */
-	if (extension_offset && nr_threads > 1)
+	if (extension_offset && nr_threads > 1 && !ieot)
 		ieot = read_ieot_extension(mmap, mmap_size, extension_offset);
+	if (ieot && nr_threads < 2)
+		FREE_AND_NULL(ieot);
 
 	if (ieot) {
 		src_offset += load_cache_entries_threaded(istate, mmap, mmap_size, nr_threads, ieot);
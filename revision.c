@@ -652,6 +652,8 @@ static unsigned int count_bloom_filter_maybe;
 static unsigned int count_bloom_filter_definitely_not;
 static unsigned int count_bloom_filter_false_positive;
 static unsigned int count_bloom_filter_not_present;
+static unsigned int count_path_index_definitely_not;
+static unsigned int count_path_index_changed;
 
 static void trace2_bloom_filter_statistics_atexit(void)
 {
@@ -662,6 +664,8 @@ static void trace2_bloom_filter_statistics_atexit(void)
 	jw_object_intmax(&jw, "maybe", count_bloom_filter_maybe);
 	jw_object_intmax(&jw, "definitely_not", count_bloom_filter_definitely_not);
 	jw_object_intmax(&jw, "false_positive", count_bloom_filter_false_positive);
+	jw_object_intmax(&jw, "index_definitely_not", count_path_index_definitely_not);
+	jw_object_intmax(&jw, "index_changed", count_path_index_changed);
 	jw_end(&jw);
 
 	trace2_data_json("bloom", the_repository, "statistics", &jw);
@@ -690,6 +694,8 @@ static int forbid_bloom_filters(struct pathspec *spec)
 static void release_revisions_bloom_keyvecs(struct rev_info *revs);
 
 static int convert_pathspec_to_bloom_keyvec(struct bloom_keyvec **out,
+					    struct commit_graph_path_query **query,
+					    struct repository *r,
 					    const struct pathspec_item *pi,
 					    const struct bloom_filter_settings *settings)
 {
@@ -722,6 +728,7 @@ static int convert_pathspec_to_bloom_keyvec(struct bloom_keyvec **out,
 		path = pi->match;
 
 	*out = bloom_keyvec_new(path, len, settings);
+	*query = commit_graph_path_query_new(r, path);
 
 	res = 0;
 cleanup:
@@ -748,14 +755,35 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 
 	revs->bloom_keyvecs_nr = revs->pruning.pathspec.nr;
 	CALLOC_ARRAY(revs->bloom_keyvecs, revs->bloom_keyvecs_nr);
+	CALLOC_ARRAY(revs->path_queries, revs->bloom_keyvecs_nr);
+
+	/*
+	 * When the pathspec is nothing but literal paths, a commit the
+	 * history index says changed one of them is !TREESAME without
+	 * looking at its tree. Only --remove-empty needs to know more.
+	 */
+	revs->path_queries_exact = !revs->remove_empty_trees &&
+		!(revs->pruning.pathspec.magic & (PATHSPEC_ATTR | PATHSPEC_MAXDEPTH));
 
 	for (int i = 0; i < revs->pruning.pathspec.nr; i++) {
+		const struct pathspec_item *pi = &revs->pruning.pathspec.items[i];
+
 		if (convert_pathspec_to_bloom_keyvec(&revs->bloom_keyvecs[i],
-						     &revs->pruning.pathspec.items[i],
+						     &revs->path_queries[i],
+						     revs->repo, pi,
 						     revs->bloom_filter_settings))
 			goto fail;
+		if (!revs->path_queries[i])
+			revs->path_queries_exact = 0;
+		if (pi->nowildcard_len != pi->len || pi->match[pi->len - 1] == '/' ||
+		    pi->magic & (PATHSPEC_ATTR | PATHSPEC_MAXDEPTH))
+			revs->path_queries_exact = 0;
 	}
 
+	revs->bloom_probe = bloom_probe_new(revs->bloom_keyvecs,
+					    revs->bloom_keyvecs_nr,
+					    revs->bloom_filter_settings);
+
 	if (trace2_is_enabled() && !bloom_filter_atexit_registered) {
 		atexit(trace2_bloom_filter_statistics_atexit);
 		bloom_filter_atexit_registered = 1;
@@ -768,6 +796,36 @@ static void prepare_to_use_bloom_filter(struct rev_info *revs)
 	release_revisions_bloom_keyvecs(revs);
 }
 
+/*
+ * Ask the changed-path history index about "commit" once its Bloom filter
+ * said that it may have changed the pathspec. Returns 0 if it did not
+ * change any of the paths, 2 if it did and revs->path_queries_exact
+ * allows to take that for an answer, and 1 otherwise.
+ */
+static int check_path_index(struct rev_info *revs, struct commit *commit)
+{
+	int result = 0;
+
+	for (size_t nr = 0; nr < revs->bloom_keyvecs_nr; nr++) {
+		int changed;
+
+		if (!revs->path_queries[nr])
+			return 1;
+		changed = commit_graph_path_query_changed(revs->path_queries[nr],
+							  commit);
+		if (changed > 0) {
+			count_path_index_changed++;
+			return revs->path_queries_exact ? 2 : 1;
+		}
+		if (changed < 0)
+			result = 1;
+	}
+
+	if (!result)
+		count_path_index_definitely_not++;
+	return result;
+}
+
 static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 						 struct commit *commit)
 {
@@ -787,17 +845,16 @@ static int check_maybe_different_in_bloom_filter(struct rev_info *revs,
 		return -1;
 	}
 
-	for (size_t nr = 0; !result && nr < revs->bloom_keyvecs_nr; nr++) {
-		result = bloom_filter_contains_vec(filter,
-						   revs->bloom_keyvecs[nr],
-						   revs->bloom_filter_settings);
-	}
+	result = bloom_filter_contains_probe(filter, revs->bloom_probe);
 
 	if (result)
 		count_bloom_filter_maybe++;
 	else
 		count_bloom_filter_definitely_not++;
 
+	if (result)
+		result = check_path_index(revs, commit);
+
 	return result;
 }
 
@@ -836,6 +893,8 @@ static int rev_compare_tree(struct rev_info *revs,
 
 		if (bloom_ret == 0)
 			return REV_TREE_SAME;
+		if (bloom_ret == 2)
+			return REV_TREE_DIFFERENT;
 	}
 
 	tree_difference = REV_TREE_SAME;
@@ -862,6 +921,8 @@ static int rev_same_tree_as_empty(struct rev_info *revs, struct commit *commit,
 		bloom_ret = check_maybe_different_in_bloom_filter(revs, commit);
 		if (!bloom_ret)
 			return 1;
+		if (bloom_ret == 2)
+			return 0;
 	}
 
 	tree_difference = REV_TREE_SAME;
@@ -3198,9 +3259,15 @@ static void release_revisions_topo_walk_info(struct topo_walk_info *info);
 
 static void release_revisions_bloom_keyvecs(struct rev_info *revs)
 {
-	for (size_t nr = 0; nr < revs->bloom_keyvecs_nr; nr++)
+	for (size_t nr = 0; nr < revs->bloom_keyvecs_nr; nr++) {
 		bloom_keyvec_free(revs->bloom_keyvecs[nr]);
+		if (revs->path_queries)
+			commit_graph_path_query_free(revs->path_queries[nr]);
+	}
 	FREE_AND_NULL(revs->bloom_keyvecs);
+	FREE_AND_NULL(revs->path_queries);
+	bloom_probe_free(revs->bloom_probe);
+	revs->bloom_probe = NULL;
 	revs->bloom_keyvecs_nr = 0;
 }
 
@@ -4024,6 +4091,36 @@ int rewrite_parents(struct rev_info *revs, struct commit *commit,
 	return 0;
 }
 
+/*
+ * When only the author and committer are grepped for, match against the
+ * idents the commit-graph has for "commit" instead of reading it. The
+ * dates are made up, as the patterns are not matched against them.
+ * Returns -1 if the full commit is needed.
+ */
+static int commit_match_graph_idents(struct commit *commit, struct rev_info *opt)
+{
+	struct commit_graph_idents idents;
+	struct strbuf buf = STRBUF_INIT;
+	int retval;
+
+	if (opt->grep_filter.pattern_list || opt->grep_filter.use_reflog_filter ||
+	    !is_encoding_utf8(get_log_output_encoding()) ||
+	    repo_commit_graph_idents(opt->repo, commit, &idents))
+		return -1;
+
+	strbuf_addf(&buf, "author %s 0 +0000\ncommitter %s 0 +0000\n\n",
+		    idents.author, idents.committer);
+	if (opt->mailmap) {
+		const char *commit_headers[] = { "author ", "committer ", NULL };
+
+		apply_mailmap_to_header(&buf, commit_headers, opt->mailmap);
+	}
+
+	retval = grep_buffer(&opt->grep_filter, buf.buf, buf.len);
+	strbuf_release(&buf);
+	return retval;
+}
+
 static int commit_match(struct commit *commit, struct rev_info *opt)
 {
 	int retval;
@@ -4034,6 +4131,10 @@ static int commit_match(struct commit *commit, struct rev_info *opt)
 	if (!opt->grep_filter.pattern_list && !opt->grep_filter.header_list)
 		return 1;
 
+	retval = commit_match_graph_idents(commit, opt);
+	if (retval >= 0)
+		return retval;
+
 	/* Prepend "fake" headers as needed */
 	if (opt->grep_filter.use_reflog_filter) {
 		strbuf_addstr(&buf, "reflog ");
@@ -63,7 +63,9 @@ struct rev_info;
 struct string_list;
 struct saved_parents;
 struct bloom_keyvec;
+struct bloom_probe;
 struct bloom_filter_settings;
+struct commit_graph_path_query;
 struct option;
 struct parse_opt_ctx_t;
 define_shared_commit_slab(revision_sources, char *);
@@ -360,6 +362,8 @@ struct rev_info {
 	/* The bloom filter key(s) for the pathspec */
 	struct bloom_keyvec **bloom_keyvecs;
 	int bloom_keyvecs_nr;
+	/* the same keys, as tested against each commit's filter */
+	struct bloom_probe *bloom_probe;
 
 	/*
 	 * The bloom filter settings used to generate the key.
@@ -367,6 +371,14 @@ struct rev_info {
 	 */
 	struct bloom_filter_settings *bloom_filter_settings;
 
+	/*
+	 * The commit-graph history index lookups for the same paths as
+	 * the bloom filter keys, if it has one, and whether what they say
+	 * is exactly what the pathspec asks for.
+	 */
+	struct commit_graph_path_query **path_queries;
+	int path_queries_exact;
+
 	/* misc. flags related to '--no-kept-objects' */
 	unsigned keep_pack_cache_flags;
 
@@ -1485,13 +1485,17 @@ struct parallel_processes {
 		enum child_state state;
 		struct child_process process;
 		struct strbuf err;
+		struct strbuf out; /* with opts->task_stdout */
 		void *data;
 	} *children;
 	/*
 	 * The struct pollfd is logically part of *children,
 	 * but the system call expects it as its own array.
+	 * With opts->task_stdout, the second half of it is for
+	 * the standard output of the children.
 	 */
 	struct pollfd *pfd;
+	size_t nr_pfd;
 
 	unsigned shutdown : 1;
 
@@ -1542,18 +1546,25 @@ static void pp_init(struct parallel_processes *pp,
 
 	if (!opts->get_next_task)
 		BUG("you need to specify a get_next_task function");
+	if (opts->ungroup && opts->hold_output)
+		BUG("ungroup and hold_output are incompatible");
+	if (opts->ungroup && opts->task_stdout)
+		BUG("ungroup and task_stdout are incompatible");
 
 	CALLOC_ARRAY(pp->children, n);
-	if (!opts->ungroup)
-		CALLOC_ARRAY(pp->pfd, n);
+	if (!opts->ungroup) {
+		pp->nr_pfd = opts->task_stdout ? st_mult(n, 2) : n;
+		CALLOC_ARRAY(pp->pfd, pp->nr_pfd);
+	}
 
 	for (size_t i = 0; i < n; i++) {
 		strbuf_init(&pp->children[i].err, 0);
+		strbuf_init(&pp->children[i].out, 0);
 		child_process_init(&pp->children[i].process);
-		if (pp->pfd) {
-			pp->pfd[i].events = POLLIN | POLLHUP;
-			pp->pfd[i].fd = -1;
-		}
+	}
+	for (size_t i = 0; i < pp->nr_pfd; i++) {
+		pp->pfd[i].events = POLLIN | POLLHUP;
+		pp->pfd[i].fd = -1;
 	}
 
 	pp_sig->pp = pp;
@@ -1568,6 +1579,7 @@ static void pp_cleanup(struct parallel_processes *pp,
 	trace_printf("run_processes_parallel: done");
 	for (size_t i = 0; i < opts->processes; i++) {
 		strbuf_release(&pp->children[i].err);
+		strbuf_release(&pp->children[i].out);
 		child_process_clear(&pp->children[i].process);
 	}
 
@@ -1624,7 +1636,10 @@ static int pp_start_one(struct parallel_processes *pp,
 	}
 	if (!opts->ungroup) {
 		pp->children[i].process.err = -1;
-		pp->children[i].process.stdout_to_stderr = 1;
+		if (opts->task_stdout)
+			pp->children[i].process.out = -1;
+		else
+			pp->children[i].process.stdout_to_stderr = 1;
 	}
 
 	if (start_command(&pp->children[i].process)) {
@@ -1649,14 +1664,36 @@ static int pp_start_one(struct parallel_processes *pp,
 	pp->children[i].state = GIT_CP_WORKING;
 	if (pp->pfd)
 		pp->pfd[i].fd = pp->children[i].process.err;
+	if (opts->task_stdout)
+		pp->pfd[opts->processes + i].fd = pp->children[i].process.out;
 	return 0;
 }
 
+/*
+ * Read what is there from one of the pipes of a child, and close it
+ * (and stop polling it) at EOF.
+ */
+static void pp_buffer_pipe(struct pollfd *pfd, struct strbuf *buf)
+{
+	int n;
+
+	if (pfd->fd < 0 || !(pfd->revents & (POLLIN | POLLHUP)))
+		return;
+	n = strbuf_read_once(buf, pfd->fd, 0);
+	if (n == 0) {
+		close(pfd->fd);
+		pfd->fd = -1;
+	} else if (n < 0) {
+		if (errno != EAGAIN)
+			die_errno("read");
+	}
+}
+
 static void pp_buffer_stderr(struct parallel_processes *pp,
 			     const struct run_process_parallel_opts *opts,
 			     int output_timeout)
 {
-	while (poll(pp->pfd, opts->processes, output_timeout) < 0) {
+	while (poll(pp->pfd, pp->nr_pfd, output_timeout) < 0) {
 		if (errno == EINTR)
 			continue;
 		pp_cleanup(pp, opts);
@@ -1665,17 +1702,17 @@ static void pp_buffer_stderr(struct parallel_processes *pp,
 
 	/* Buffer output from all pipes. */
 	for (size_t i = 0; i < opts->processes; i++) {
-		if (pp->children[i].state == GIT_CP_WORKING &&
-		    pp->pfd[i].revents & (POLLIN | POLLHUP)) {
-			int n = strbuf_read_once(&pp->children[i].err,
-						 pp->children[i].process.err, 0);
-			if (n == 0) {
-				close(pp->children[i].process.err);
-				pp->children[i].state = GIT_CP_WAIT_CLEANUP;
-			} else if (n < 0)
-				if (errno != EAGAIN)
-					die_errno("read");
+		struct pollfd *out_pfd = NULL;
+
+		if (pp->children[i].state != GIT_CP_WORKING)
+			continue;
+		pp_buffer_pipe(&pp->pfd[i], &pp->children[i].err);
+		if (opts->task_stdout) {
+			out_pfd = &pp->pfd[opts->processes + i];
+			pp_buffer_pipe(out_pfd, &pp->children[i].out);
 		}
+		if (pp->pfd[i].fd < 0 && (!out_pfd || out_pfd->fd < 0))
+			pp->children[i].state = GIT_CP_WAIT_CLEANUP;
 	}
 }
 
@@ -1706,6 +1743,11 @@ static int pp_collect_finished(struct parallel_processes *pp,
 
 		code = finish_command(&pp->children[i].process);
 
+		if (opts->task_stdout) {
+			opts->task_stdout(&pp->children[i].out, opts->data,
+					  pp->children[i].data);
+			strbuf_reset(&pp->children[i].out);
+		}
 		if (opts->task_finished)
 			code = opts->task_finished(code, opts->ungroup ? NULL :
 						   &pp->children[i].err, opts->data,
@@ -1797,7 +1839,8 @@ void run_processes_parallel(const struct run_process_parallel_opts *opts)
 				pp.children[i].state = GIT_CP_WAIT_CLEANUP;
 		} else {
 			pp_buffer_stderr(&pp, opts, output_timeout);
-			pp_output(&pp);
+			if (!opts->hold_output)
+				pp_output(&pp);
 		}
 		code = pp_collect_finished(&pp, opts);
 		if (code) {
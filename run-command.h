@@ -438,6 +438,21 @@ typedef int (*task_finished_fn)(int result,
 				void *pp_cb,
 				void *pp_task_cb);
 
+/**
+ * This callback is called on every child process that finished
+ * processing, right before task_finished_fn, when the standard output
+ * of the children is collected on its own (see "task_stdout" below).
+ *
+ * "child_out" holds everything the child wrote to its standard output;
+ * the callback may do with it whatever it likes.
+ *
+ * pp_cb is the callback cookie as passed into run_processes_parallel,
+ * pp_task_cb is the callback cookie as passed into get_next_task_fn.
+ */
+typedef void (*task_stdout_fn)(struct strbuf *child_out,
+			       void *pp_cb,
+			       void *pp_task_cb);
+
 /**
  * Option used by run_processes_parallel(), { 0 }-initialized means no
  * options.
@@ -461,6 +476,14 @@ struct run_process_parallel_opts
 	 */
 	unsigned int ungroup:1;
 
+	/**
+	 * hold_output: if set, the output of a child is not shown while
+	 * it runs. The task_finished callback gets to see all of it in
+	 * its "out" parameter, and may consume it, before what is left
+	 * is shown. Incompatible with "ungroup".
+	 */
+	unsigned int hold_output:1;
+
 	/**
 	 * get_next_task: See get_next_task_fn() above. This must be
 	 * specified.
@@ -479,6 +502,14 @@ struct run_process_parallel_opts
 	 */
 	task_finished_fn task_finished;
 
+	/**
+	 * task_stdout: See task_stdout_fn() above. If set, the standard
+	 * output of the children is not sent to stderr with the rest of
+	 * their output, but collected and handed to this callback.
+	 * Incompatible with "ungroup".
+	 */
+	task_stdout_fn task_stdout;
+
 	/**
 	 * data: user data, will be passed as "pp_cb" to the callback
 	 * parameters.
@@ -495,7 +526,8 @@ struct run_process_parallel_opts
  *
  * The children started via this function run in parallel. Their output
  * (both stdout and stderr) is routed to stderr in a manner that output
- * from different tasks does not interleave (but see "ungroup" below).
+ * from different tasks does not interleave (but see "ungroup" and
+ * "task_stdout" below).
  *
  * If the "ungroup" option isn't specified, the API will set the
  * "stdout_to_stderr" parameter in "struct child_process" and provide
@@ -266,6 +266,7 @@ void send_sideband(int fd, int band, const char *data, ssize_t sz, int packet_ma
 	while (sz) {
 		unsigned n;
 		char hdr[5];
+		struct iovec iov[2];
 
 		n = sz;
 		if (packet_max - 5 < n)
@@ -273,12 +274,15 @@ void send_sideband(int fd, int band, const char *data, ssize_t sz, int packet_ma
 		if (0 <= band) {
 			xsnprintf(hdr, sizeof(hdr), "%04x", n + 5);
 			hdr[4] = band;
-			write_or_die(fd, hdr, 5);
+			iov[0].iov_len = 5;
 		} else {
 			xsnprintf(hdr, sizeof(hdr), "%04x", n + 4);
-			write_or_die(fd, hdr, 4);
+			iov[0].iov_len = 4;
 		}
-		write_or_die(fd, p, n);
+		iov[0].iov_base = hdr;
+		iov[1].iov_base = (char *)p;
+		iov[1].iov_len = n;
+		writev_or_die(fd, iov, 2);
 		p += n;
 		sz -= n;
 	}
@@ -1869,14 +1869,16 @@ int fetch_submodules(struct repository *r,
 	return spf.result;
 }
 
-unsigned is_submodule_modified(const char *path, int ignore_untracked)
+/*
+ * Prepare "cp" to run "git status --porcelain=2" in the submodule at
+ * "path".  Returns 0 if the submodule is not checked out, in which case
+ * it is not modified either.
+ */
+static int prepare_submodule_status(struct child_process *cp,
+				    const char *path, int ignore_untracked)
 {
-	struct child_process cp = CHILD_PROCESS_INIT;
 	struct strbuf buf = STRBUF_INIT;
-	FILE *fp;
-	unsigned dirty_submodule = 0;
 	const char *git_dir;
-	int ignore_cp_exit_code = 0;
 
 	if (validate_submodule_path(path) < 0)
 		exit(128);
@@ -1889,47 +1891,74 @@ unsigned is_submodule_modified(const char *path, int ignore_untracked)
 		if (is_directory(git_dir))
 			die(_("'%s' not recognized as a git repository"), git_dir);
 		strbuf_release(&buf);
-		/* The submodule is not checked out, so it is not modified */
 		return 0;
 	}
-	strbuf_reset(&buf);
+	strbuf_release(&buf);
 
-	strvec_pushl(&cp.args, "status", "--porcelain=2", NULL);
+	strvec_pushl(&cp->args, "status", "--porcelain=2", NULL);
 	if (ignore_untracked)
-		strvec_push(&cp.args, "-uno");
+		strvec_push(&cp->args, "-uno");
+
+	prepare_submodule_repo_env(&cp->env);
+	cp->git_cmd = 1;
+	cp->no_stdin = 1;
+	cp->dir = path;
+	return 1;
+}
+
+/*
+ * Return the DIRTY_SUBMODULE_* bits implied by one line of
+ * "git status --porcelain=2" output.
+ */
+static unsigned parse_submodule_status_line(const struct strbuf *buf)
+{
+	unsigned dirty_submodule = 0;
+
+	/* regular untracked files */
+	if (buf->buf[0] == '?')
+		dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
+
+	if (buf->buf[0] == 'u' ||
+	    buf->buf[0] == '1' ||
+	    buf->buf[0] == '2') {
+		/* T = line type, XY = status, SSSS = submodule state */
+		if (buf->len < strlen("T XY SSSS"))
+			BUG("invalid status --porcelain=2 line %s",
+			    buf->buf);
+
+		if (buf->buf[5] == 'S' && buf->buf[8] == 'U')
+			/* nested untracked file */
+			dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
+
+		if (buf->buf[0] == 'u' ||
+		    buf->buf[0] == '2' ||
+		    memcmp(buf->buf + 5, "S..U", 4))
+			/* other change */
+			dirty_submodule |= DIRTY_SUBMODULE_MODIFIED;
+	}
+
+	return dirty_submodule;
+}
+
+unsigned is_submodule_modified(const char *path, int ignore_untracked)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+	struct strbuf buf = STRBUF_INIT;
+	FILE *fp;
+	unsigned dirty_submodule = 0;
+	int ignore_cp_exit_code = 0;
+
+	if (!prepare_submodule_status(&cp, path, ignore_untracked))
+		/* The submodule is not checked out, so it is not modified */
+		return 0;
 
-	prepare_submodule_repo_env(&cp.env);
-	cp.git_cmd = 1;
-	cp.no_stdin = 1;
 	cp.out = -1;
-	cp.dir = path;
 	if (start_command(&cp))
 		die(_("Could not run 'git status --porcelain=2' in submodule %s"), path);
 
 	fp = xfdopen(cp.out, "r");
 	while (strbuf_getwholeline(&buf, fp, '\n') != EOF) {
-		/* regular untracked files */
-		if (buf.buf[0] == '?')
-			dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
-
-		if (buf.buf[0] == 'u' ||
-		    buf.buf[0] == '1' ||
-		    buf.buf[0] == '2') {
-			/* T = line type, XY = status, SSSS = submodule state */
-			if (buf.len < strlen("T XY SSSS"))
-				BUG("invalid status --porcelain=2 line %s",
-				    buf.buf);
-
-			if (buf.buf[5] == 'S' && buf.buf[8] == 'U')
-				/* nested untracked file */
-				dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
-
-			if (buf.buf[0] == 'u' ||
-			    buf.buf[0] == '2' ||
-			    memcmp(buf.buf + 5, "S..U", 4))
-				/* other change */
-				dirty_submodule |= DIRTY_SUBMODULE_MODIFIED;
-		}
+		dirty_submodule |= parse_submodule_status_line(&buf);
 
 		if ((dirty_submodule & DIRTY_SUBMODULE_MODIFIED) &&
 		    ((dirty_submodule & DIRTY_SUBMODULE_UNTRACKED) ||
@@ -1951,6 +1980,97 @@ unsigned is_submodule_modified(const char *path, int ignore_untracked)
 	return dirty_submodule;
 }
 
+struct submodule_status_parallel {
+	struct string_list *submodules;
+	size_t next;
+	const char *failed;
+};
+
+static int get_next_submodule_status(struct child_process *cp,
+				     struct strbuf *err UNUSED,
+				     void *data, void **task_cb)
+{
+	struct submodule_status_parallel *sps = data;
+
+	while (sps->next < sps->submodules->nr) {
+		struct string_list_item *item =
+			&sps->submodules->items[sps->next++];
+		struct submodule_status *status = item->util;
+
+		status->dirty_submodule = 0;
+		if (prepare_submodule_status(cp, item->string,
+					     status->ignore_untracked)) {
+			*task_cb = item;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int start_submodule_status_failed(struct strbuf *err UNUSED,
+					 void *data, void *task_cb)
+{
+	struct submodule_status_parallel *sps = data;
+	struct string_list_item *item = task_cb;
+
+	sps->failed = item->string;
+	return 1;
+}
+
+static void submodule_status_stdout(struct strbuf *child_out,
+				    void *data UNUSED, void *task_cb)
+{
+	struct string_list_item *item = task_cb;
+	struct submodule_status *status = item->util;
+	struct strbuf line = STRBUF_INIT;
+	const char *p = child_out->buf;
+
+	while (*p) {
+		const char *eol = strchrnul(p, '\n');
+
+		strbuf_reset(&line);
+		strbuf_add(&line, p, eol - p);
+		status->dirty_submodule |= parse_submodule_status_line(&line);
+		p = *eol ? eol + 1 : eol;
+	}
+	strbuf_release(&line);
+}
+
+static int submodule_status_finished(int result, struct strbuf *out UNUSED,
+				     void *data, void *task_cb)
+{
+	struct submodule_status_parallel *sps = data;
+	struct string_list_item *item = task_cb;
+
+	if (result && !sps->failed)
+		sps->failed = item->string;
+	return 0;
+}
+
+void get_submodules_modified(struct string_list *submodules, int max_jobs)
+{
+	struct submodule_status_parallel sps = {
+		.submodules = submodules,
+	};
+	const struct run_process_parallel_opts opts = {
+		.tr2_category = "submodule",
+		.tr2_label = "parallel/status",
+
+		.processes = max_jobs,
+
+		.get_next_task = get_next_submodule_status,
+		.start_failure = start_submodule_status_failed,
+		.task_stdout = submodule_status_stdout,
+		.task_finished = submodule_status_finished,
+		.data = &sps,
+	};
+
+	run_processes_parallel(&opts);
+	if (sps.failed)
+		die(_("'git status --porcelain=2' failed in submodule %s"),
+		    sps.failed);
+}
+
 int submodule_uses_gitfile(const char *path)
 {
 	struct child_process cp = CHILD_PROCESS_INIT;
@@ -97,6 +97,19 @@ int fetch_submodules(struct repository *r,
 		     int default_option,
 		     int quiet, int max_parallel_jobs);
 unsigned is_submodule_modified(const char *path, int ignore_untracked);
+
+struct submodule_status {
+	unsigned ignore_untracked : 1;
+	unsigned dirty_submodule;
+};
+
+/*
+ * Like is_submodule_modified(), but for all submodules at once, running
+ * up to "max_jobs" "git status" processes in parallel.  The util field
+ * of each item must point to a "struct submodule_status", whose
+ * dirty_submodule gets filled in.
+ */
+void get_submodules_modified(struct string_list *submodules, int max_jobs);
 int submodule_uses_gitfile(const char *path);
 
 #define SUBMODULE_REMOVAL_DIE_ON_ERROR (1<<0)
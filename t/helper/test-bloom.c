@@ -6,6 +6,8 @@
 #include "commit.h"
 #include "repository.h"
 #include "setup.h"
+#include "strbuf.h"
+#include "trace.h"
 
 static struct bloom_filter_settings settings = DEFAULT_BLOOM_FILTER_SETTINGS;
 
@@ -44,11 +46,102 @@ static void get_bloom_filter_for_commit(const struct object_id *commit_oid)
 	print_bloom_filter(filter);
 }
 
+/*
+ * Test NR_BENCH_FILTERS pseudo-random filters against the keys of the
+ * given paths, one vector at a time and with a bloom_probe, and report
+ * how many of them matched and how long each way took.
+ */
+#define NR_BENCH_FILTERS 1024
+
+static uint32_t bench_random(uint32_t *state)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+static void bench_probes(int rounds, const char **paths, int nr_paths)
+{
+	struct bloom_keyvec **vecs;
+	struct bloom_probe *probe;
+	struct bloom_filter *filters;
+	struct strbuf buf = STRBUF_INIT;
+	uint32_t state = 1;
+	uint64_t start, scalar_ns, batched_ns;
+	size_t scalar_matches = 0, batched_matches = 0;
+
+	ALLOC_ARRAY(vecs, nr_paths);
+	for (int i = 0; i < nr_paths; i++)
+		vecs[i] = bloom_keyvec_new(paths[i], strlen(paths[i]),
+					   &settings);
+	probe = bloom_probe_new(vecs, nr_paths, &settings);
+
+	CALLOC_ARRAY(filters, NR_BENCH_FILTERS);
+	for (int i = 0; i < NR_BENCH_FILTERS; i++) {
+		size_t nr_entries = 1 + bench_random(&state) % 64;
+
+		filters[i].len = (nr_entries * settings.bits_per_entry +
+				  BITS_PER_WORD - 1) / BITS_PER_WORD;
+		CALLOC_ARRAY(filters[i].data, filters[i].len);
+		for (size_t j = 0; j < nr_entries; j++) {
+			struct bloom_key key;
+
+			/* let some of the filters contain the paths */
+			strbuf_reset(&buf);
+			if (!(bench_random(&state) % 8))
+				strbuf_addstr(&buf, paths[bench_random(&state) % nr_paths]);
+			else
+				strbuf_addf(&buf, "dir%u/file%u",
+					    bench_random(&state) % 16,
+					    bench_random(&state) % 256);
+			bloom_key_fill(&key, buf.buf, buf.len, &settings);
+			add_key_to_filter(&key, &filters[i], &settings);
+			bloom_key_clear(&key);
+		}
+	}
+
+	start = getnanotime();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < NR_BENCH_FILTERS; i++) {
+			int result = 0;
+
+			for (int v = 0; !result && v < nr_paths; v++)
+				result = bloom_filter_contains_vec(&filters[i],
+								   vecs[v],
+								   &settings);
+			if (result > 0)
+				scalar_matches++;
+		}
+	}
+	scalar_ns = getnanotime() - start;
+
+	start = getnanotime();
+	for (int r = 0; r < rounds; r++)
+		for (int i = 0; i < NR_BENCH_FILTERS; i++)
+			if (bloom_filter_contains_probe(&filters[i], probe) > 0)
+				batched_matches++;
+	batched_ns = getnanotime() - start;
+
+	printf("scalar_matches:%"PRIuMAX"\n", (uintmax_t)scalar_matches);
+	printf("batched_matches:%"PRIuMAX"\n", (uintmax_t)batched_matches);
+	printf("scalar_ns:%"PRIuMAX"\n", (uintmax_t)scalar_ns);
+	printf("batched_ns:%"PRIuMAX"\n", (uintmax_t)batched_ns);
+
+	for (int i = 0; i < NR_BENCH_FILTERS; i++)
+		free(filters[i].data);
+	free(filters);
+	bloom_probe_free(probe);
+	for (int i = 0; i < nr_paths; i++)
+		bloom_keyvec_free(vecs[i]);
+	free(vecs);
+	strbuf_release(&buf);
+}
+
 static const char *const bloom_usage = "\n"
 "  test-tool bloom get_murmur3 <string>\n"
 "  test-tool bloom get_murmur3_seven_highbit\n"
 "  test-tool bloom generate_filter <string> [<string>...]\n"
-"  test-tool bloom get_filter_for_commit <commit-hex>\n";
+"  test-tool bloom get_filter_for_commit <commit-hex>\n"
+"  test-tool bloom bench_probes <rounds> <path>...\n";
 
 int cmd__bloom(int argc, const char **argv)
 {
@@ -100,5 +193,11 @@ int cmd__bloom(int argc, const char **argv)
 		get_bloom_filter_for_commit(&oid);
 	}
 
+	if (!strcmp(argv[1], "bench_probes")) {
+		if (argc < 4)
+			usage(bloom_usage);
+		bench_probes(atoi(argv[2]), argv + 3, argc - 3);
+	}
+
 	return 0;
 }
@@ -72,4 +72,13 @@ test_perf "switch between aliases ($nr_files)" '
 	git checkout -q br_ballast
 '
 
+test_perf "read-tree br_base br_ballast, 4 tree threads ($nr_files)" '
+	git -c checkout.treeReadThreads=4 read-tree -n -m br_base br_ballast
+'
+
+test_perf "switch between br_base br_ballast, 4 tree threads ($nr_files)" '
+	git -c checkout.treeReadThreads=4 checkout -q br_base &&
+	git -c checkout.treeReadThreads=4 checkout -q br_ballast
+'
+
 test_done
@@ -10,4 +10,25 @@ test_perf 'fsck' '
 	git fsck
 '
 
+# Count down from the number of CPUs, halving each time, so that the
+# last test uses all of them.
+test_expect_success 'set up thread-counting tests' '
+	t=$(test-tool online-cpus) &&
+	threads= &&
+	while test $t -gt 0
+	do
+		threads="$t $threads" &&
+		t=$((t / 2)) || return 1
+	done
+'
+
+for t in $threads
+do
+	THREADS=$t
+	export THREADS
+	test_perf "fsck --threads=$t" '
+		git fsck --threads=$THREADS
+	'
+done
+
 test_done
@@ -0,0 +1,32 @@
+#!/bin/sh
+
+test_description='performance of checkout with a long-running process filter'
+. ./perf-lib.sh
+
+test_perf_fresh_repo
+
+test_expect_success 'setup' '
+	git config filter.rot13.process "test-tool rot13-filter --log=/dev/null clean smudge" &&
+	git config filter.rot13.required true &&
+	echo "*.r filter=rot13" >.gitattributes &&
+	mkdir files &&
+	for i in $(test_seq 2000)
+	do
+		echo "content $i" >files/$i.r || return 1
+	done &&
+	git add . &&
+	git commit -q -m files &&
+	git config checkout.thresholdForParallelism 0
+'
+
+test_perf 'checkout with one filter process' '
+	rm -rf files &&
+	git -c checkout.workers=1 checkout -f
+'
+
+test_perf 'checkout with a parallel filter' '
+	rm -rf files &&
+	git -c checkout.workers=4 -c filter.rot13.parallel=true checkout -f
+'
+
+test_done
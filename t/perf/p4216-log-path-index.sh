@@ -0,0 +1,43 @@
+#!/bin/sh
+
+test_description='Tests git log -- <path> with the changed-path history index'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+# Pick a file in a subdirectory to log pseudo-randomly.  The sort key
+# is the blob hash, so it is stable.
+test_expect_success 'select a file' '
+	git ls-tree -r HEAD | grep ^100644 | grep / |
+	sort -k 3 | head -1 | cut -f 2 >filelist
+'
+
+file=$(cat filelist)
+export file
+
+test_expect_success 'write commit-graph with changed-path Bloom filters' '
+	git commit-graph write --reachable --changed-paths
+'
+
+test_perf 'git log -- <file> (Bloom filters)' '
+	git log --oneline -- "$file" >/dev/null
+'
+
+test_perf 'git log -- <dir> (Bloom filters)' '
+	git log --oneline -- "$(dirname "$file")" >/dev/null
+'
+
+test_expect_success 'write commit-graph with the history index' '
+	git -c commitGraph.changedPathsIndex=true \
+		commit-graph write --reachable --changed-paths
+'
+
+test_perf 'git log -- <file> (history index)' '
+	git log --oneline -- "$file" >/dev/null
+'
+
+test_perf 'git log -- <dir> (history index)' '
+	git log --oneline -- "$(dirname "$file")" >/dev/null
+'
+
+test_done
@@ -45,6 +45,19 @@ test_fetch_bitmaps () {
 		test_perf "client $title (lookup=$1)" '
 			git index-pack --stdin --fix-thin <tmp.pack
 		'
+
+		test_expect_success "setup upload-pack request $title" '
+			{
+				echo "want $(git rev-parse HEAD) side-band-64k thin-pack ofs-delta no-progress" &&
+				echo 0000 &&
+				sed -n "s/^\^/have /p" revs &&
+				echo done
+			} | test-tool pkt-line pack >request
+		'
+
+		test_perf "upload-pack $title (lookup=$1)" '
+			git upload-pack --stateless-rpc . <request >tmp.response
+		'
 	done
 }
 
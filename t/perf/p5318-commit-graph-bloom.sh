@@ -0,0 +1,17 @@
+#!/bin/sh
+
+test_description='Tests performance of writing changed-path Bloom filters'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+for threads in 1 4 0
+do
+	test_perf "write changed-path Bloom filters (threads=$threads)" "
+		rm -rf .git/objects/info/commit-graph* &&
+		git -c commitGraph.changedPathsThreads=$threads \
+			commit-graph write --reachable --changed-paths
+	"
+done
+
+test_done
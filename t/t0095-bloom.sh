@@ -123,4 +123,13 @@ test_expect_success EXPENSIVE 'get bloom filter for commit with 513 changes' '
 	test_cmp expect actual
 '
 
+test_expect_success 'batched probes match the key vectors one at a time' '
+	test-tool bloom bench_probes 2 dir1/file1 dir1/file2 dir1/sub/file3 \
+		dir2/file4 dir5/no/such/file >out &&
+	grep "^scalar_matches:" out | sed "s/^scalar_//" >expect &&
+	grep "^batched_matches:" out | sed "s/^batched_//" >actual &&
+	test_cmp expect actual &&
+	! grep "matches:0$" out
+'
+
 test_done
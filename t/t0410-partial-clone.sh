@@ -749,6 +749,28 @@ test_expect_success TTY 'promisor.quiet=unconfigured shows progress messages' '
 	grep "Receiving objects" err
 '
 
+test_expect_success 'threaded grep fetches missing blobs in batches' '
+	rm -rf server repo &&
+	test_create_repo server &&
+	for i in $(test_seq 1 20)
+	do
+		echo "needle $i" >server/file$i || return 1
+	done &&
+	git -C server add . &&
+	git -C server commit -m files &&
+	test_config -C server uploadpack.allowfilter 1 &&
+	test_config -C server uploadpack.allowanysha1inwant 1 &&
+
+	git clone --no-checkout --filter=blob:none "file://$(pwd)/server" repo &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C repo grep --threads=4 -c needle HEAD >out &&
+	test_line_count = 20 out &&
+	grep "\"key\":\"lazy_fetch_batch\"" trace >batches &&
+	test_line_count -lt 20 batches &&
+	git -C repo rev-list --objects --missing=print HEAD >objects &&
+	! grep "^?" objects
+'
+
 . "$TEST_DIRECTORY"/lib-httpd.sh
 start_httpd
 
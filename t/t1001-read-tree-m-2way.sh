@@ -416,4 +416,62 @@ test_expect_success '-m references the correct modified tree' '
 	test_cmp expect actual
 '
 
+test_expect_success 'prefetching trees with checkout.treeReadThreads' '
+	git init prefetch &&
+	(
+		cd prefetch &&
+		for d in a b c
+		do
+			for s in x y
+			do
+				mkdir -p $d/$s/sub &&
+				echo $d$s >$d/$s/file &&
+				echo $d$s >$d/$s/sub/file || return 1
+			done
+		done &&
+		git add . &&
+		git commit -m base &&
+		git branch base &&
+		echo changed >>a/y/sub/file &&
+		echo changed >>c/x/file &&
+		mkdir d &&
+		echo new >d/file &&
+		git rm -q -r b/x &&
+		git add . &&
+		git commit -m changed &&
+		git branch changed &&
+
+		git checkout -q base &&
+		git read-tree -m -u base changed &&
+		git ls-files -s >expect &&
+		git reset -q --hard base &&
+		GIT_TRACE2_PERF="$(pwd)/trace" \
+			git -c checkout.treeReadThreads=4 \
+			read-tree -m -u base changed &&
+		git ls-files -s >actual &&
+		test_cmp expect actual &&
+		git diff --exit-code changed &&
+		grep "tree_prefetch/read:" trace &&
+
+		git reset -q --hard base &&
+		git -c checkout.treeReadThreads=4 checkout -q changed &&
+		git diff --exit-code changed &&
+		git -c checkout.treeReadThreads=4 checkout -q base &&
+		git diff --exit-code base
+	)
+'
+
+test_expect_success 'prefetching trees past a sparse directory' '
+	test_when_finished "git -C prefetch sparse-checkout disable" &&
+	(
+		cd prefetch &&
+		git reset -q --hard base &&
+		git sparse-checkout set --cone --sparse-index b c &&
+		GIT_TRACE2_PERF="$(pwd)/trace-sparse" \
+			git -c checkout.treeReadThreads=4 checkout -q changed &&
+		git diff --exit-code changed &&
+		grep "tree_prefetch/dropped:" trace-sparse
+	)
+'
+
 test_done
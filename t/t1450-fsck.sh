@@ -1038,4 +1038,28 @@ test_expect_success 'fsck reports problems in current worktree index without fil
 	test_cmp expect actual
 '
 
+test_expect_success 'fsck --threads reports the same as a single thread' '
+	test_when_finished "rm -rf threads" &&
+	git init threads &&
+	(
+		cd threads &&
+		for i in 1 2 3 4 5 6 7 8
+		do
+			test_commit $i || return 1
+		done &&
+		git repack -ad &&
+		git fsck --verbose --threads=1 >expect 2>&1 &&
+		git fsck --verbose --threads=4 >actual 2>&1 &&
+		test_cmp expect actual &&
+
+		pack=$(echo .git/objects/pack/pack-*.pack) &&
+		chmod a+w $pack &&
+		printf "\0" | dd of=$pack bs=1 conv=notrunc seek=12 &&
+		test_must_fail git fsck --threads=1 >expect 2>&1 &&
+		test_must_fail git fsck --threads=4 >actual 2>&1 &&
+		test_cmp expect actual &&
+		test_grep "cannot unpack" actual
+	)
+'
+
 test_done
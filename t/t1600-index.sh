@@ -133,4 +133,30 @@ test_expect_success 'index version config precedence' '
 	test_index_version 0 true 2 2
 '
 
+test_expect_success 'threaded loading of an index without offset table' '
+	git init no-ieot &&
+	(
+		cd no-ieot &&
+		mkdir -p dir/sub &&
+		for i in $(test_seq 20)
+		do
+			echo $i >file$i &&
+			echo $i >dir/file$i &&
+			echo $i >dir/sub/file$i || return 1
+		done &&
+		long=$(test_seq -f x%03d/ 1 1000 | tr -d "\n")file &&
+		blob=$(git hash-object -w file1) &&
+		git -c index.threads=1 -c index.recordEndOfIndexEntries=false \
+			-c index.recordOffsetTable=false \
+			update-index --add --index-version 3 \
+			--cacheinfo 100644,$blob,$long file* dir/file* dir/sub/* &&
+		git update-index --skip-worktree file1 &&
+		git -c index.threads=1 ls-files -s --debug >expect &&
+		GIT_TRACE2_PERF="$(pwd)/trace" \
+			git -c index.threads=4 ls-files -s --debug >actual &&
+		test_cmp expect actual &&
+		grep "read/scanned_blocks:3" trace
+	)
+'
+
 test_done
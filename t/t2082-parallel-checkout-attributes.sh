@@ -188,4 +188,43 @@ test_expect_success 'parallel-checkout and delayed checkout' '
 	test_cmp delayed/Z original
 '
 
+test_expect_success 'parallel-checkout with a parallel process filter' '
+	test_config_global filter.par.process \
+		"test-tool rot13-filter --log=\"$(pwd)/parallel.log\" clean smudge" &&
+	test_config_global filter.par.required true &&
+	test_config_global filter.par.parallel true &&
+
+	git init parallel-filter &&
+	(
+		cd parallel-filter &&
+		echo "*.r filter=par" >.gitattributes &&
+		for i in 1 2 3 4
+		do
+			cp ../original $i.r || return 1
+		done &&
+		cp ../original plain &&
+		git add -A &&
+		git commit -m parallel-filter &&
+
+		git cat-file -p :1.r >1.r.internal &&
+		test_cmp ../rot13 1.r.internal &&
+		rm -f *.r *.internal plain
+	) &&
+
+	rm -f parallel.log &&
+	set_checkout_config 2 0 &&
+	test_checkout_workers 2 git -C parallel-filter checkout -f &&
+
+	# Each worker started its own instance of the filter
+	test $(grep -c "^START" parallel.log) -eq 2 &&
+	test $(grep -c "smudge [1-4].r blob=" parallel.log) -eq 4 &&
+
+	verify_checkout parallel-filter &&
+	for i in 1 2 3 4
+	do
+		test_cmp original parallel-filter/$i.r || return 1
+	done &&
+	test_cmp original parallel-filter/plain
+'
+
 test_done
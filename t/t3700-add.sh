@@ -548,4 +548,21 @@ test_expect_success CASE_INSENSITIVE_FS 'path is case-insensitive' '
 	git add "$downcased"
 '
 
+test_expect_success !CASE_INSENSITIVE_FS 'adding a single path does not hash all index entries' '
+	git init single-path &&
+	(
+		cd single-path &&
+		mkdir dir &&
+		for i in $(test_seq 200)
+		do
+			echo $i >dir/file$i || return 1
+		done &&
+		git add dir &&
+		echo new >dir/new &&
+		GIT_TRACE2_PERF="$(pwd)/trace" git add dir/new &&
+		! grep name-hash-init trace &&
+		git ls-files --error-unmatch dir/new
+	)
+'
+
 test_done
@@ -2412,4 +2412,32 @@ test_expect_success 'log --invert-grep --grep --author' '
 	test_cmp expect actual
 '
 
+test_expect_success 'log.diffThreads does not change the output' '
+	git checkout --orphan diff-threads &&
+	git rm -rf . &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 >file &&
+	mkdir dir &&
+	test_write_lines a b c d e f g h i >dir/other &&
+	git add file dir &&
+	test_tick &&
+	git commit -m root &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		echo $i >>file &&
+		echo $i >>dir/other &&
+		test_tick &&
+		git commit -a -m "change $i" || return 1
+	done &&
+	git mv file moved &&
+	test_tick &&
+	git commit -m rename &&
+	for args in "-p" "--stat -M" "-p -- dir" "-p --full-diff -- dir" \
+		    "-p -n 3 -S 5" "--numstat --reverse" "-p --root -n 20"
+	do
+		git -c log.diffThreads=1 log $args >expect &&
+		git -c log.diffThreads=4 log $args >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
 test_done
@@ -96,7 +96,9 @@ test_bloom_filters_not_used () {
 		data="$data\"filter_not_present\":[0-9][0-9]*,"
 		data="$data\"maybe\":0,"
 		data="$data\"definitely_not\":0,"
-		data="$data\"false_positive\":0}"
+		data="$data\"false_positive\":0,"
+		data="$data\"index_definitely_not\":0,"
+		data="$data\"index_changed\":0}"
 
 		grep -q "$data" "$TRASH_DIRECTORY/trace.perf"
 	fi &&
@@ -184,6 +186,95 @@ test_expect_success 'git log with path contains various magic signatures' '
 	test_bloom_filters_used "-- \:\(attr\:text\)A"
 '
 
+test_expect_success 'setup - write the changed-path history index' '
+	git -c commitGraph.changedPathsIndex=true \
+		commit-graph write --reachable --changed-paths &&
+	test-tool read-graph >actual &&
+	grep "^chunks: .* path_index$" actual
+'
+
+for path in A A/B A/file1 A/B/C/file3 file4 file5_renamed file_to_be_deleted
+do
+	for option in "" \
+		      "--full-history" \
+		      "--simplify-merges" \
+		      "--first-parent" \
+		      "--remove-empty"
+	do
+		test_expect_success "git log option: $option for path: $path uses the history index" '
+			test_bloom_filters_used "$option -- $path" &&
+			grep -q "\"index_changed\":[1-9]" "$TRASH_DIRECTORY/trace.perf"
+		'
+	done
+done
+
+test_expect_success 'history index with pathspecs that are not literal paths' '
+	test_bloom_filters_used "-- A/" &&
+	test_bloom_filters_used "-- A/file\*" &&
+	test_bloom_filters_used "-- file4 A/file1" &&
+	test_bloom_filters_used "-- \:\(glob\)A/\*\*/C" &&
+	test_bloom_filters_used "-- path_does_not_exist"
+'
+
+test_expect_success 'history index answers Bloom filter false positives' '
+	git init pathindex &&
+	(
+		cd pathindex &&
+		mkdir a b c &&
+		for i in $(test_seq 1 8)
+		do
+			test_commit a$i a/$i &&
+			test_commit b$i b/$i || return 1
+		done &&
+		touch c/x c/y c/z &&
+		git add c &&
+		git commit -m "too many changed paths" &&
+
+		# Filters of one byte match about anything; the commit
+		# touching c/ gets a truncated filter and no index entry.
+		GIT_TEST_BLOOM_SETTINGS_BITS_PER_ENTRY=1 \
+		GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=3 \
+			git -c commitGraph.changedPathsIndex=true \
+			commit-graph write --reachable --changed-paths &&
+
+		for path in a a/3 b/5 c/y b/nothing
+		do
+			rm -f trace.perf &&
+			git -c core.commitGraph=false log --oneline -- $path >expect &&
+			GIT_TRACE2_PERF="$(pwd)/trace.perf" \
+				git log --oneline -- $path >actual &&
+			test_cmp expect actual &&
+			grep "\"index_definitely_not\":[1-9]" trace.perf ||
+			return 1
+		done
+	)
+'
+
+test_expect_success 'history index in a split commit-graph' '
+	(
+		cd pathindex &&
+		test_commit a9 a/9 &&
+		test_commit b9 b/9 &&
+		test_commit a10 a/10 &&
+		git -c commitGraph.changedPathsIndex=true \
+			commit-graph write --reachable --changed-paths \
+			--split=no-merge --max-new-filters=1 &&
+		test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+
+		for path in a a/9 a/10 b c/z
+		do
+			git -c core.commitGraph=false log --oneline -- $path >expect &&
+			git log --oneline -- $path >actual &&
+			test_cmp expect actual || return 1
+		done
+	)
+'
+
+test_expect_success 'setup - drop the changed-path history index' '
+	git commit-graph write --reachable --changed-paths &&
+	graph_read_expect 16
+'
+
 test_expect_success 'setup - add commit-graph to the chain without Bloom filters' '
 	test_commit c14 A/anotherFile2 &&
 	test_commit c15 A/B/anotherFile2 &&
@@ -453,6 +544,37 @@ test_expect_success 'Bloom generation backfills empty commits' '
 	)
 '
 
+test_expect_success 'Bloom filters do not depend on commitGraph.changedPathsThreads' '
+	test_when_finished "rm -f limits/graph.* limits/trace.*" &&
+	(
+		cd limits &&
+		git update-index --add --cacheinfo 160000,$(git rev-parse HEAD),sub &&
+		git commit -m "add gitlink" &&
+
+		for threads in 1 4
+		do
+			rm -rf .git/objects/info/commit-graph* &&
+			GIT_TEST_BLOOM_SETTINGS_MAX_CHANGED_PATHS=10 \
+			GIT_TRACE2_EVENT="$(pwd)/trace.$threads" \
+				git -c commitGraph.changedPathsThreads=$threads \
+				commit-graph write --reachable --changed-paths &&
+			cp .git/objects/info/commit-graph graph.$threads || return 1
+		done &&
+		test_cmp_bin graph.1 graph.4 &&
+		grep "\"key\":\"bloom_filter_threads\",\"value\":\"4\"" trace.4 &&
+		test_filter_trunc_large 2 trace.4 &&
+
+		# Threads stop at --max-new-filters like the sequential code
+		rm -rf .git/objects/info/commit-graph* &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.max" \
+			git -c commitGraph.changedPathsThreads=4 \
+			commit-graph write --reachable --changed-paths \
+				--max-new-filters=2 &&
+		test_filter_computed 2 trace.max &&
+		test_filter_not_computed 4 trace.max
+	)
+'
+
 graph=.git/objects/info/commit-graph
 graphdir=.git/objects/info/commit-graphs
 chain=$graphdir/commit-graph-chain
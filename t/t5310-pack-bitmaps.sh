@@ -607,4 +607,20 @@ test_expect_success 'truncated bitmap fails gracefully (lookup table)' '
 	test_grep corrupted.bitmap.index stderr
 '
 
+test_expect_success 'bitmaps do not depend on pack.threads' '
+	rm -f .git/objects/pack/*.bitmap &&
+	git -c pack.threads=1 repack -adb &&
+	cp .git/objects/pack/*.bitmap expect.bitmap &&
+
+	rm -f .git/objects/pack/*.bitmap &&
+	GIT_TRACE2_EVENT="$(pwd)/trace2" \
+		git -c pack.threads=4 repack -adb &&
+	grep "\"key\":\"building_bitmaps_threads\",\"value\":\"4\"" trace2 &&
+	test_cmp_bin expect.bitmap .git/objects/pack/*.bitmap &&
+
+	# and when reusing the bitmaps that are already there
+	git -c pack.threads=4 repack -adb &&
+	test_cmp_bin expect.bitmap .git/objects/pack/*.bitmap
+'
+
 test_done
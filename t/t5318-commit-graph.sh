@@ -946,4 +946,81 @@ test_expect_success 'stale commit cannot be parsed when traversing graph' '
 	)
 '
 
+test_expect_success 'author and committer filters use the commit-graph idents' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit A &&
+		GIT_AUTHOR_NAME="Other Author" GIT_AUTHOR_EMAIL=other@example.com \
+			test_commit B &&
+		test_commit C &&
+		git -c i18n.commitEncoding=ISO-8859-1 commit --allow-empty -m D &&
+		echo "Mapped Name <other@example.com>" >.mailmap &&
+		git -c commitGraph.commitIdents=true commit-graph write --reachable &&
+		test-tool read-graph >info &&
+		grep "^chunks: .* commit_idents$" info &&
+
+		for args in --author=Other --author=author@example.com \
+			    --committer=Mitter "--author=Other --invert-grep" \
+			    "--author=Mapped --use-mailmap" --author-date-order
+		do
+			git -c core.commitGraph=false log --format=%H $args >expect &&
+			git log --format=%H $args >actual &&
+			test_cmp expect actual || return 1
+		done &&
+
+		# The idents of B come from the commit-graph alone.
+		oid=$(git rev-parse B) &&
+		rm .git/objects/"$(test_oid_to_path "$oid")" &&
+		echo $oid >expect &&
+		git rev-list --author=Other HEAD >actual &&
+		test_cmp expect actual &&
+		git rev-list --author-date-order HEAD >actual &&
+		test_line_count = 4 actual
+	)
+'
+
+test_expect_success 'rev-list --count walks the commit-graph' '
+	test_when_finished "rm -rf repo" &&
+	git init repo &&
+	(
+		cd repo &&
+		test_commit base &&
+		for i in 1 2 3
+		do
+			git checkout -b side$i base &&
+			test_commit side$i-1 &&
+			test_commit side$i-2 || return 1
+		done &&
+		git checkout -b merged side1 &&
+		git merge -m octopus side2 side3 &&
+		test_commit after &&
+		git tag -a -m annotated annotated side2 &&
+		git commit-graph write --reachable --split &&
+		test_commit top &&
+		git commit-graph write --reachable --split=no-merge &&
+		test_line_count = 2 .git/objects/info/commit-graphs/commit-graph-chain &&
+
+		for args in --all merged side1..merged side1...side3 \
+			    "--all --not side2" "merged ^annotated" \
+			    "--branches --not --tags" "top side1-2 ^after"
+		do
+			git -c core.commitGraph=false rev-list --count $args >expect &&
+			GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+				git rev-list --count $args >actual &&
+			test_cmp expect actual &&
+			grep "count-walk/visited" trace.txt &&
+			rm trace.txt || return 1
+		done &&
+
+		# Anything else counts the walk as usual.
+		git -c core.commitGraph=false rev-list --count --max-count=3 --all >expect &&
+		GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+			git rev-list --count --max-count=3 --all >actual &&
+		test_cmp expect actual &&
+		test_grep ! "count-walk/visited" trace.txt
+	)
+'
+
 test_done
@@ -1079,6 +1079,97 @@ test_expect_success 'fetch with --filter=blob:limit=0' '
 	fetch_filter_blob_limit_zero server server
 '
 
+test_expect_success 'setup negotiation against a bitmapped server' '
+	rm -rf server &&
+	test_create_repo server &&
+	test_commit_bulk -C server 50 &&
+	git -C server repack -adb
+'
+
+# Clone "server", then give both sides commits the other lacks. The new
+# commits on the server are left outside of its bitmapped pack.
+diverge_from_bitmapped_server () {
+	rm -rf client &&
+	git clone --no-local server client &&
+	test_commit_bulk -C client --id=local-$1 10 &&
+	test_commit_bulk -C server --id=new-$1 3
+}
+
+for v in 0 2
+do
+	test_expect_success "protocol v$v negotiation uses the bitmaps of the wants" '
+		test_when_finished "rm -f trace event" &&
+		diverge_from_bitmapped_server v$v &&
+		GIT_TRACE_PACKET="$(pwd)/trace" \
+		GIT_TRACE2_EVENT="$(pwd)/event" \
+		git -C client -c protocol.version=$v fetch origin &&
+		grep "\"region_enter\".*\"label\":\"negotiation-bitmaps\"" event &&
+		grep "fetch< .*ready" trace &&
+		git -C server rev-parse main >expect &&
+		git -C client rev-parse origin/main >actual &&
+		test_cmp expect actual
+	'
+done
+
+test_expect_success 'uploadpack.negotiationBitmaps=false walks the commits instead' '
+	test_when_finished "rm -f trace event" &&
+	test_config -C server uploadpack.negotiationBitmaps false &&
+	diverge_from_bitmapped_server no-bitmaps &&
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+	GIT_TRACE2_EVENT="$(pwd)/event" \
+	git -C client fetch origin &&
+	! grep "negotiation-bitmaps" event &&
+	grep "fetch< .*ready" trace &&
+	git -C server rev-parse main >expect &&
+	git -C client rev-parse origin/main >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'setup haves outside of the bitmapped pack' '
+	rm -rf server &&
+	test_create_repo server &&
+	test_commit_bulk -C server --ref=refs/heads/old --id=old 20 &&
+	git -C server repack -adb &&
+	# "main" is unrelated to "old" and stays out of the bitmapped pack.
+	test_commit_bulk -C server --id=loose 50
+'
+
+# Like diverge_from_bitmapped_server, but everything the client has in
+# common with "server" is outside of its bitmapped pack.
+diverge_from_loose_server () {
+	rm -rf client &&
+	git clone --no-local --single-branch server client &&
+	test_commit_bulk -C client --id=local-$1 10 &&
+	test_commit_bulk -C server --id=loose-$1 3
+}
+
+for v in 0 2
+do
+	test_expect_success "protocol v$v finds haves outside of the bitmapped pack" '
+		test_when_finished "rm -f trace event" &&
+		diverge_from_loose_server v$v &&
+		GIT_TRACE_PACKET="$(pwd)/trace" \
+		GIT_TRACE2_EVENT="$(pwd)/event" \
+		git -C client -c protocol.version=$v fetch origin main &&
+		grep "\"region_enter\".*\"label\":\"negotiation-bitmaps\"" event &&
+		grep "fetch< .*ready" trace
+	'
+
+	test_expect_success "protocol v$v is not ready while a want reaches no have" '
+		test_when_finished "rm -f trace event" &&
+		diverge_from_loose_server v$v-old &&
+		GIT_TRACE_PACKET="$(pwd)/trace" \
+		GIT_TRACE2_EVENT="$(pwd)/event" \
+		git -C client -c protocol.version=$v fetch origin \
+			main old:refs/remotes/origin/old &&
+		grep "\"region_enter\".*\"label\":\"negotiation-bitmaps\"" event &&
+		! grep "fetch< .*ready" trace &&
+		git -C server rev-parse old >expect &&
+		git -C client rev-parse origin/old >actual &&
+		test_cmp expect actual
+	'
+done
+
 . "$TEST_DIRECTORY"/lib-httpd.sh
 start_httpd
 
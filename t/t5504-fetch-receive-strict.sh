@@ -120,6 +120,18 @@ test_expect_success 'push with transfer.fsckobjects' '
 	test_cmp exp act
 '
 
+test_expect_success 'push with receive.connectivityCheck=edges' '
+	rm -rf dst &&
+	git init dst &&
+	git -C dst config receive.connectivityCheck edges &&
+	test_must_fail git push --porcelain dst main:refs/heads/test >act &&
+	test_cmp exp act &&
+
+	git -C dst config receive.unpackLimit 1 &&
+	test_must_fail git push --porcelain dst main:refs/heads/test >act &&
+	test_cmp exp act
+'
+
 test_expect_success 'repair the "corrupt or missing" object' '
 	mv -f .git/objects/$(cat S) .git/objects/$(cat X) &&
 	mv .git/objects/$(cat S).back .git/objects/$(cat S) &&
@@ -376,4 +388,32 @@ test_expect_success PERL_TEST_HELPERS 'badFilemode is not a strict error' '
 	grep "$tree: badFilemode" err
 '
 
+test_expect_success 'receive.connectivityCheck=edges does not walk history' '
+	git init edges-src &&
+	git init --bare edges.git &&
+	git -C edges.git config receive.connectivityCheck edges &&
+	test_commit -C edges-src one &&
+	git -C edges-src push ../edges.git main &&
+
+	test_commit -C edges-src two &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C edges-src push ../edges.git main &&
+	test_grep "unpack-objects.*--check-links" trace &&
+	test_grep ! "\"rev-list\"" trace &&
+
+	test_commit -C edges-src three &&
+	git -C edges.git config receive.unpackLimit 1 &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" \
+		git -C edges-src push ../edges.git main main:refs/heads/other &&
+	test_grep "index-pack.*--check-links" trace &&
+	test_grep ! "\"rev-list\"" trace &&
+
+	git -C edges-src rev-parse main >expect &&
+	git -C edges.git rev-parse main >actual &&
+	test_cmp expect actual &&
+	git -C edges.git rev-parse other >actual &&
+	test_cmp expect actual &&
+	git -C edges.git fsck
+'
+
 test_done
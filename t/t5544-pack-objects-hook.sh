@@ -20,7 +20,7 @@ test_expect_success 'create debugging hook script' '
 '
 
 clear_hook_results () {
-	rm -rf .git/hook.* dst.git
+	rm -rf .git/hook.* dst.git dst2.git
 }
 
 test_expect_success 'hook runs via global config' '
@@ -75,4 +75,93 @@ test_expect_success 'hook works with partial clone' '
 	! grep blob types
 '
 
+test_expect_success 'pack cache serves repeated fetches' '
+	clear_hook_results &&
+	rm -rf cache &&
+	test_config_global uploadpack.packCache "$(pwd)/cache" &&
+	GIT_TRACE2_EVENT="$(pwd)/trace1" git clone --no-local . dst.git &&
+	grep "\"key\":\"pack-cache\",\"value\":\"miss\"" trace1 &&
+	ls cache/pack-*.stream >entries &&
+	test_line_count = 1 entries &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace2" git clone --no-local . dst2.git &&
+	grep "\"key\":\"pack-cache\",\"value\":\"hit\"" trace2 &&
+	git -C dst2.git fsck &&
+	git -C dst.git rev-parse --all >expect &&
+	git -C dst2.git rev-parse --all >actual &&
+	test_cmp expect actual &&
+	rm -rf dst2.git trace1 trace2 &&
+
+	# a shallow clone asks for something else
+	git clone --no-local --depth=1 . dst2.git &&
+	ls cache/pack-*.stream >entries &&
+	test_line_count = 2 entries &&
+	rm -rf dst2.git &&
+
+	# and so does any clone once a ref has moved
+	test_commit three &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --no-local . dst2.git &&
+	grep "\"key\":\"pack-cache\",\"value\":\"miss\"" trace &&
+	git -C dst2.git rev-parse three &&
+	rm -rf dst2.git trace
+'
+
+test_expect_success 'pack cache is not used from repo config' '
+	clear_hook_results &&
+	rm -rf cache &&
+	test_config uploadpack.packCache "$(pwd)/cache" &&
+	git clone --no-local . dst.git &&
+	test_path_is_missing cache
+'
+
+test_expect_success 'pack cache evicts the least recently used entries' '
+	clear_hook_results &&
+	rm -rf cache &&
+	test_config_global uploadpack.packCache "$(pwd)/cache" &&
+	git clone --no-local . dst.git &&
+	old=$(ls cache/pack-*.stream) &&
+	test-tool chmtime =-60 $old &&
+	size=$(test_file_size $old) &&
+
+	# too big to be kept at all
+	test_config_global uploadpack.packCacheSize 1 &&
+	git clone --no-local --depth=1 . dst2.git &&
+	rm -rf dst2.git &&
+	ls cache/pack-*.stream >entries &&
+	echo $old >expect &&
+	test_cmp expect entries &&
+
+	# room for only one of them
+	test_config_global uploadpack.packCacheSize $((size + 1)) &&
+	git clone --no-local --depth=1 . dst2.git &&
+	ls cache/pack-*.stream >entries &&
+	test_line_count = 1 entries &&
+	! grep $old entries
+'
+
+test_expect_success 'pack cache misses once pack configuration changes' '
+	clear_hook_results &&
+	rm -rf cache &&
+	test_config_global uploadpack.packCache "$(pwd)/cache" &&
+	git clone --no-local . dst.git &&
+	test_config pack.compression 1 &&
+	GIT_TRACE2_EVENT="$(pwd)/trace" git clone --no-local . dst2.git &&
+	grep "\"key\":\"pack-cache\",\"value\":\"miss\"" trace &&
+	ls cache/pack-*.stream >entries &&
+	test_line_count = 2 entries &&
+	rm -f trace
+'
+
+test_expect_success 'pack cache is not used with a pack-objects hook' '
+	clear_hook_results &&
+	rm -rf cache &&
+	test_config_global uploadpack.packCache "$(pwd)/cache" &&
+	test_config_global uploadpack.packObjectsHook ./hook &&
+	git clone --no-local . dst.git 2>stderr &&
+	grep "hook running" stderr &&
+	git clone --no-local . dst2.git 2>stderr &&
+	grep "hook running" stderr &&
+	test_path_is_missing cache
+'
+
 test_done
@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='test sketch fetch negotiator'
+
+GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME=main
+export GIT_TEST_DEFAULT_INITIAL_BRANCH_NAME
+
+. ./test-lib.sh
+
+# trace_fetch <client_dir> <server_dir> [args]
+#
+# Trace the packet output and trace2 events of fetch, both of which the
+# child upload-pack adds to.
+trace_fetch () {
+	client=$1; shift
+	server=$1; shift
+	rm -f trace event &&
+	GIT_TRACE_PACKET="$(pwd)/trace" GIT_TRACE2_EVENT="$(pwd)/event" \
+	git -C "$client" -c protocol.version=2 fetch "$server" "$@"
+}
+
+test_expect_success 'setup' '
+	git init server &&
+	test_commit -C server base &&
+	git -C server config uploadpack.allowSketch true &&
+	git clone "file://$(pwd)/server" client &&
+	for i in $(test_seq 1 40)
+	do
+		git -C client checkout -q -b topic$i base &&
+		test_commit -C client local$i || return 1
+	done &&
+	cp -R client client2 &&
+	git -C client config fetch.negotiationAlgorithm sketch &&
+	test_commit_bulk -C server 20
+'
+
+test_expect_success 'local-only branches do not cost extra rounds' '
+	trace_fetch client "file://$(pwd)/server" main &&
+	grep "fetch> sketch " trace &&
+	grep "\"key\":\"sketch/decoded\",\"value\":\"1\"" event &&
+	grep "\"key\":\"total_rounds\",\"value\":\"1\"" event &&
+	git -C server rev-parse main >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual &&
+	git -C client fsck --connectivity-only
+'
+
+test_expect_success 'the same fetch takes more rounds without a sketch' '
+	trace_fetch client2 "file://$(pwd)/server" main &&
+	! grep "fetch> sketch" trace &&
+	! grep "\"key\":\"total_rounds\",\"value\":\"1\"" event &&
+	git -C server rev-parse main >expect &&
+	git -C client2 rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'falls back when the difference is too large' '
+	test_commit_bulk -C server 200 &&
+
+	trace_fetch client "file://$(pwd)/server" main &&
+	grep "fetch> sketch " trace &&
+	grep "\"key\":\"sketch/decoded\",\"value\":\"0\"" event &&
+	git -C server rev-parse main >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual &&
+	git -C client fsck --connectivity-only
+'
+
+test_expect_success 'a sketch older than uploadpack.sketchMaxAge is ignored' '
+	test_commit -C server too-old &&
+	test_config -C server uploadpack.sketchMaxAge 1 &&
+
+	trace_fetch client "file://$(pwd)/server" main &&
+	grep "fetch> sketch " trace &&
+	grep "\"key\":\"sketch/too-old\",\"value\":\"1\"" event &&
+	! grep "sketch/decoded" event &&
+	git -C server rev-parse main >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'no sketch is sent unless the server allows it' '
+	test_commit -C server unadvertised &&
+	test_config -C server uploadpack.allowSketch false &&
+
+	trace_fetch client "file://$(pwd)/server" main &&
+	! grep "fetch> sketch" trace &&
+	git -C server rev-parse main >expect &&
+	git -C client rev-parse FETCH_HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_done
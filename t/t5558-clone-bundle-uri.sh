@@ -213,6 +213,28 @@ test_expect_success 'clone bundle list (file, no heuristic)' '
 	test_cmp expect actual
 '
 
+test_expect_success 'bundles that are ready at the same time are indexed together' '
+	test_when_finished rm -rf clone-list-rounds trace.txt &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace.txt" \
+		git clone --bundle-uri="file://$(pwd)/bundle-list" \
+		clone-from clone-list-rounds &&
+
+	# bundle-1 alone, then bundle-2 and bundle-3, then bundle-4
+	grep "\"key\":\"bundle-uri/unbundle-rounds\",\"value\":\"3\"" trace.txt &&
+	test $(grep -c "\"event\":\"child_start\".*\"index-pack\",\"--fix-thin\"" trace.txt) = 4 &&
+
+	git -C clone-list-rounds for-each-ref --format="%(refname)" \
+		"refs/bundles/heads/*" >actual &&
+	cat >expect <<-\EOF &&
+	refs/bundles/heads/base
+	refs/bundles/heads/left
+	refs/bundles/heads/merge
+	refs/bundles/heads/right
+	EOF
+	test_cmp expect actual
+'
+
 test_expect_success 'clone bundle list (file, all mode, some failures)' '
 	cat >bundle-list <<-EOF &&
 	[bundle]
@@ -555,6 +577,37 @@ test_expect_success 'clone bundle list (HTTP, no heuristic)' '
 	test_cmp expect actual
 '
 
+test_expect_success 'clone bundle list (HTTP, parallel downloads)' '
+	test_when_finished rm -rf clone-list-http-jobs clone-list-http-serial trace*.txt &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-jobs.txt" \
+		git -c fetch.bundleJobs=4 clone \
+		--bundle-uri="$HTTPD_URL/bundle-list" \
+		clone-from clone-list-http-jobs &&
+	grep "\"region_enter\".*\"prefetch-bundles\"" trace-jobs.txt &&
+	cat >expect <<-EOF &&
+	$HTTPD_URL/bundle-1.bundle
+	$HTTPD_URL/bundle-2.bundle
+	$HTTPD_URL/bundle-3.bundle
+	$HTTPD_URL/bundle-4.bundle
+	$HTTPD_URL/bundle-list
+	EOF
+	test_remote_https_urls <trace-jobs.txt | sort >actual &&
+	test_cmp expect actual &&
+
+	GIT_TRACE2_EVENT="$(pwd)/trace-serial.txt" \
+		git -c fetch.bundleJobs=1 clone \
+		--bundle-uri="$HTTPD_URL/bundle-list" \
+		clone-from clone-list-http-serial &&
+	! grep "\"region_enter\".*\"prefetch-bundles\"" trace-serial.txt &&
+
+	git -C clone-list-http-jobs for-each-ref --format="%(refname)" \
+		"refs/bundles/heads/*" >jobs &&
+	git -C clone-list-http-serial for-each-ref --format="%(refname)" \
+		"refs/bundles/heads/*" >serial &&
+	test_cmp serial jobs
+'
+
 test_expect_success 'clone bundle list (HTTP, any mode)' '
 	cp clone-from/bundle-*.bundle "$HTTPD_DOCUMENT_ROOT_PATH/" &&
 	cat >"$HTTPD_DOCUMENT_ROOT_PATH/bundle-list" <<-EOF &&
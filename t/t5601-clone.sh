@@ -806,6 +806,80 @@ test_expect_success 'batch missing blob request does not inadvertently try to fe
 	git clone --filter=blob:limit=0 "file://$(pwd)/server" client
 '
 
+test_expect_success 'setup repository for --stream-checkout' '
+	git init stream-src &&
+	mkdir -p stream-src/dir/sub &&
+	for i in $(test_seq 1 20)
+	do
+		echo file $i >stream-src/file$i &&
+		echo dir $i >stream-src/dir/file$i &&
+		echo sub $i >stream-src/dir/sub/file$i || return 1
+	done &&
+	echo same >stream-src/dir/copy &&
+	echo same >stream-src/dir/sub/copy &&
+	write_script stream-src/dir/run <<-\EOF &&
+	echo run
+	EOF
+	git -C stream-src add . &&
+	(
+		cd stream-src &&
+		test_ln_s_add file1 link
+	) &&
+	git -C stream-src commit -m one &&
+	echo more >>stream-src/dir/file1 &&
+	git -C stream-src rm -q file2 &&
+	git -C stream-src commit -am two
+'
+
+# check_stream_checkout <dir> <expected-written>
+check_stream_checkout () {
+	git clone --no-stream-checkout "file://$(pwd)/stream-src" stream-plain &&
+	git -C stream-plain ls-files -s >expect &&
+	git -C "$1" ls-files -s >actual &&
+	test_cmp expect actual &&
+	git -C "$1" status --porcelain --ignored >status &&
+	test_must_be_empty status &&
+	git -C "$1" diff --exit-code &&
+	diff -r -x .git stream-plain "$1" &&
+	test_path_is_missing "$1/.git/STREAMED_CHECKOUT" &&
+	rm -rf stream-plain &&
+	grep "\"category\":\"checkout-stream\",\"key\":\"written\",\"value\":\"$2\"" event
+}
+
+test_expect_success 'clone --stream-checkout writes files as they come' '
+	test_when_finished "rm -rf stream-dst event" &&
+	GIT_TRACE2_EVENT="$(pwd)/event" \
+		git clone --stream-checkout "file://$(pwd)/stream-src" stream-dst &&
+	check_stream_checkout stream-dst 62
+'
+
+test_expect_success 'clone.streamCheckout with checkout workers' '
+	test_when_finished "rm -rf stream-dst event" &&
+	GIT_TRACE2_EVENT="$(pwd)/event" git -c clone.streamCheckout=true \
+		-c checkout.workers=4 clone -c checkout.workers=4 \
+		"file://$(pwd)/stream-src" stream-dst &&
+	check_stream_checkout stream-dst 62
+'
+
+test_expect_success 'clone --stream-checkout with in-tree attributes' '
+	test_when_finished "rm -rf stream-dst event" &&
+	printf "file* text eol=crlf\n" >stream-src/dir/.gitattributes &&
+	git -C stream-src add dir/.gitattributes &&
+	git -C stream-src commit -m attributes &&
+	GIT_TRACE2_EVENT="$(pwd)/event" \
+		git clone --stream-checkout "file://$(pwd)/stream-src" stream-dst &&
+	check_stream_checkout stream-dst 0 &&
+	git -C stream-src rm -q dir/.gitattributes &&
+	git -C stream-src commit -m "no attributes"
+'
+
+test_expect_success 'clone --stream-checkout skipped with core.autocrlf' '
+	test_when_finished "rm -rf stream-dst event" &&
+	GIT_TRACE2_EVENT="$(pwd)/event" git clone -c core.autocrlf=true \
+		--stream-checkout "file://$(pwd)/stream-src" stream-dst &&
+	! grep checkout-stream event
+'
+
 . "$TEST_DIRECTORY"/lib-httpd.sh
 start_httpd
 
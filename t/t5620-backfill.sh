@@ -77,6 +77,32 @@ test_expect_success 'do partial clone 2, backfill min batch size' '
 	test_line_count = 0 revs2
 '
 
+test_expect_success 'backfill --jobs fetches batches in parallel' '
+	git clone --no-checkout --filter=blob:none	\
+		--single-branch --branch=main 		\
+		"file://$(pwd)/srv.bare" backfill-jobs &&
+	ls backfill-jobs/.git/objects/pack/*.promisor >before &&
+	test_line_count = 1 before &&
+
+	GIT_TRACE2_EVENT="$(pwd)/jobs-trace" git \
+		-C backfill-jobs backfill --min-batch-size=10 --jobs=3 &&
+
+	test_trace2_data backfill fetch_count 10 <jobs-trace >matches &&
+	test_line_count = 4 matches &&
+	test_trace2_data backfill fetch_count 8 <jobs-trace &&
+
+	# The five packs were consolidated into one promisor pack.
+	test_trace2_data backfill consolidated_packs 5 <jobs-trace &&
+	ls backfill-jobs/.git/objects/pack/*.promisor >after &&
+	test_line_count = 2 after &&
+	ls backfill-jobs/.git/objects/pack/*.pack >packs &&
+	test_line_count = 2 packs &&
+
+	git -C backfill-jobs rev-list --quiet --objects --missing=print HEAD >revs &&
+	test_line_count = 0 revs &&
+	git -C backfill-jobs fsck
+'
+
 test_expect_success 'backfill --sparse without sparse-checkout fails' '
 	git init not-sparse &&
 	test_must_fail git -C not-sparse backfill --sparse 2>err &&
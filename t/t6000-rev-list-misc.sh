@@ -248,4 +248,34 @@ test_expect_success 'rev-list -z --boundary' '
 	test_cmp expect actual
 '
 
+test_expect_success 'core.objectWalkThreads does not change the objects listed' '
+	test_when_finished rm -rf repo &&
+
+	git init repo &&
+	for i in 1 2 3 4 5 6
+	do
+		mkdir -p repo/a/b$i repo/c &&
+		echo $i >repo/a/b$i/file &&
+		echo $i >>repo/c/file &&
+		git -C repo add . &&
+		git -C repo commit -q -m $i || return 1
+	done &&
+	git -C repo tag -m tagged tagged HEAD~2 &&
+
+	for args in "--objects --all" "--objects HEAD~3..HEAD" \
+		    "--objects-edge HEAD~3..HEAD" "--objects HEAD^{tree} tagged"
+	do
+		git -C repo -c core.objectWalkThreads=1 rev-list $args >expect &&
+		git -C repo -c core.objectWalkThreads=4 rev-list $args >actual &&
+		test_cmp expect actual || return 1
+	done &&
+
+	echo HEAD~2..HEAD >in &&
+	git -C repo -c core.objectWalkThreads=1 \
+		pack-objects --revs --stdout <in >expect.pack &&
+	git -C repo -c core.objectWalkThreads=4 \
+		pack-objects --revs --stdout <in >actual.pack &&
+	test_cmp expect.pack actual.pack
+'
+
 test_done
@@ -411,4 +411,34 @@ test_expect_success 'status with added file in nested submodule (short)' '
 	EOF
 '
 
+test_expect_success 'status with submodule.diffJobs' '
+	git -C super status --porcelain=2 >expect &&
+	git -C super -c submodule.diffJobs=3 status --porcelain=2 >actual &&
+	test_cmp expect actual &&
+	git -C super status --short -uno >expect &&
+	git -C super -c submodule.diffJobs=0 status --short -uno >actual &&
+	test_cmp expect actual &&
+	git -C super diff --submodule=short >expect &&
+	git -C super -c submodule.diffJobs=2 diff --submodule=short >actual &&
+	test_cmp expect actual &&
+	test_must_fail git -C super -c submodule.diffJobs=-1 status 2>err &&
+	test_grep "negative values not allowed" err
+'
+
+test_expect_success 'submodule.diffJobs only parses what the child writes to stdout' '
+	test_when_finished "git -C super/sub3 config --unset core.fsmonitor" &&
+	write_script fsmonitor-noise <<-EOF &&
+	echo "1 x" >&2
+	echo "1 .M N... 100644 100644 100644 $ZERO_OID $ZERO_OID file" >&2
+	exit 1
+	EOF
+	git -C super/sub3 config core.fsmonitor "\"$(pwd)/fsmonitor-noise\"" &&
+	git -C super status --porcelain=2 >expect &&
+	git -C super -c submodule.diffJobs=3 status --porcelain=2 >actual 2>err &&
+	test_cmp expect actual &&
+	grep "S\.\.U .* sub3\$" actual &&
+	test_grep "^1 x$" err &&
+	test_grep "^1 \.M N\.\.\. " err
+'
+
 test_done
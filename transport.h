@@ -48,6 +48,13 @@ struct git_transport_options {
 	 */
 	struct oid_array *negotiation_tips;
 
+	/*
+	 * This is only used during clone. See the documentation of
+	 * stream_checkout in struct fetch_pack_args.
+	 */
+	const struct object_id *stream_checkout;
+	const char *stream_checkout_dir;
+
 	/*
 	 * If allocated, whenever transport_fetch_refs() is called, add known
 	 * common commits to this oidset instead of fetching any packfiles.
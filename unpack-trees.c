@@ -31,6 +31,9 @@
 #include "entry.h"
 #include "parallel-checkout.h"
 #include "setup.h"
+#include "oidmap.h"
+#include "prio-queue.h"
+#include "thread-utils.h"
 
 /*
  * Error messages expected by scripts out of plumbing commands such as
@@ -863,6 +866,478 @@ static int traverse_by_cache_tree(int pos, int nr_entries, int nr_names,
 	return 0;
 }
 
+/*
+ * Tree prefetching.
+ *
+ * traverse_trees() has to call unpack_callback() in path order, but
+ * inflating the trees it walks does not.  When "checkout.treeReadThreads"
+ * asks for more than one thread, a pool of workers reads the subtrees in
+ * which the input trees differ ahead of the traversal, starting from the
+ * top-level ones, and traverse_trees_recursive() picks the buffers up
+ * from a shared map instead of reading them itself.  Subtrees that are
+ * identical in all inputs are left alone, as the traversal will usually
+ * satisfy them from the cache-tree.
+ *
+ * Trees read ahead are held until the traversal asks for them, up to
+ * TREE_PREFETCH_MAX_BYTES.  The traversal does not ask for all of them,
+ * e.g. when the cache-tree or a sparse directory lets it skip one, so
+ * whatever it has already walked past is dropped again as it goes.
+ */
+#define TREE_PREFETCH_MAX_BYTES (64 * 1024 * 1024)
+
+enum prefetched_tree_state {
+	PREFETCH_READING,
+	PREFETCH_READY,
+	/* consumed by the traversal, or could not be read by a worker */
+	PREFETCH_DONE,
+};
+
+struct prefetched_tree {
+	struct oidmap_entry entry;
+	enum prefetched_tree_state state;
+	void *buf;
+	unsigned long size;
+	/* where the worker found it, with a trailing slash */
+	char *path;
+};
+
+struct tree_prefetch_job {
+	struct object_id oids[MAX_UNPACK_TREES];
+	unsigned long mask;
+	char *path;
+};
+
+struct tree_prefetch {
+	struct repository *repo;
+	int n;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/* all fields below are protected by the mutex */
+	struct oidmap trees;
+	struct tree_prefetch_job **jobs;
+	size_t jobs_nr, jobs_alloc;
+	size_t ready_bytes;
+	/* PREFETCH_READY trees (and some consumed since) by path */
+	struct prio_queue ready;
+	int active;
+	int stop;
+
+	/* statistics, for trace2 */
+	intmax_t nr_read, nr_hit, nr_dropped;
+
+	int nr_threads;
+	pthread_t *threads;
+};
+
+static int get_tree_read_threads(struct repository *r)
+{
+	char *env = getenv("GIT_TEST_CHECKOUT_TREE_READ_THREADS");
+	int nr_threads;
+
+	if (env && *env) {
+		if (strtol_i(env, 10, &nr_threads))
+			die(_("invalid value for '%s': '%s'"),
+			    "GIT_TEST_CHECKOUT_TREE_READ_THREADS", env);
+	} else if (repo_config_get_int(r, "checkout.treereadthreads",
+				       &nr_threads)) {
+		return 1;
+	}
+
+	if (nr_threads < 1)
+		nr_threads = online_cpus();
+	return nr_threads;
+}
+
+static int compare_prefetched_tree_paths(const void *a_, const void *b_,
+					 void *data UNUSED)
+{
+	const struct prefetched_tree *a = a_, *b = b_;
+
+	return strcmp(a->path, b->path);
+}
+
+static void free_tree_prefetch_job(struct tree_prefetch_job *job)
+{
+	free(job->path);
+	free(job);
+}
+
+/*
+ * Queue a job for each subtree found in the given (already read) trees
+ * at "base", unless it has the same object name in all of them.  Jobs
+ * are pushed in reverse name order, so that workers popping from the
+ * end of the stack visit them roughly in the order the traversal will
+ * want them.
+ */
+static void queue_subtree_jobs(struct tree_prefetch *tp, const char *base,
+			       struct tree_desc *t)
+{
+	struct string_list subtrees = STRING_LIST_INIT_DUP;
+	unsigned long all = (1ul << tp->n) - 1;
+
+	for (int i = 0; i < tp->n; i++) {
+		struct tree_desc desc = t[i];
+		struct name_entry entry;
+
+		while (tree_entry_gently(&desc, &entry)) {
+			struct string_list_item *item;
+			struct tree_prefetch_job *job;
+
+			if (!S_ISDIR(entry.mode))
+				continue;
+			item = string_list_insert(&subtrees, entry.path);
+			job = item->util;
+			if (!job) {
+				item->util = CALLOC_ARRAY(job, 1);
+				job->path = xstrfmt("%s%s/", base, entry.path);
+			}
+			oidcpy(&job->oids[i], &entry.oid);
+			job->mask |= 1ul << i;
+		}
+	}
+
+	pthread_mutex_lock(&tp->mutex);
+	for (size_t i = subtrees.nr; i > 0; i--) {
+		struct tree_prefetch_job *job = subtrees.items[i - 1].util;
+		int same = job->mask == all;
+
+		for (int j = 1; same && j < tp->n; j++)
+			same = oideq(&job->oids[0], &job->oids[j]);
+		if (same) {
+			free_tree_prefetch_job(job);
+			continue;
+		}
+		ALLOC_GROW(tp->jobs, tp->jobs_nr + 1, tp->jobs_alloc);
+		tp->jobs[tp->jobs_nr++] = job;
+	}
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+
+	string_list_clear(&subtrees, 0);
+}
+
+/*
+ * Mark a tree as being read by the calling worker.  Returns 0 if some
+ * other worker, or the traversal itself, already took care of it.
+ */
+static int claim_prefetched_tree(struct tree_prefetch *tp,
+				 const struct object_id *oid,
+				 struct prefetched_tree **out)
+{
+	struct prefetched_tree *pt;
+
+	pthread_mutex_lock(&tp->mutex);
+	pt = oidmap_get(&tp->trees, oid);
+	if (!pt) {
+		CALLOC_ARRAY(pt, 1);
+		oidcpy(&pt->entry.oid, oid);
+		pt->state = PREFETCH_READING;
+		oidmap_put(&tp->trees, pt);
+		*out = pt;
+	}
+	pthread_mutex_unlock(&tp->mutex);
+	return !!*out;
+}
+
+static void *read_prefetched_tree(struct repository *r,
+				  const struct object_id *oid,
+				  unsigned long *size)
+{
+	struct object_info oi = OBJECT_INFO_INIT;
+	enum object_type type;
+	void *buf;
+
+	oi.typep = &type;
+	oi.sizep = size;
+	oi.contentp = &buf;
+
+	/*
+	 * Leave missing objects to the traversal, which knows how to
+	 * lazily fetch them and how to complain about them.
+	 */
+	if (odb_read_object_info_extended(r->objects, oid, &oi,
+					  OBJECT_INFO_LOOKUP_REPLACE |
+					  OBJECT_INFO_SKIP_FETCH_OBJECT |
+					  OBJECT_INFO_QUICK))
+		return NULL;
+	if (type != OBJ_TREE) {
+		free(buf);
+		return NULL;
+	}
+	return buf;
+}
+
+static void run_tree_prefetch_job(struct tree_prefetch *tp,
+				  struct tree_prefetch_job *job)
+{
+	struct prefetched_tree *pt[MAX_UNPACK_TREES] = { NULL };
+	struct tree_desc t[MAX_UNPACK_TREES];
+	int complete = 1;
+
+	for (int i = 0; i < tp->n; i++) {
+		int dup = -1;
+
+		init_tree_desc(&t[i], NULL, NULL, 0);
+		if (!(job->mask & (1ul << i)))
+			continue;
+
+		for (int j = 0; j < i && dup < 0; j++)
+			if ((job->mask & (1ul << j)) &&
+			    oideq(&job->oids[i], &job->oids[j]))
+				dup = j;
+		if (dup >= 0) {
+			t[i] = t[dup];
+			continue;
+		}
+
+		if (!claim_prefetched_tree(tp, &job->oids[i], &pt[i])) {
+			/*
+			 * We do not have the contents, so we cannot tell
+			 * which of its subtrees differ; whoever has it will
+			 * queue them.
+			 */
+			complete = 0;
+			continue;
+		}
+		pt[i]->buf = read_prefetched_tree(tp->repo, &job->oids[i],
+						  &pt[i]->size);
+		if (!pt[i]->buf ||
+		    init_tree_desc_gently(&t[i], &job->oids[i], pt[i]->buf,
+					  pt[i]->size, 0)) {
+			FREE_AND_NULL(pt[i]->buf);
+			complete = 0;
+		}
+	}
+
+	if (complete)
+		queue_subtree_jobs(tp, job->path, t);
+
+	pthread_mutex_lock(&tp->mutex);
+	for (int i = 0; i < tp->n; i++) {
+		if (!pt[i])
+			continue;
+		if (pt[i]->buf) {
+			pt[i]->state = PREFETCH_READY;
+			pt[i]->path = xstrdup(job->path);
+			prio_queue_put(&tp->ready, pt[i]);
+			tp->ready_bytes += pt[i]->size;
+			tp->nr_read++;
+		} else {
+			pt[i]->state = PREFETCH_DONE;
+		}
+	}
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+}
+
+static void *tree_prefetch_thread(void *data)
+{
+	struct tree_prefetch *tp = data;
+
+	pthread_mutex_lock(&tp->mutex);
+	while (1) {
+		struct tree_prefetch_job *job;
+
+		while (!tp->stop &&
+		       (tp->jobs_nr ? tp->ready_bytes >= TREE_PREFETCH_MAX_BYTES
+				    : tp->active))
+			pthread_cond_wait(&tp->cond, &tp->mutex);
+		if (tp->stop || !tp->jobs_nr)
+			break;
+
+		job = tp->jobs[--tp->jobs_nr];
+		tp->active++;
+		pthread_mutex_unlock(&tp->mutex);
+
+		run_tree_prefetch_job(tp, job);
+		free_tree_prefetch_job(job);
+
+		pthread_mutex_lock(&tp->mutex);
+		tp->active--;
+	}
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+	return NULL;
+}
+
+static void start_tree_prefetch(struct unpack_trees_options *o,
+				const struct traverse_info *info,
+				unsigned n, struct tree_desc *t)
+{
+	struct repository *r = o->src_index->repo;
+	int nr_threads = get_tree_read_threads(r);
+	struct tree_prefetch *tp;
+	struct strbuf base = STRBUF_INIT;
+
+	if (!HAVE_THREADS || nr_threads < 2)
+		return;
+
+	CALLOC_ARRAY(tp, 1);
+	tp->repo = r;
+	tp->n = n;
+	pthread_mutex_init(&tp->mutex, NULL);
+	pthread_cond_init(&tp->cond, NULL);
+	oidmap_init(&tp->trees, 0);
+	tp->ready.compare = compare_prefetched_tree_paths;
+
+	/* the prefix the trees are spliced into, if any */
+	strbuf_make_traverse_path(&base, info, "", 0);
+	queue_subtree_jobs(tp, base.buf, t);
+	strbuf_release(&base);
+	if (!tp->jobs_nr) {
+		pthread_mutex_destroy(&tp->mutex);
+		pthread_cond_destroy(&tp->cond);
+		oidmap_clear(&tp->trees, 1);
+		free(tp);
+		return;
+	}
+
+	trace2_region_enter("unpack_trees", "tree_prefetch", r);
+	enable_obj_read_lock();
+
+	tp->nr_threads = nr_threads;
+	CALLOC_ARRAY(tp->threads, nr_threads);
+	for (int i = 0; i < nr_threads; i++) {
+		int err = pthread_create(&tp->threads[i], NULL,
+					 tree_prefetch_thread, tp);
+		if (err)
+			die(_("unable to create tree prefetch thread: %s"),
+			    strerror(err));
+	}
+
+	o->internal.tree_prefetch = tp;
+}
+
+static void stop_tree_prefetch(struct unpack_trees_options *o)
+{
+	struct tree_prefetch *tp = o->internal.tree_prefetch;
+	struct oidmap_iter iter;
+	struct prefetched_tree *pt;
+
+	if (!tp)
+		return;
+
+	pthread_mutex_lock(&tp->mutex);
+	tp->stop = 1;
+	pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+
+	for (int i = 0; i < tp->nr_threads; i++)
+		if (pthread_join(tp->threads[i], NULL))
+			die("unable to join tree prefetch thread");
+	disable_obj_read_lock();
+
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/read",
+			   tp->nr_read);
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/hit",
+			   tp->nr_hit);
+	trace2_data_intmax("unpack_trees", tp->repo, "tree_prefetch/dropped",
+			   tp->nr_dropped);
+	trace2_region_leave("unpack_trees", "tree_prefetch", tp->repo);
+
+	oidmap_iter_init(&tp->trees, &iter);
+	while ((pt = oidmap_iter_next(&iter))) {
+		free(pt->buf);
+		free(pt->path);
+	}
+	oidmap_clear(&tp->trees, 1);
+	clear_prio_queue(&tp->ready);
+	for (size_t i = 0; i < tp->jobs_nr; i++)
+		free_tree_prefetch_job(tp->jobs[i]);
+	free(tp->jobs);
+	free(tp->threads);
+	pthread_mutex_destroy(&tp->mutex);
+	pthread_cond_destroy(&tp->cond);
+	FREE_AND_NULL(o->internal.tree_prefetch);
+}
+
+/*
+ * Like fill_tree_descriptor(), but take the tree from the prefetching
+ * workers if they have (or are about to have) it.
+ */
+static void *fill_tree_descriptor_prefetched(struct unpack_trees_options *o,
+					     struct tree_desc *desc,
+					     const struct object_id *oid)
+{
+	struct tree_prefetch *tp = o->internal.tree_prefetch;
+	struct prefetched_tree *pt;
+	void *buf = NULL;
+	unsigned long size = 0;
+
+	if (!tp || !oid)
+		return fill_tree_descriptor(the_repository, desc, oid);
+
+	pthread_mutex_lock(&tp->mutex);
+	pt = oidmap_get(&tp->trees, oid);
+	while (pt && pt->state == PREFETCH_READING)
+		pthread_cond_wait(&tp->cond, &tp->mutex);
+	if (!pt) {
+		/* make sure no worker bothers reading it after us */
+		CALLOC_ARRAY(pt, 1);
+		oidcpy(&pt->entry.oid, oid);
+		pt->state = PREFETCH_DONE;
+		oidmap_put(&tp->trees, pt);
+	} else if (pt->state == PREFETCH_READY) {
+		buf = pt->buf;
+		size = pt->size;
+		pt->buf = NULL;
+		pt->state = PREFETCH_DONE;
+		tp->ready_bytes -= size;
+		tp->nr_hit++;
+		pthread_cond_broadcast(&tp->cond);
+	}
+	pthread_mutex_unlock(&tp->mutex);
+
+	if (!buf)
+		return fill_tree_descriptor(the_repository, desc, oid);
+	init_tree_desc(desc, oid, buf, size);
+	return buf;
+}
+
+/*
+ * The traversal is about to enter the directory "names" in "info".
+ * Drop the trees read ahead that it has walked past without asking for
+ * them, so that they no longer keep the workers from reading on.
+ */
+static void drop_passed_prefetched_trees(struct unpack_trees_options *o,
+					 const struct name_entry *names,
+					 const struct traverse_info *info)
+{
+	struct tree_prefetch *tp = o->internal.tree_prefetch;
+	struct strbuf path = STRBUF_INIT;
+	struct prefetched_tree *pt;
+	int dropped = 0;
+
+	while (!names->mode)
+		names++;
+	strbuf_make_traverse_path(&path, info, names->path, names->pathlen);
+	strbuf_addch(&path, '/');
+
+	/*
+	 * With the trailing slash, comparing full paths puts directories
+	 * in the order traverse_trees() visits them.
+	 */
+	pthread_mutex_lock(&tp->mutex);
+	while ((pt = prio_queue_peek(&tp->ready)) &&
+	       strcmp(pt->path, path.buf) < 0) {
+		prio_queue_get(&tp->ready);
+		if (pt->state != PREFETCH_READY)
+			continue;
+		FREE_AND_NULL(pt->buf);
+		pt->state = PREFETCH_DONE;
+		tp->ready_bytes -= pt->size;
+		tp->nr_dropped++;
+		dropped = 1;
+	}
+	if (dropped)
+		pthread_cond_broadcast(&tp->cond);
+	pthread_mutex_unlock(&tp->mutex);
+
+	strbuf_release(&path);
+}
+
 static int traverse_trees_recursive(int n, unsigned long dirmask,
 				    unsigned long df_conflicts,
 				    struct name_entry *names,
@@ -877,6 +1352,9 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 	struct name_entry *p;
 	int nr_entries;
 
+	if (o->internal.tree_prefetch)
+		drop_passed_prefetched_trees(o, names, info);
+
 	nr_entries = all_trees_same_as_cache_tree(n, dirmask, names, info);
 	if (nr_entries > 0) {
 		int pos = index_pos_by_traverse_info(names, info);
@@ -937,7 +1415,7 @@ static int traverse_trees_recursive(int n, unsigned long dirmask,
 			const struct object_id *oid = NULL;
 			if (dirmask & 1)
 				oid = &names[i].oid;
-			buf[nr_buf++] = fill_tree_descriptor(the_repository, t + i, oid);
+			buf[nr_buf++] = fill_tree_descriptor_prefetched(o, t + i, oid);
 		}
 	}
 
@@ -2007,7 +2485,9 @@ int unpack_trees(unsigned len, struct tree_desc *t, struct unpack_trees_options
 
 		trace_performance_enter();
 		trace2_region_enter("unpack_trees", "traverse_trees", the_repository);
+		start_tree_prefetch(o, &info, len, t);
 		ret = traverse_trees(o->src_index, len, t, &info);
+		stop_tree_prefetch(o);
 		trace2_region_leave("unpack_trees", "traverse_trees", the_repository);
 		trace_performance_leave("traverse_trees");
 		if (ret < 0)
@@ -28,11 +28,17 @@
 #include "upload-pack.h"
 #include "commit-graph.h"
 #include "commit-reach.h"
+#include "commit-sketch.h"
 #include "shallow.h"
+#include "tag.h"
 #include "write-or-die.h"
 #include "json-writer.h"
 #include "strmap.h"
 #include "promisor-remote.h"
+#include "tempfile.h"
+#include "abspath.h"
+#include "path.h"
+#include "pack-bitmap.h"
 
 /* Remember to update object flag allocation in object.h */
 #define THEY_HAVE	(1u << 11)
@@ -80,6 +86,22 @@ struct upload_pack_data {
 	int shallow_nr;
 	timestamp_t oldest_have;
 
+	/*
+	 * ok_to_give_up() remembers its answer until do_got_oid() learns
+	 * of another have, and answers from the reachability bitmaps of
+	 * the wants when the repository has bitmaps. The wants are taken
+	 * in order, and only the first one not yet known to reach a have
+	 * has its bitmap around.
+	 */
+	unsigned haves_seen, haves_checked;
+	int give_up;
+	struct bitmap_index *bitmap_git;
+	size_t wants_reached;
+	struct ewah_bitmap *want_bitmap;	/* of want_obj[wants_reached] */
+	struct bitmap *have_bitmap;
+	size_t haves_in_bitmap;
+	struct oid_array unplaced_haves;	/* not in have_bitmap yet */
+
 	unsigned int timeout;					/* v0 only */
 	enum {
 		NO_MULTI_ACK = 0,
@@ -98,7 +120,14 @@ struct upload_pack_data {
 
 	struct packet_writer writer;
 
+	struct commit_sketch sketch;				/* v2 only */
+	size_t sketch_filled;					/* v2 only */
+	timestamp_t sketch_since;				/* v2 only */
+	unsigned long sketch_max_age;				/* v2 only */
+
 	char *pack_objects_hook;
+	char *pack_cache;
+	unsigned long pack_cache_size;
 
 	unsigned stateless_rpc : 1;				/* v0 only */
 	unsigned no_done : 1;					/* v0 only */
@@ -119,10 +148,18 @@ struct upload_pack_data {
 	unsigned allow_sideband_all : 1;			/* v2 only */
 	unsigned seen_haves : 1;				/* v2 only */
 	unsigned allow_packfile_uris : 1;			/* v2 only */
+	unsigned allow_sketch : 1;				/* v2 only */
 	unsigned advertise_sid : 1;
 	unsigned sent_capabilities : 1;
+	unsigned use_bitmap_negotiation : 1;
+	unsigned tried_bitmap_negotiation : 1;
 };
 
+#define PACK_CACHE_DEFAULT_SIZE (1024ul * 1024 * 1024)
+
+/* in days, before the newest commit any of our refs point at */
+#define SKETCH_MAX_AGE_DEFAULT 30
+
 static void upload_pack_data_init(struct upload_pack_data *data)
 {
 	struct string_list symref = STRING_LIST_INIT_DUP;
@@ -150,14 +187,24 @@ static void upload_pack_data_init(struct upload_pack_data *data)
 	data->allow_filter_fallback = 1;
 	data->tree_filter_max_depth = ULONG_MAX;
 	packet_writer_init(&data->writer, 1);
+	packet_writer_buffer(&data->writer);
 	list_objects_filter_init(&data->filter_options);
 
 	data->keepalive = 5;
 	data->advertise_sid = 0;
+	data->use_bitmap_negotiation = 1;
+	data->pack_cache_size = PACK_CACHE_DEFAULT_SIZE;
+	data->sketch_max_age = SKETCH_MAX_AGE_DEFAULT;
 }
 
 static void upload_pack_data_clear(struct upload_pack_data *data)
 {
+	if (data->want_bitmap)
+		ewah_free(data->want_bitmap);
+	bitmap_free(data->have_bitmap);
+	oid_array_clear(&data->unplaced_haves);
+	free_bitmap_index(data->bitmap_git);
+
 	string_list_clear(&data->symref, 1);
 	strmap_clear(&data->wanted_refs, 1);
 	strvec_clear(&data->hidden_refs);
@@ -169,8 +216,11 @@ static void upload_pack_data_clear(struct upload_pack_data *data)
 	list_objects_filter_release(&data->filter_options);
 	string_list_clear(&data->allowed_filters, 0);
 	string_list_clear(&data->uri_protocols, 0);
+	commit_sketch_release(&data->sketch);
+	packet_writer_release(&data->writer);
 
 	free((char *)data->pack_objects_hook);
+	free(data->pack_cache);
 }
 
 static void reset_timeout(unsigned int timeout)
@@ -198,9 +248,9 @@ static void send_client_data(int fd, const char *data, ssize_t sz,
 
 static int write_one_shallow(const struct commit_graft *graft, void *cb_data)
 {
-	FILE *fp = cb_data;
+	struct strbuf *buf = cb_data;
 	if (graft->nr_parent == -1)
-		fprintf(fp, "--shallow %s\n", oid_to_hex(&graft->oid));
+		strbuf_addf(buf, "--shallow %s\n", oid_to_hex(&graft->oid));
 	return 0;
 }
 
@@ -213,8 +263,16 @@ struct output_state {
 	 */
 	char buffer[(LARGE_PACKET_DATA_MAX - 1) + 1];
 	int used;
+	/*
+	 * When not -1, everything read is also written to this file, up to
+	 * "tee_max" bytes; it is set back to -1 if that fails.
+	 */
+	int tee;
+	size_t teed, tee_max;
 	unsigned packfile_uris_started : 1;
 	unsigned packfile_started : 1;
+	/* set once the kernel refused to move data for us */
+	unsigned no_zero_copy : 1;
 };
 
 static int relay_pack_data(int pack_objects_out, struct output_state *os,
@@ -237,6 +295,12 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	if (readsz < 0) {
 		return readsz;
 	}
+	if (os->tee >= 0 && readsz) {
+		os->teed += readsz;
+		if (os->teed > os->tee_max ||
+		    write_in_full(os->tee, os->buffer + os->used, readsz) < 0)
+			os->tee = -1;
+	}
 	os->used += readsz;
 
 	while (!os->packfile_started) {
@@ -282,6 +346,249 @@ static int relay_pack_data(int pack_objects_out, struct output_state *os,
 	return readsz;
 }
 
+/* Most bytes sendfile() moves before we reset the timeout again. */
+#define ZERO_COPY_CHUNK (1024 * 1024)
+
+/*
+ * Move "len" bytes from "fd" to our stdout without copying them through
+ * our buffer: with splice() when "fd" is a pipe and with sendfile() when
+ * it is a file. Returns how many bytes were moved, which is short of
+ * "len" only when the kernel refused.
+ */
+static size_t move_to_stdout(int fd, int fd_is_pipe, size_t len)
+{
+	size_t moved = 0;
+
+	while (moved < len) {
+		ssize_t n = -1;
+
+#ifdef HAVE_SPLICE
+		if (fd_is_pipe)
+			n = splice(fd, NULL, 1, NULL, len - moved, SPLICE_F_MORE);
+#endif
+#ifdef HAVE_SENDFILE
+		if (!fd_is_pipe)
+			n = sendfile(1, fd, NULL, len - moved);
+#endif
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		moved += n;
+	}
+	return moved;
+}
+
+/*
+ * Send the byte "os" may be holding back and then "len" bytes that are
+ * ready to be read from "fd", like relay_pack_data() would, except that
+ * we only write the packet headers and let the kernel move the pack
+ * data.
+ */
+static void send_pack_data_zero_copy(int fd, int fd_is_pipe, size_t len,
+				     struct output_state *os, int use_sideband)
+{
+	while (len) {
+		char head[6];
+		size_t n = len, head_len = 0, moved;
+
+		if (use_sideband) {
+			if (n > use_sideband - 5 - os->used)
+				n = use_sideband - 5 - os->used;
+			xsnprintf(head, sizeof(head), "%04x",
+				  (unsigned)(os->used + n + 5));
+			head[4] = 1;
+			head_len = 5;
+		}
+		memcpy(head + head_len, os->buffer, os->used);
+		head_len += os->used;
+		os->used = 0;
+		write_or_die(1, head, head_len);
+
+		moved = os->no_zero_copy ? 0 : move_to_stdout(fd, fd_is_pipe, n);
+		if (moved < n)
+			os->no_zero_copy = 1;
+		while (moved < n) {
+			ssize_t readsz = xread(fd, os->buffer,
+					       n - moved < sizeof(os->buffer) ?
+					       n - moved : sizeof(os->buffer));
+			if (readsz <= 0)
+				die_errno("git upload-pack: unable to read pack data");
+			write_or_die(1, os->buffer, readsz);
+			moved += readsz;
+		}
+		len -= n;
+	}
+}
+
+/*
+ * Return how many of the bytes waiting in the pipe "fd" from pack-objects
+ * can go through send_pack_data_zero_copy(): all but the last one, which
+ * is held back as relay_pack_data() does, once the pack itself started.
+ */
+static size_t pipe_zero_copy_len(int fd, struct output_state *os)
+{
+#ifdef HAVE_SPLICE
+	int avail;
+
+	if (!os->packfile_started || os->no_zero_copy || os->tee >= 0 ||
+	    os->used > 1)
+		return 0;
+	if (ioctl(fd, FIONREAD, &avail) < 0 || avail < 2)
+		return 0;
+	return avail - 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Return how many bytes of the file "fd" from the pack cache can go
+ * through send_pack_data_zero_copy() next.
+ */
+static size_t file_zero_copy_len(int fd, struct output_state *os)
+{
+#ifdef HAVE_SENDFILE
+	struct stat st;
+	off_t pos;
+
+	if (!os->packfile_started || os->no_zero_copy || os->used > 1)
+		return 0;
+	pos = lseek(fd, 0, SEEK_CUR);
+	if (pos < 0 || fstat(fd, &st) || st.st_size <= pos)
+		return 0;
+	return st.st_size - pos < ZERO_COPY_CHUNK ?
+		st.st_size - pos : ZERO_COPY_CHUNK;
+#else
+	return 0;
+#endif
+}
+
+static int pack_cache_hash_ref(const char *refname, const char *referent UNUSED,
+			       const struct object_id *oid, int flags UNUSED,
+			       void *cb_data)
+{
+	struct git_hash_ctx *ctx = cb_data;
+
+	git_hash_update(ctx, refname, strlen(refname) + 1);
+	git_hash_update(ctx, oid->hash, the_hash_algo->rawsz);
+	return 0;
+}
+
+static int pack_cache_hash_config(const char *var, const char *value,
+				  const struct config_context *ctx UNUSED,
+				  void *cb_data)
+{
+	struct git_hash_ctx *hash_ctx = cb_data;
+
+	/* what pack-objects reads to decide what and how to send */
+	if (!starts_with(var, "core.") && !starts_with(var, "pack.") &&
+	    strcmp(var, "uploadpack.blobpackfileuri"))
+		return 0;
+	git_hash_update(hash_ctx, var, strlen(var) + 1);
+	if (value)
+		git_hash_update(hash_ctx, value, strlen(value) + 1);
+	else
+		git_hash_update(hash_ctx, "", 1);
+	return 0;
+}
+
+/*
+ * Name the entry of the pack cache for what pack-objects would send when
+ * run with "args" and fed "input". The refs are part of the key, as
+ * "--include-tag" looks at them, and so is the configuration that
+ * pack-objects reads.
+ */
+static void pack_cache_path(struct strbuf *path, const char *dir,
+			    const struct strvec *args, const struct strbuf *input)
+{
+	struct git_hash_ctx ctx;
+	struct object_id oid;
+	struct strbuf gitdir = STRBUF_INIT;
+
+	the_hash_algo->init_fn(&ctx);
+	strbuf_realpath(&gitdir, repo_get_git_dir(the_repository), 1);
+	git_hash_update(&ctx, gitdir.buf, gitdir.len + 1);
+	for (size_t i = 0; i < args->nr; i++) {
+		/* progress goes to stderr and is not cached */
+		if (!strcmp(args->v[i], "--progress"))
+			continue;
+		git_hash_update(&ctx, args->v[i], strlen(args->v[i]) + 1);
+	}
+	git_hash_update(&ctx, input->buf, input->len);
+	repo_config(the_repository, pack_cache_hash_config, &ctx);
+	refs_for_each_rawref(get_main_ref_store(the_repository),
+			     pack_cache_hash_ref, &ctx);
+	git_hash_final_oid(&oid, &ctx);
+
+	strbuf_addf(path, "%s/pack-%s.stream", dir, oid_to_hex(&oid));
+	strbuf_release(&gitdir);
+}
+
+struct pack_cache_entry {
+	char *name;
+	time_t mtime;
+	off_t size;
+};
+
+static int pack_cache_entry_cmp(const void *va, const void *vb)
+{
+	const struct pack_cache_entry *a = va, *b = vb;
+
+	if (a->mtime != b->mtime)
+		return a->mtime < b->mtime ? -1 : 1;
+	return strcmp(a->name, b->name);
+}
+
+/* Remove the least recently used entries until the cache fits "max_size". */
+static void prune_pack_cache(const char *dir, unsigned long max_size)
+{
+	struct pack_cache_entry *entries = NULL;
+	size_t nr = 0, alloc = 0;
+	struct strbuf path = STRBUF_INIT;
+	size_t dirlen;
+	uintmax_t total = 0;
+	struct dirent *de;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	strbuf_addf(&path, "%s/", dir);
+	dirlen = path.len;
+	while ((de = readdir(d))) {
+		struct stat st;
+
+		if (!starts_with(de->d_name, "pack-") ||
+		    !ends_with(de->d_name, ".stream"))
+			continue;
+		strbuf_setlen(&path, dirlen);
+		strbuf_addstr(&path, de->d_name);
+		if (stat(path.buf, &st))
+			continue;
+		ALLOC_GROW(entries, nr + 1, alloc);
+		entries[nr].name = xstrdup(de->d_name);
+		entries[nr].mtime = st.st_mtime;
+		entries[nr].size = st.st_size;
+		total += st.st_size;
+		nr++;
+	}
+	closedir(d);
+
+	QSORT(entries, nr, pack_cache_entry_cmp);
+	for (size_t i = 0; i < nr; i++) {
+		if (total > max_size) {
+			strbuf_setlen(&path, dirlen);
+			strbuf_addstr(&path, entries[i].name);
+			if (!unlink(path.buf))
+				total -= entries[i].size;
+		}
+		free(entries[i].name);
+	}
+	free(entries);
+	strbuf_release(&path);
+}
+
 static void create_pack_file(struct upload_pack_data *pack_data,
 			     const struct string_list *uri_protocols)
 {
@@ -292,7 +599,14 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 		"corruption on the remote side.";
 	ssize_t sz;
 	int i;
-	FILE *pipe_fd;
+	struct strbuf input = STRBUF_INIT;
+	struct strbuf cache_path = STRBUF_INIT;
+	struct tempfile *cache = NULL;
+
+	/* the pack goes to the client directly, after what we have said */
+	packet_writer_send(&pack_data->writer);
+
+	output_state->tee = -1;
 
 	if (!pack_data->pack_objects_hook)
 		pack_objects.git_cmd = 1;
@@ -333,6 +647,67 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 					 uri_protocols->items[i].string);
 	}
 
+	if (pack_data->shallow_nr)
+		for_each_commit_graft(write_one_shallow, &input);
+
+	for (i = 0; i < pack_data->want_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->want_obj.objects[i].item->oid));
+	strbuf_addstr(&input, "--not\n");
+	for (i = 0; i < pack_data->have_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->have_obj.objects[i].item->oid));
+	for (i = 0; i < pack_data->extra_edge_obj.nr; i++)
+		strbuf_addf(&input, "%s\n",
+			    oid_to_hex(&pack_data->extra_edge_obj.objects[i].item->oid));
+	strbuf_addch(&input, '\n');
+
+	/* a hook may want to see, or change, every pack that is sent */
+	if (pack_data->pack_cache && !pack_data->pack_objects_hook) {
+		int fd;
+
+		pack_cache_path(&cache_path, pack_data->pack_cache,
+				&pack_objects.args, &input);
+		fd = open(cache_path.buf, O_RDONLY);
+		if (fd >= 0) {
+			trace2_data_string("upload-pack", the_repository,
+					   "pack-cache", "hit");
+			/* keep it from being the next one evicted */
+			utime(cache_path.buf, NULL);
+			child_process_clear(&pack_objects);
+			do {
+				size_t len;
+
+				reset_timeout(pack_data->timeout);
+				len = file_zero_copy_len(fd, output_state);
+				if (len) {
+					send_pack_data_zero_copy(fd, 0, len, output_state,
+								 pack_data->use_sideband);
+					sz = len;
+				} else {
+					sz = relay_pack_data(fd, output_state,
+							     pack_data->use_sideband,
+							     !!uri_protocols);
+				}
+			} while (sz > 0);
+			close(fd);
+			if (sz < 0)
+				goto fail;
+			goto flush;
+		}
+
+		trace2_data_string("upload-pack", the_repository,
+				   "pack-cache", "miss");
+		strbuf_addf(&cache_path, ".tmp-XXXXXX");
+		if (safe_create_leading_directories_no_share(cache_path.buf) == SCLD_OK)
+			cache = mks_tempfile(cache_path.buf);
+		strbuf_setlen(&cache_path, cache_path.len - strlen(".tmp-XXXXXX"));
+		if (cache) {
+			output_state->tee = get_tempfile_fd(cache);
+			output_state->tee_max = pack_data->pack_cache_size;
+		}
+	}
+
 	pack_objects.in = -1;
 	pack_objects.out = -1;
 	pack_objects.err = -1;
@@ -341,24 +716,9 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 	if (start_command(&pack_objects))
 		die("git upload-pack: unable to fork git-pack-objects");
 
-	pipe_fd = xfdopen(pack_objects.in, "w");
-
-	if (pack_data->shallow_nr)
-		for_each_commit_graft(write_one_shallow, pipe_fd);
-
-	for (i = 0; i < pack_data->want_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->want_obj.objects[i].item->oid));
-	fprintf(pipe_fd, "--not\n");
-	for (i = 0; i < pack_data->have_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->have_obj.objects[i].item->oid));
-	for (i = 0; i < pack_data->extra_edge_obj.nr; i++)
-		fprintf(pipe_fd, "%s\n",
-			oid_to_hex(&pack_data->extra_edge_obj.objects[i].item->oid));
-	fprintf(pipe_fd, "\n");
-	fflush(pipe_fd);
-	fclose(pipe_fd);
+	if (write_in_full(pack_objects.in, input.buf, input.len) < 0)
+		die_errno("git upload-pack: unable to feed git-pack-objects");
+	close(pack_objects.in);
 
 	/* We read from pack_objects.err to capture stderr output for
 	 * progress bar, and pack_objects.out to capture the pack data.
@@ -422,10 +782,19 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 			continue;
 		}
 		if (0 <= pu && (pfd[pu].revents & (POLLIN|POLLHUP))) {
-			int result = relay_pack_data(pack_objects.out,
-						     output_state,
-						     pack_data->use_sideband,
-						     !!uri_protocols);
+			size_t len = pipe_zero_copy_len(pack_objects.out,
+							output_state);
+			int result = 1;
+
+			if (len)
+				send_pack_data_zero_copy(pack_objects.out, 1, len,
+							 output_state,
+							 pack_data->use_sideband);
+			else
+				result = relay_pack_data(pack_objects.out,
+							 output_state,
+							 pack_data->use_sideband,
+							 !!uri_protocols);
 
 			if (result == 0) {
 				close(pack_objects.out);
@@ -456,6 +825,20 @@ static void create_pack_file(struct upload_pack_data *pack_data,
 		goto fail;
 	}
 
+	if (cache) {
+		/* the tee gave up if the pack was too big or a write failed */
+		if (output_state->tee < 0 ||
+		    rename_tempfile(&cache, cache_path.buf))
+			delete_tempfile(&cache);
+		else
+			prune_pack_cache(pack_data->pack_cache,
+					 pack_data->pack_cache_size);
+	}
+
+flush:
+	strbuf_release(&input);
+	strbuf_release(&cache_path);
+
 	/* flush the data */
 	if (output_state->used > 0) {
 		send_client_data(1, output_state->buffer, output_state->used,
@@ -483,6 +866,7 @@ static int do_got_oid(struct upload_pack_data *data, const struct object_id *oid
 
 	if (!o)
 		die("oops (%s)", oid_to_hex(oid));
+	data->haves_seen++;
 	if (o->type == OBJ_COMMIT) {
 		struct commit_list *parents;
 		struct commit *commit = (struct commit *)o;
@@ -514,16 +898,121 @@ static int got_oid(struct upload_pack_data *data,
 	return do_got_oid(data, oid);
 }
 
+/*
+ * Past this many wants, finding a have below each of them one at a time
+ * costs more than the single walk of can_all_from_reach_with_flag().
+ */
+#define NEGOTIATION_BITMAPS_MAX_WANTS 256
+
+static int prepare_negotiation_bitmaps(struct upload_pack_data *data)
+{
+	if (data->tried_bitmap_negotiation)
+		return !!data->bitmap_git;
+	data->tried_bitmap_negotiation = 1;
+
+	if (!data->use_bitmap_negotiation ||
+	    data->want_obj.nr > NEGOTIATION_BITMAPS_MAX_WANTS)
+		return 0;
+	data->bitmap_git = prepare_bitmap_git(the_repository);
+	if (!data->bitmap_git)
+		return 0;
+	data->have_bitmap = bitmap_new();
+
+	return 1;
+}
+
+static void add_have_to_bitmap(struct upload_pack_data *data,
+			       const struct object_id *oid)
+{
+	if (bitmap_set_oid(data->bitmap_git, data->have_bitmap, oid) < 0)
+		oid_array_append(&data->unplaced_haves, oid);
+}
+
+static int have_stays_unplaced(const struct object_id *oid, void *cb_data)
+{
+	struct upload_pack_data *data = cb_data;
+
+	return bitmap_set_oid(data->bitmap_git, data->have_bitmap, oid) < 0;
+}
+
+/*
+ * Every want reaches one of the haves or one of their parents when the
+ * bitmap of the commits the want reaches shares a bit with those.
+ *
+ * A have outside of the bitmapped pack(s) only gets a position once the
+ * walk for some want has come across it, so the haves still without one
+ * are tried again after each new walk. Those left over have not been
+ * reached by any want walked so far.
+ */
+static int bitmap_ok_to_give_up(struct upload_pack_data *data)
+{
+	for (; data->haves_in_bitmap < data->have_obj.nr; data->haves_in_bitmap++) {
+		struct object *o =
+			data->have_obj.objects[data->haves_in_bitmap].item;
+
+		add_have_to_bitmap(data, &o->oid);
+		if (o->type == OBJ_COMMIT) {
+			struct commit_list *p;
+
+			for (p = ((struct commit *)o)->parents; p; p = p->next)
+				add_have_to_bitmap(data, &p->item->object.oid);
+		}
+	}
+
+	for (; data->wants_reached < data->want_obj.nr; data->wants_reached++) {
+		if (!data->want_bitmap) {
+			struct object *o;
+
+			o = deref_tag(the_repository,
+				      data->want_obj.objects[data->wants_reached].item,
+				      NULL, 0);
+			/*
+			 * As with can_all_from_reach_with_flag(), there is
+			 * no common ancestry to look for below anything else.
+			 */
+			if (!o || o->type != OBJ_COMMIT)
+				continue;
+
+			trace2_region_enter("upload-pack", "negotiation-bitmaps",
+					    the_repository);
+			data->want_bitmap =
+				bitmap_for_reachable_commits(data->bitmap_git,
+							     (struct commit *)o);
+			oid_array_filter(&data->unplaced_haves,
+					 have_stays_unplaced, data);
+			trace2_region_leave("upload-pack", "negotiation-bitmaps",
+					    the_repository);
+		}
+
+		if (!ewah_bitmap_intersects(data->want_bitmap,
+					    data->have_bitmap))
+			return 0;
+		ewah_free(data->want_bitmap);
+		data->want_bitmap = NULL;
+	}
+
+	return 1;
+}
+
 static int ok_to_give_up(struct upload_pack_data *data)
 {
 	timestamp_t min_generation = GENERATION_NUMBER_ZERO;
 
 	if (!data->have_obj.nr)
 		return 0;
+	if (data->haves_checked == data->haves_seen)
+		return data->give_up;
+	data->haves_checked = data->haves_seen;
 
-	return can_all_from_reach_with_flag(&data->want_obj, THEY_HAVE,
-					    COMMON_KNOWN, data->oldest_have,
-					    min_generation);
+	if (prepare_negotiation_bitmaps(data))
+		data->give_up = bitmap_ok_to_give_up(data);
+	else
+		data->give_up = can_all_from_reach_with_flag(&data->want_obj,
+							     THEY_HAVE,
+							     COMMON_KNOWN,
+							     data->oldest_have,
+							     min_generation);
+	return data->give_up;
 }
 
 static int get_common_commits(struct upload_pack_data *data,
@@ -546,15 +1035,19 @@ static int get_common_commits(struct upload_pack_data *data,
 			    && !got_other
 			    && ok_to_give_up(data)) {
 				sent_ready = 1;
-				packet_write_fmt(1, "ACK %s ready\n", last_hex);
+				packet_writer_write(&data->writer, "ACK %s ready\n", last_hex);
 			}
 			if (data->have_obj.nr == 0 || data->multi_ack)
-				packet_write_fmt(1, "NAK\n");
+				packet_writer_write(&data->writer, "NAK\n");
 
 			if (data->no_done && sent_ready) {
-				packet_write_fmt(1, "ACK %s\n", last_hex);
+				packet_writer_write(&data->writer, "ACK %s\n", last_hex);
+				packet_writer_send(&data->writer);
 				return 0;
 			}
+
+			/* the client waits for our answer to its batch */
+			packet_writer_send(&data->writer);
 			if (data->stateless_rpc)
 				exit(0);
 			got_common = 0;
@@ -570,20 +1063,20 @@ static int get_common_commits(struct upload_pack_data *data,
 					const char *hex = oid_to_hex(&oid);
 					if (data->multi_ack == MULTI_ACK_DETAILED) {
 						sent_ready = 1;
-						packet_write_fmt(1, "ACK %s ready\n", hex);
+						packet_writer_write(&data->writer, "ACK %s ready\n", hex);
 					} else
-						packet_write_fmt(1, "ACK %s continue\n", hex);
+						packet_writer_write(&data->writer, "ACK %s continue\n", hex);
 				}
 				break;
 			default:
 				got_common = 1;
 				oid_to_hex_r(last_hex, &oid);
 				if (data->multi_ack == MULTI_ACK_DETAILED)
-					packet_write_fmt(1, "ACK %s common\n", last_hex);
+					packet_writer_write(&data->writer, "ACK %s common\n", last_hex);
 				else if (data->multi_ack)
-					packet_write_fmt(1, "ACK %s continue\n", last_hex);
+					packet_writer_write(&data->writer, "ACK %s continue\n", last_hex);
 				else if (data->have_obj.nr == 1)
-					packet_write_fmt(1, "ACK %s\n", last_hex);
+					packet_writer_write(&data->writer, "ACK %s\n", last_hex);
 				break;
 			}
 			continue;
@@ -591,10 +1084,12 @@ static int get_common_commits(struct upload_pack_data *data,
 		if (!strcmp(reader->line, "done")) {
 			if (data->have_obj.nr > 0) {
 				if (data->multi_ack)
-					packet_write_fmt(1, "ACK %s\n", last_hex);
+					packet_writer_write(&data->writer, "ACK %s\n", last_hex);
+				packet_writer_send(&data->writer);
 				return 0;
 			}
-			packet_write_fmt(1, "NAK\n");
+			packet_writer_write(&data->writer, "NAK\n");
+			packet_writer_send(&data->writer);
 			return -1;
 		}
 		die("git upload-pack: expected SHA1 list, got '%s'", reader->line);
@@ -1209,7 +1704,7 @@ static void receive_needs(struct upload_pack_data *data,
 		return;
 
 	if (send_shallow_list(data))
-		packet_flush(1);
+		packet_writer_flush(&data->writer);
 }
 
 /* return non-zero if the ref is hidden, otherwise 0 */
@@ -1385,6 +1880,14 @@ static int upload_pack_config(const char *var, const char *value,
 		data->allow_filter = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowrefinwant", var)) {
 		data->allow_ref_in_want = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.packcachesize", var)) {
+		data->pack_cache_size = git_config_ulong(var, value, ctx->kvi);
+	} else if (!strcmp("uploadpack.allowsketch", var)) {
+		data->allow_sketch = git_config_bool(var, value);
+	} else if (!strcmp("uploadpack.sketchmaxage", var)) {
+		data->sketch_max_age = git_config_ulong(var, value, ctx->kvi);
+	} else if (!strcmp("uploadpack.negotiationbitmaps", var)) {
+		data->use_bitmap_negotiation = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.allowsidebandall", var)) {
 		data->allow_sideband_all = git_config_bool(var, value);
 	} else if (!strcmp("uploadpack.blobpackfileuri", var)) {
@@ -1410,6 +1913,10 @@ static int upload_pack_protected_config(const char *var, const char *value,
 
 	if (!strcmp("uploadpack.packobjectshook", var))
 		return git_config_string(&data->pack_objects_hook, var, value);
+	if (!strcmp("uploadpack.packcache", var)) {
+		FREE_AND_NULL(data->pack_cache);
+		return git_config_pathname(&data->pack_cache, var, value);
+	}
 	return 0;
 }
 
@@ -1689,10 +2196,37 @@ static void process_args(struct packet_reader *request,
 			continue;
 		}
 
+		if (data->allow_sketch && skip_prefix(arg, "sketch ", &p)) {
+			char *end;
+			uintmax_t nr;
+
+			if (data->sketch.nr)
+				send_err_and_die(data,
+						 "multiple sketch lines forbidden");
+			data->sketch_since = parse_timestamp(p, &end, 10);
+			if (*end++ != ' ')
+				send_err_and_die(data, "invalid sketch line");
+			nr = strtoumax(end, &end, 10);
+			if (*end || !nr || nr % COMMIT_SKETCH_PARTS ||
+			    nr > COMMIT_SKETCH_MAX_CELLS)
+				send_err_and_die(data, "invalid sketch line");
+			commit_sketch_init(&data->sketch, the_hash_algo, nr);
+			continue;
+		}
+		if (data->sketch.nr && skip_prefix(arg, "sketch-data ", &p)) {
+			if (commit_sketch_read(&data->sketch,
+					       &data->sketch_filled, p))
+				send_err_and_die(data, "invalid sketch-data line");
+			continue;
+		}
+
 		/* ignore unknown lines maybe? */
 		die("unexpected line: '%s'", arg);
 	}
 
+	if (data->sketch_filled != data->sketch.nr)
+		send_err_and_die(data, "incomplete sketch");
+
 	if (data->uri_protocols.nr && !data->writer.use_sideband)
 		string_list_clear(&data->uri_protocols, 0);
 
@@ -1703,6 +2237,110 @@ static void process_args(struct packet_reader *request,
 		trace2_fetch_info(data);
 }
 
+static int add_sketch_tip(const char *refname UNUSED,
+			  const char *referent UNUSED,
+			  const struct object_id *oid,
+			  int flag UNUSED,
+			  void *cb_data)
+{
+	struct commit *c = lookup_commit_reference_gently(the_repository,
+							  oid, 1);
+
+	if (c)
+		commit_list_insert(c, cb_data);
+	return 0;
+}
+
+/*
+ * Work out from the client's sketch which of our recent commits it has,
+ * and take those the wanted history runs into as if the client had sent
+ * "have" lines for them. If the difference is too large for the sketch
+ * to be decoded, or the sketch reaches back further than
+ * uploadpack.sketchMaxAge allows, the "have" lines the client sent along
+ * are all we go by.
+ */
+static void process_sketch(struct upload_pack_data *data)
+{
+	struct commit_list *tips = NULL, *queue = NULL;
+	struct oidset recent = OIDSET_INIT, missing = OIDSET_INIT;
+	struct oidset seen = OIDSET_INIT;
+	struct oidset_iter iter;
+	const struct object_id *oid;
+	struct commit_sketch ours;
+	struct commit *commit;
+	int decoded, nr_common = 0;
+
+	refs_for_each_ref(get_main_ref_store(the_repository),
+			  add_sketch_tip, &tips);
+
+	if (data->sketch_max_age) {
+		timestamp_t newest = 0, max_age;
+		struct commit_list *p;
+
+		for (p = tips; p; p = p->next)
+			if (p->item->date > newest)
+				newest = p->item->date;
+		max_age = (timestamp_t)data->sketch_max_age * 24 * 60 * 60;
+		if (newest > max_age && data->sketch_since < newest - max_age) {
+			trace2_data_intmax("upload-pack", the_repository,
+					   "sketch/too-old", 1);
+			goto out;
+		}
+	}
+
+	commit_sketch_collect(the_repository, tips, data->sketch_since,
+			      &recent);
+
+	commit_sketch_init(&ours, the_hash_algo, data->sketch.nr);
+	oidset_iter_init(&recent, &iter);
+	while ((oid = oidset_iter_next(&iter)))
+		commit_sketch_add(&ours, oid);
+	commit_sketch_subtract(&ours, &data->sketch);
+	decoded = !commit_sketch_decode(&ours, &missing, NULL);
+	commit_sketch_release(&ours);
+	trace2_data_intmax("upload-pack", the_repository, "sketch/decoded",
+			   decoded);
+	if (!decoded)
+		goto out;
+
+	/*
+	 * Walk down from the wants through the commits the client lacks.
+	 * Stop at those it has, and at those the sketch does not cover,
+	 * which are left to be sent (or not) as without a sketch.
+	 */
+	for (size_t i = 0; i < data->want_obj.nr; i++) {
+		struct object *o = data->want_obj.objects[i].item;
+
+		commit = lookup_commit_reference_gently(the_repository,
+							&o->oid, 1);
+		if (commit)
+			commit_list_insert(commit, &queue);
+	}
+	while ((commit = pop_commit(&queue))) {
+		struct commit_list *p;
+
+		oid = &commit->object.oid;
+		if (oidset_insert(&seen, oid) || !oidset_contains(&recent, oid))
+			continue;
+		if (!oidset_contains(&missing, oid)) {
+			nr_common += do_got_oid(data, oid);
+			continue;
+		}
+		for (p = commit->parents; p; p = p->next)
+			commit_list_insert(p->item, &queue);
+	}
+	if (nr_common)
+		data->seen_haves = 1;
+	trace2_data_intmax("upload-pack", the_repository, "sketch/common",
+			   nr_common);
+
+out:
+	free_commit_list(tips);
+	oidset_clear(&recent);
+	oidset_clear(&missing);
+	oidset_clear(&seen);
+}
+
 static int send_acks(struct upload_pack_data *data, struct object_array *acks)
 {
 	int i;
@@ -1777,7 +2415,7 @@ static void send_shallow_info(struct upload_pack_data *data)
 	    is_repository_shallow(the_repository))
 		deepen(data, INFINITE_DEPTH);
 
-	packet_delim(1);
+	packet_writer_delim(&data->writer);
 }
 
 enum upload_state {
@@ -1802,6 +2440,8 @@ int upload_pack_v2(struct repository *r, struct packet_reader *request)
 		switch (state) {
 		case UPLOAD_PROCESS_ARGS:
 			process_args(request, &data);
+			if (data.sketch.nr)
+				process_sketch(&data);
 
 			if (!data.want_obj.nr && !data.wait_for_done) {
 				/*
@@ -1874,6 +2514,9 @@ int upload_pack_advertise(struct repository *r,
 
 		if (data.allow_packfile_uris)
 			strbuf_addstr(value, " packfile-uris");
+
+		if (data.allow_sketch)
+			strbuf_addstr(value, " sketch");
 	}
 
 	upload_pack_data_clear(&data);
@@ -0,0 +1,8 @@
+#ifndef VERSION_DEF_H
+#define VERSION_DEF_H
+
+#define GIT_VERSION "2.51.GIT"
+#define GIT_BUILT_FROM_COMMIT "bd088e5b393d805e7e833b569e6d5e5529d3e7cf"
+#define GIT_USER_AGENT "git/2.51.GIT"
+
+#endif /* VERSION_DEF_H */
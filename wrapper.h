@@ -45,6 +45,13 @@ ssize_t read_in_full(int fd, void *buf, size_t count);
 ssize_t write_in_full(int fd, const void *buf, size_t count);
 ssize_t pread_in_full(int fd, void *buf, size_t count, off_t offset);
 
+/*
+ * Write all of the "iovcnt" buffers in "iov" like write_in_full() would
+ * write them one after the other, but in as few system calls as
+ * possible. "iov" is modified to keep track of partial writes.
+ */
+ssize_t writev_in_full(int fd, struct iovec *iov, int iovcnt);
+
 static inline ssize_t write_str_in_full(int fd, const char *str)
 {
 	return write_in_full(fd, str, strlen(str));